@@ -0,0 +1,113 @@
+/* The C side of c_abi.kcea: functions it calls through Decl, and calls of its Export functions */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kcrt.h"
+
+typedef int v8si __attribute__((vector_size(32)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef int v2si __attribute__((vector_size(8)));
+typedef unsigned char v4qu __attribute__((vector_size(4)));
+typedef short v1hi __attribute__((vector_size(2)));
+typedef unsigned char v2qu __attribute__((vector_size(2)));
+typedef unsigned char v1qu __attribute__((vector_size(1)));
+
+bool is_neg(short x);
+unsigned char pick(unsigned char x, bool b);
+int many(int a, int b, int c, int d, int e, struct kcrt_slice s);
+struct kcrt_slice tail(struct kcrt_slice s);
+v8si twice(v8si v);
+v2si triple(v2si v);
+v4qu bump(v4qu v);
+v4si square(v4si v);
+v1qu inc(v1qu v);
+v1hi negate(v1hi v);
+int spread(v2qu a, v1hi b, int c, int d, int e, int f, int g);
+
+int
+c_sum(int a, int b, int c, int d, int e, struct kcrt_slice s) {
+  return a + b + c + d + e + s.len;
+}
+
+int
+c_flags(bool b, unsigned char u, short s) {
+  return b * 1000000 + u * 1000 + s;
+}
+
+struct kcrt_slice
+c_xs(int len) {
+  char *data = malloc(len);
+  memset(data, 'x', len);
+  struct kcrt_slice s = {data, len};
+  return s;
+}
+
+v8si
+c_vec8(v8si v) {
+  return v * 2;
+}
+
+v2si
+c_vec2(v2si v) {
+  return v + 1;
+}
+
+v4qu
+c_bytes(v4qu v) {
+  return v + 2;
+}
+
+v4si
+c_vec4(v4si v) {
+  return v * v;
+}
+
+/* the vectors take an integer register each, which leaves g on the stack */
+v2qu
+c_small(v1qu a, v2qu b, v1hi c, int d, int e, int f, int g) {
+  unsigned char sum = a[0] + b[0] + b[1] + c[0] + d + e + f + g;
+  return (v2qu){sum, sum};
+}
+
+/* 0, or the number of the first check that failed plus 100 */
+int
+c_call_exports(void) {
+  if (!is_neg(-5) || is_neg(5)) {
+    return 101;
+  }
+  if (pick(250, true) != 250 || pick(250, false) != 0) {
+    return 102;
+  }
+  struct kcrt_slice s = {"xxyxx", 5};
+  if (many(1, 2, 3, 4, 5, s) != 19) {
+    return 103;
+  }
+  struct kcrt_slice t = tail(s);
+  if (t.data != s.data || t.len != 5) {
+    return 104;
+  }
+  v8si w = twice((v8si){1, 2, 3, 4, 5, 6, 7, 8});
+  if (w[0] != 2 || w[7] != 16) {
+    return 105;
+  }
+  v2si p = triple((v2si){5, 6});
+  if (p[0] != 15 || p[1] != 18) {
+    return 106;
+  }
+  v4qu q = bump((v4qu){1, 2, 3, 255});
+  if (q[0] != 2 || q[3] != 0) {
+    return 107;
+  }
+  v4si r = square((v4si){1, 2, 3, 4});
+  if (r[0] != 1 || r[3] != 16) {
+    return 108;
+  }
+  if (inc((v1qu){255})[0] != 0 || negate((v1hi){7})[0] != -7) {
+    return 109;
+  }
+  if (spread((v2qu){1, 2}, (v1hi){3}, 4, 5, 6, 7, 8) != 8022) {
+    return 110;
+  }
+  return 0;
+}
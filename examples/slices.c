@@ -0,0 +1,10 @@
+#include <stdlib.h>
+
+#include "kcrt.h"
+
+/* writable memory for slices.kcea; string literals are read-only */
+struct kcrt_slice
+alloc_bytes(int len) {
+  struct kcrt_slice s = {malloc(len), len};
+  return s;
+}
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "driver.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "typechecker.hpp"
+
+#include "generator.hpp"
+
+// Compiles generated programs phase by phase and reports throughput as JSON, e.g.
+//
+//   kccc++-bench --sweep=functions --steps=6 -o before.json
+//
+// Each sweep step doubles one GeneratorConfig knob; a phase scales linearly when its
+// tokens/nodes/functions per second stay flat across the steps.
+
+static llvm::cl::OptionCategory bench_category("kccc++-bench");
+
+static llvm::cl::opt<uint64_t> opt_seed(
+  "seed", llvm::cl::desc("generator seed"), llvm::cl::init(1), llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<size_t> opt_functions(
+  "functions",
+  llvm::cl::desc("number of DefFns"),
+  llvm::cl::init(GeneratorConfig().functions),
+  llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<size_t> opt_depth(
+  "depth",
+  llvm::cl::desc("expression nesting depth"),
+  llvm::cl::init(GeneratorConfig().depth),
+  llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<size_t> opt_lets(
+  "lets",
+  llvm::cl::desc("Let chain length per function"),
+  llvm::cl::init(GeneratorConfig().lets),
+  llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<size_t> opt_identifiers(
+  "identifiers",
+  llvm::cl::desc("parameters per function"),
+  llvm::cl::init(GeneratorConfig().identifiers),
+  llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<size_t> opt_literal_digits(
+  "literal-digits",
+  llvm::cl::desc("digits per integer literal"),
+  llvm::cl::init(GeneratorConfig().literal_digits),
+  llvm::cl::cat(bench_category));
+
+enum class Sweep { None, Functions, Depth, Lets, Identifiers, LiteralDigits };
+
+static llvm::cl::opt<Sweep> opt_sweep(
+  "sweep",
+  llvm::cl::desc("knob to double at each step"),
+  llvm::cl::values(
+    clEnumValN(Sweep::None, "none", "a single configuration"),
+    clEnumValN(Sweep::Functions, "functions", ""),
+    clEnumValN(Sweep::Depth, "depth", ""),
+    clEnumValN(Sweep::Lets, "lets", ""),
+    clEnumValN(Sweep::Identifiers, "identifiers", ""),
+    clEnumValN(Sweep::LiteralDigits, "literal-digits", "")),
+  llvm::cl::init(Sweep::None),
+  llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<unsigned> opt_steps(
+  "steps", llvm::cl::desc("sweep steps"), llvm::cl::init(5), llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<unsigned> opt_repeat(
+  "repeat",
+  llvm::cl::desc("compilations per configuration; the fastest one is reported"),
+  llvm::cl::init(3),
+  llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<std::string> opt_dump(
+  "dump",
+  llvm::cl::desc("also write the last generated program to <file>"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::init(""),
+  llvm::cl::cat(bench_category));
+
+static llvm::cl::opt<std::string> output_filename(
+  "o",
+  llvm::cl::desc("JSON output (default: stdout)"),
+  llvm::cl::value_desc("filename"),
+  llvm::cl::init("-"),
+  llvm::cl::cat(bench_category));
+
+enum Phase { Lex, Parse, TypeCheck, CodeGenPhase, Emit, NumPhases };
+
+static char const *const phase_names[NumPhases] = {"lex", "parse", "typecheck", "codegen", "emit"};
+
+struct PhaseResult {
+  double seconds = 0;
+  long peak_rss_kb = 0; // process high-water mark once the phase has finished
+};
+
+class Stopwatch {
+public:
+  Stopwatch(): start(std::chrono::steady_clock::now()) {
+  }
+  double elapsed() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start;
+};
+
+static llvm::Expected<llvm::json::Object>
+run_config(GeneratorConfig const &config) {
+  auto const prog = generate_program(config);
+  SourceFile const source("bench.kcea", prog.text);
+
+  if (!opt_dump.empty()) {
+    auto dest = create_raw_fd_stream(opt_dump, llvm::sys::fs::OF_Text);
+    if (!dest) {
+      return dest.takeError();
+    }
+    *dest.get() << prog.text;
+  }
+
+  PhaseResult results[NumPhases];
+  size_t ntokens = 0;
+  size_t ninsts = 0;
+  size_t object_bytes = 0;
+  auto const record = [&](Phase phase, unsigned run, Stopwatch const &watch) {
+    auto const seconds = watch.elapsed();
+    auto &r = results[phase];
+    r.seconds = (run == 0) ? seconds : std::min(r.seconds, seconds);
+    r.peak_rss_kb = std::max(r.peak_rss_kb, peak_rss_kb());
+  };
+
+  for (unsigned run = 0; run < std::max(1u, opt_repeat.getValue()); ++run) {
+    Stopwatch lex;
+    auto const tokens = LexicalAnalysis(source);
+    record(Lex, run, lex);
+    ntokens = tokens.size();
+
+    Stopwatch parse;
+    Parser parser(tokens);
+    auto const tunit = parser.parse_top_level_decl();
+    record(Parse, run, parse);
+
+    Stopwatch typecheck;
+    TypeChecker tc;
+    tc.traverse_tunit(tunit);
+    record(TypeCheck, run, typecheck);
+
+    llvm::LLVMContext ctxt;
+    llvm::Module mod("bench.kcea", ctxt);
+    llvm::IRBuilder<> builder(ctxt);
+    auto target_machine = create_target_machine(mod, 0);
+    if (!target_machine) {
+      return target_machine.takeError();
+    }
+
+    Stopwatch codegen;
+    CodeGen(ctxt, mod, builder).execute(tunit);
+    record(CodeGenPhase, run, codegen);
+    ninsts = mod.getInstructionCount();
+
+    llvm::SmallVector<char, 0> object;
+    llvm::raw_svector_ostream os(object);
+    Stopwatch emit;
+    if (auto err = emit_object_code(mod, *target_machine.get(), os)) {
+      return std::move(err);
+    }
+    record(Emit, run, emit);
+    object_bytes = object.size();
+  }
+
+  llvm::json::Object phases;
+  for (int p = 0; p < NumPhases; ++p) {
+    auto const &r = results[p];
+    auto const per_second = [&](size_t n) {
+      return (r.seconds > 0) ? n / r.seconds : 0.0;
+    };
+    phases[phase_names[p]] = llvm::json::Object{
+      {"seconds", r.seconds},
+      {"tokens_per_second", per_second(ntokens)},
+      {"nodes_per_second", per_second(prog.nodes)},
+      {"functions_per_second", per_second(prog.functions)},
+      {"peak_rss_kb", static_cast<int64_t>(r.peak_rss_kb)},
+    };
+  }
+  return llvm::json::Object{
+    {"config",
+     llvm::json::Object{
+       {"seed", static_cast<int64_t>(config.seed)},
+       {"functions", static_cast<int64_t>(config.functions)},
+       {"depth", static_cast<int64_t>(config.depth)},
+       {"lets", static_cast<int64_t>(config.lets)},
+       {"identifiers", static_cast<int64_t>(config.identifiers)},
+       {"literal_digits", static_cast<int64_t>(config.literal_digits)},
+     }},
+    {"source_bytes", static_cast<int64_t>(prog.text.size())},
+    {"tokens", static_cast<int64_t>(ntokens)},
+    {"nodes", static_cast<int64_t>(prog.nodes)},
+    {"functions", static_cast<int64_t>(prog.functions)},
+    {"llvm_instructions", static_cast<int64_t>(ninsts)},
+    {"object_bytes", static_cast<int64_t>(object_bytes)},
+    {"phases", std::move(phases)},
+  };
+}
+
+static size_t *
+swept_knob(GeneratorConfig &config) {
+  switch (opt_sweep) {
+    case Sweep::None:
+      return nullptr;
+    case Sweep::Functions:
+      return &config.functions;
+    case Sweep::Depth:
+      return &config.depth;
+    case Sweep::Lets:
+      return &config.lets;
+    case Sweep::Identifiers:
+      return &config.identifiers;
+    case Sweep::LiteralDigits:
+      return &config.literal_digits;
+  }
+  llvm_unreachable("unknown sweep");
+}
+
+int
+main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(argc, argv);
+
+  GeneratorConfig config;
+  config.seed = opt_seed;
+  config.functions = opt_functions;
+  config.depth = opt_depth;
+  config.lets = opt_lets;
+  config.identifiers = opt_identifiers;
+  config.literal_digits = opt_literal_digits;
+
+  auto const knob = swept_knob(config);
+  auto const steps = knob ? std::max(1u, opt_steps.getValue()) : 1;
+
+  llvm::json::Array runs;
+  for (unsigned step = 0; step < steps; ++step) {
+    auto result = run_config(config);
+    if (!result) {
+      llvm::logAllUnhandledErrors(result.takeError(), llvm::errs(), "[kccc++-bench] ");
+      return 1;
+    }
+    runs.push_back(std::move(result.get()));
+    if (knob) {
+      *knob *= 2;
+    }
+  }
+
+  auto dest = create_raw_fd_stream(output_filename, llvm::sys::fs::OF_Text);
+  if (!dest) {
+    llvm::logAllUnhandledErrors(dest.takeError(), llvm::errs(), "[kccc++-bench] ");
+    return 1;
+  }
+  llvm::json::Value const report = llvm::json::Object{
+    {"benchmark", "kccc++-frontend"},
+    {"repeat", static_cast<int64_t>(opt_repeat)},
+    {"runs", std::move(runs)},
+  };
+  *dest.get() << llvm::formatv("{0:2}", report) << "\n";
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "generator.hpp"
+
+namespace {
+
+class ProgramGenerator {
+public:
+  ProgramGenerator(GeneratorConfig const &c): config(c), rng(c.seed) {
+  }
+  GeneratedProgram run();
+
+private:
+  void function(size_t index);
+  void expr(size_t depth);
+  void leaf();
+  void literal();
+  void call(size_t depth);
+  size_t pick(size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+  }
+
+  GeneratorConfig const &config;
+  std::mt19937_64 rng;
+  GeneratedProgram prog;
+  std::vector<std::string> scope;
+  size_t current = 0;
+};
+
+GeneratedProgram
+ProgramGenerator::run() {
+  prog.nodes = 1; // TranslationUnit
+  for (size_t i = 0; i < config.functions; ++i) {
+    function(i);
+  }
+  prog.functions = config.functions;
+  return prog;
+}
+
+void
+ProgramGenerator::function(size_t index) {
+  current = index;
+  scope.clear();
+  auto &out = prog.text;
+  out += "DefFn f" + std::to_string(index) + "(";
+  for (size_t i = 0; i < config.identifiers; ++i) {
+    auto const name = "p" + std::to_string(i);
+    out += (i > 0) ? ", " : "";
+    out += name + ": i64";
+    scope.push_back(name);
+  }
+  out += ") -> i64 {\n";
+  prog.nodes += 2; // DefFn, BlockExpr
+
+  for (size_t i = 0; i < config.lets; ++i) {
+    auto const name = "v" + std::to_string(i);
+    out += "\tLet " + name + " = ";
+    expr(config.depth);
+    out += ";\n";
+    scope.push_back(name);
+    ++prog.nodes;
+  }
+  out += "\t";
+  expr(config.depth);
+  out += "\n}\n\n";
+}
+
+// One operand carries the remaining depth; the others are leaves, so an expression of depth d
+// has O(d) nodes.
+void
+ProgramGenerator::expr(size_t depth) {
+  if (depth == 0) {
+    leaf();
+    return;
+  }
+  auto &out = prog.text;
+  auto const choice = pick(8);
+  if (choice < 5) {
+    static char const *const ops[] = {" + ", " - ", " * "};
+    auto const deep_lhs = pick(2) == 0;
+    out += "(";
+    deep_lhs ? expr(depth - 1) : leaf();
+    out += ops[pick(3)];
+    deep_lhs ? leaf() : expr(depth - 1);
+    out += ")";
+    ++prog.nodes;
+  } else if (choice < 7 || current == 0) {
+    static char const *const cmps[] = {" < ", " > ", " = "};
+    out += "(If ";
+    leaf();
+    out += cmps[pick(3)];
+    leaf();
+    out += " Then ";
+    expr(depth - 1);
+    out += " Else ";
+    leaf();
+    out += ")";
+    prog.nodes += 2; // IfExpr, comparison
+  } else {
+    call(depth - 1);
+  }
+}
+
+void
+ProgramGenerator::leaf() {
+  if (scope.empty() || pick(3) == 0) {
+    literal();
+    return;
+  }
+  prog.text += scope[pick(scope.size())];
+  ++prog.nodes;
+}
+
+void
+ProgramGenerator::literal() {
+  auto const digits = std::max<size_t>(1, std::min<size_t>(config.literal_digits, 18));
+  prog.text += static_cast<char>('1' + pick(9));
+  for (size_t i = 1; i < digits; ++i) {
+    prog.text += static_cast<char>('0' + pick(10));
+  }
+  // literal-only subexpressions would otherwise default to i32 and clash with the parameters
+  prog.text += "i64";
+  ++prog.nodes;
+}
+
+// Only earlier functions are called, so the call graph is acyclic.
+void
+ProgramGenerator::call(size_t depth) {
+  auto &out = prog.text;
+  out += "f" + std::to_string(pick(current)) + "(";
+  auto const deep = pick(std::max<size_t>(config.identifiers, 1));
+  for (size_t i = 0; i < config.identifiers; ++i) {
+    out += (i > 0) ? ", " : "";
+    (i == deep) ? expr(depth) : leaf();
+  }
+  out += ")";
+  prog.nodes += 2; // CallExpr, callee VarRef
+}
+
+} // namespace
+
+GeneratedProgram
+generate_program(GeneratorConfig const &config) {
+  return ProgramGenerator(config).run();
+}
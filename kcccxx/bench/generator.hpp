@@ -0,0 +1,32 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shape of a synthetic .kcea program. Every knob scales the program linearly, so per-phase
+// throughput should stay flat as any one of them grows.
+struct GeneratorConfig {
+  uint64_t seed = 1;
+  size_t functions = 100;
+  // expressions nest this many levels deep along one operand
+  size_t depth = 4;
+  // Let bindings before the result expression of each body
+  size_t lets = 4;
+  // parameters of each function, all of which stay in scope for its body
+  size_t identifiers = 4;
+  // decimal digits of each integer literal (at most 18)
+  size_t literal_digits = 3;
+};
+
+struct GeneratedProgram {
+  std::string text;
+  size_t nodes = 0; // AST nodes the parser builds for text
+  size_t functions = 0;
+};
+
+// Deterministic for a given config: the same seed always produces the same program.
+GeneratedProgram generate_program(GeneratorConfig const &config);
+
+#endif /* !GENERATOR_HPP */
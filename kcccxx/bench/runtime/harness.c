@@ -0,0 +1,99 @@
+/* Times each kernel compiled by kccc++ against its C equivalent built at the same -O level. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef BENCH_OPT_LEVEL
+#define BENCH_OPT_LEVEL 0
+#endif
+
+struct octet_seq {
+  char const *data;
+  int cap;
+};
+
+/* sink for the slice-writing kernels: checksum the bytes instead of paying for write(2) */
+static volatile unsigned long written;
+
+int write_oseq(struct octet_seq os) {
+  unsigned long sum = written;
+  for (int i = 0; i < os.cap; ++i) {
+    sum = sum * 31 + (unsigned char)os.data[i];
+  }
+  written = sum;
+  return os.cap;
+}
+
+int kc_fib(int);
+int kc_preds(int);
+int kc_emit(int);
+int c_fib(int);
+int c_preds(int);
+int c_emit(int);
+
+struct kernel {
+  char const *name;
+  int (*kc)(int);
+  int (*c)(int);
+  int arg;
+};
+
+static struct kernel const kernels[] = {
+  {"fib", kc_fib, c_fib, 27},
+  {"preds", kc_preds, c_preds, 20000},
+  {"emit", kc_emit, c_emit, 20000},
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_double(void const *lhs, void const *rhs) {
+  double const l = *(double const *)lhs, r = *(double const *)rhs;
+  return (l > r) - (l < r);
+}
+
+/* median seconds per call over reps timed calls, after warmup untimed ones */
+static double measure(int (*fn)(int), int arg, int warmup, int reps, int *result) {
+  double *samples = malloc(sizeof(double) * reps);
+  for (int i = 0; i < warmup; ++i) {
+    *result = fn(arg);
+  }
+  for (int i = 0; i < reps; ++i) {
+    double const start = now();
+    *result = fn(arg);
+    samples[i] = now() - start;
+  }
+  qsort(samples, reps, sizeof(double), compare_double);
+  double const median = samples[reps / 2];
+  free(samples);
+  return median;
+}
+
+int main(int argc, char **argv) {
+  int const reps = (argc > 1) ? atoi(argv[1]) : 21;
+  int const warmup = (argc > 2) ? atoi(argv[2]) : 3;
+  if (reps < 1 || warmup < 0) {
+    fprintf(stderr, "usage: %s [reps] [warmup]\n", argv[0]);
+    return 1;
+  }
+
+  int status = 0;
+  for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+    struct kernel const *k = &kernels[i];
+    int kc_result, c_result;
+    double const kc = measure(k->kc, k->arg, warmup, reps, &kc_result);
+    double const c = measure(k->c, k->arg, warmup, reps, &c_result);
+    if (kc_result != c_result) {
+      fprintf(stderr, "%s(%d): kcea returned %d, C returned %d\n", k->name, k->arg, kc_result,
+              c_result);
+      status = 1;
+    }
+    printf("O%d  %-6s  kcea %10.3f us  c %10.3f us  ratio %6.2f\n", BENCH_OPT_LEVEL, k->name,
+           kc * 1e6, c * 1e6, kc / c);
+  }
+  return status;
+}
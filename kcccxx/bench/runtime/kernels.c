@@ -0,0 +1,53 @@
+/* C equivalents of kernels.kcea, written the way the .kcea versions are */
+#include <stdbool.h>
+
+struct octet_seq {
+  char const *data;
+  int cap;
+};
+
+int write_oseq(struct octet_seq os);
+
+int c_fib(int n) {
+  if (n < 3) {
+    return 1;
+  }
+  return c_fib(n - 1) + c_fib(n - 2);
+}
+
+static bool c_and(bool a, bool b) {
+  return a ? (b ? true : false) : false;
+}
+
+static bool c_or(bool a, bool b) {
+  return a ? true : (b ? true : false);
+}
+
+static bool c_lt1(int n) {
+  return n < 1;
+}
+
+static bool c_divisible(int n, int d) {
+  return c_lt1(n - d * (n / d));
+}
+
+static int c_count_preds(int n, int acc) {
+  if (c_lt1(n)) {
+    return acc;
+  }
+  return c_count_preds(
+    n - 1, acc + (c_or(c_and(c_divisible(n, 3), c_divisible(n, 5)), c_divisible(n, 7)) ? 1 : 0));
+}
+
+int c_preds(int n) {
+  return c_count_preds(n, 0);
+}
+
+int c_emit(int n) {
+  if (n < 1) {
+    return 0;
+  }
+  int const head = write_oseq((struct octet_seq){"hello, world", 12});
+  struct octet_seq const rest = {"!", 1};
+  return head + write_oseq(rest) + c_emit(n - 1);
+}
@@ -0,0 +1,94 @@
+#ifndef ABI_HPP
+#define ABI_HPP
+
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Attributes.h"
+#include "llvm/IR/IRBuilder.h"
+
+namespace llvm {
+class CallInst;
+class DataLayout;
+class Function;
+class FunctionType;
+class Module;
+class Type;
+class Value;
+} // namespace llvm
+
+class Type;
+
+// The C calling convention of a kcea function type, for the functions that C code calls or is
+// called by: Decl'd and imported externals, Export functions and main. Inside the module kcea
+// values keep their natural IR types; only the signature of such a function and the code on both
+// sides of the call change. On x86-64 System V,
+//
+//   Bool, u8, i8, i16, u16   extended to 32 bits by the caller (zeroext, signext)
+//   Slice T                  two INTEGER eightbytes: the pointer and the length in registers of
+//                            their own, or a byval copy on the stack once fewer than two are left;
+//                            returned in rax:edx
+//   Vec of 1, 2 or 4 bytes   INTEGER, as an i8, i16 or i32
+//   Vec of 8 bytes           SSE, as a double
+//   Vec of 16 bytes          SSE, in an xmm register
+//   other Vecs               MEMORY: a byval copy as argument, an sret slot as result
+//
+// Other targets only get the extensions.
+class FunctionAbi {
+public:
+  FunctionAbi(
+    llvm::Module &mod, llvm::ArrayRef<Type *> params, Type *ret, llvm::FunctionType *natural);
+
+  llvm::FunctionType *get_natural_type() const {
+    return natural;
+  }
+  // The C signature; the natural one when every value passes as is
+  llvm::FunctionType *get_type() const {
+    return lowered;
+  }
+  llvm::AttributeList get_attributes() const {
+    return attributes;
+  }
+  // the natural signature with no attributes, so that kcea code may call it as any other function
+  bool is_natural() const;
+  // some value goes through memory that the caller owns, which rules out tail calls
+  bool passes_in_memory() const;
+
+  // Caller side: a call of callee, which has the C signature, with the natural arguments args, and
+  // the natural result of such a call.
+  llvm::CallInst *create_call(
+    llvm::IRBuilder<> &b, llvm::FunctionCallee callee, llvm::ArrayRef<llvm::Value *> args) const;
+  llvm::Value *get_result(llvm::IRBuilder<> &b, llvm::CallInst *call) const;
+
+  // Callee side: the natural values of the parameters of fn, which has the C signature, and the
+  // return of the natural value val from it.
+  std::vector<llvm::Value *> get_params(llvm::IRBuilder<> &b, llvm::Function *fn) const;
+  void create_return(llvm::IRBuilder<> &b, llvm::Function *fn, llvm::Value *val) const;
+
+private:
+  struct Arg {
+    enum Kind {
+      Direct,   // as is
+      Expand,   // a struct as one argument per member
+      Coerce,   // bit cast to coerced
+      Indirect, // in memory: byval for arguments, sret for the result
+    };
+    Kind kind;
+    llvm::Type *type; // natural
+    llvm::Type *coerced;
+    llvm::Attribute::AttrKind extension; // ZExt, SExt or None
+  };
+
+  Arg classify(llvm::DataLayout const &layout, Type *type, llvm::Type *llt, bool result);
+
+  bool sysv; // x86-64 System V
+  llvm::FunctionType *natural;
+  llvm::FunctionType *lowered;
+  llvm::AttributeList attributes;
+  std::vector<Arg> params;
+  Arg ret;
+  // System V integer registers left for arguments while classifying
+  unsigned free_int_regs = 6;
+};
+
+#endif /* !ABI_HPP */
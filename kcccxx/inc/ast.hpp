@@ -1,6 +1,8 @@
 #ifndef AST_HPP
 #define AST_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -9,33 +11,57 @@ public:
   enum class AK {
     TranslationUnit,
     DefFn,
+    AwaitExpr,
     BinaryExpr,
     BlockExpr,
     BoolLiteral,
     CallExpr,
     DeclStmt,
+    EmbedExpr,
+    ForExpr,
     IntegerLiteral,
     IfExpr,
     LetStmt,
     OctetSeqLiteral,
+    ParExpr,
     VarRefExpr,
+    WhileExpr,
   };
 
 public:
-  Ast(AK k): kind(k) {
-  }
+  Ast(AK k);
   virtual ~Ast() = 0;
   AK get_kind() const {
     return kind;
   }
+  // byte offset of the first token in the source file
+  uint32_t get_loc() const {
+    return loc;
+  }
+  void set_loc(uint32_t offset) {
+    loc = offset;
+  }
 
 private:
   AK const kind;
+  uint32_t loc = 0;
 };
 
 class Type;
+class TyVar;
 
+// DefFn name[type parameters](parameters) -> type body
+//
+// A generic function, one with type parameters, is type checked once against them and emitted
+// once for each list of type arguments it is called with.
 class DefFnAst : public Ast {
+public:
+  enum Modifier : unsigned {
+    Memo = 1u << 0,
+    Export = 1u << 1,
+    Async = 1u << 2,
+  };
+
 public:
   DefFnAst(
     std::string const &fnname,
@@ -71,6 +97,21 @@ public:
   Ast *get_body() {
     return body;
   }
+  void add_modifier(Modifier m) {
+    modifiers |= m;
+  }
+  bool has_modifier(Modifier m) const {
+    return (modifiers & m) != 0;
+  }
+  std::vector<TyVar *> const &get_type_params() const {
+    return type_params;
+  }
+  void set_type_params(std::vector<TyVar *> const &tyvars) {
+    type_params = tyvars;
+  }
+  bool is_generic() const {
+    return !type_params.empty();
+  }
 
 private:
   std::string name;
@@ -78,6 +119,8 @@ private:
   Type *ret;
   std::vector<Type *> ptypes;
   Ast *body;
+  unsigned modifiers = 0;
+  std::vector<TyVar *> type_params;
 };
 
 class ExprAst : public Ast {
@@ -93,8 +136,8 @@ public:
   }
 
   static bool classof(Ast const *a) {
-    auto constexpr lb = static_cast<int>(AK::BinaryExpr);
-    auto constexpr ub = static_cast<int>(AK::VarRefExpr);
+    auto constexpr lb = static_cast<int>(AK::AwaitExpr);
+    auto constexpr ub = static_cast<int>(AK::WhileExpr);
 
     auto const num = static_cast<int>(a->get_kind());
     return lb <= num && num <= ub;
@@ -104,11 +147,41 @@ public:
   Type *get_type() const;
 
 private:
-  Type *type;
+  Type *type = nullptr;
 };
 
 class BinOp;
 
+class CallExprAst;
+
+// Await body
+//
+// Only in an Async function. Starts the calls to Async functions and async builtins among body and
+// its operands, the two sides of a binary expression or the arguments of a call, and suspends the
+// function until all of them have finished; then evaluates body with their results.
+class AwaitExprAst : public ExprAst {
+public:
+  AwaitExprAst(Ast *b): ExprAst(AK::AwaitExpr), body(b) {
+  }
+  static bool classof(Ast const *a) {
+    return a->get_kind() == AK::AwaitExpr;
+  }
+  Ast *get_body() {
+    return body;
+  }
+  // set by the type checker, in evaluation order
+  std::vector<CallExprAst *> const &get_awaited() const {
+    return awaited;
+  }
+  void set_awaited(std::vector<CallExprAst *> const &calls) {
+    awaited = calls;
+  }
+
+private:
+  Ast *body;
+  std::vector<CallExprAst *> awaited;
+};
+
 class BinaryExprAst : public ExprAst {
 public:
   BinaryExprAst(BinOp *binop, Ast *left, Ast *right):
@@ -183,10 +256,19 @@ public:
   Ast *get_nth_arg(size_t n) {
     return args[n];
   }
+  // set by the type checker for calls to generic functions, one per type parameter; they may name
+  // the type parameters of the enclosing function
+  std::vector<Type *> const &get_type_args() const {
+    return type_args;
+  }
+  void set_type_args(std::vector<Type *> const &types) {
+    type_args = types;
+  }
 
 private:
   Ast *callee;
   std::vector<Ast *> args;
+  std::vector<Type *> type_args;
 };
 
 class DeclStmtAst : public ExprAst {
@@ -208,19 +290,117 @@ private:
   Type *type;
 };
 
+// Hint clause of a loop; 0 leaves the choice to the optimizer
+struct LoopHints {
+  // vectorization width, 1 disables vectorization
+  unsigned vectorize = 0;
+  unsigned interleave = 0;
+  // unroll count, 1 disables unrolling
+  unsigned unroll = 0;
+};
+
+// Embed "path"
+//
+// The contents of a file as a Slice u8, the path relative to the directory of the source file. The
+// file is mapped before type checking, and codegen emits its bytes as they are.
+class EmbedExprAst : public ExprAst {
+public:
+  EmbedExprAst(std::string const &p): ExprAst(AK::EmbedExpr), path(p) {
+  }
+  static bool classof(Ast const *a) {
+    return a->get_kind() == AK::EmbedExpr;
+  }
+  std::string get_path() const {
+    return path;
+  }
+  // null until the file is mapped, which lasts through code generation
+  char const *get_data() const {
+    return data;
+  }
+  size_t get_size() const {
+    return size;
+  }
+  void set_contents(char const *bytes, size_t n) {
+    data = bytes;
+    size = n;
+  }
+
+private:
+  std::string path; // as written
+  char const *data = nullptr;
+  size_t size = 0;
+};
+
+// For var In start..end With acc = init Do body
+//
+// Runs body for var from start up to but excluding end; body computes the next value of acc from
+// var and acc. The value is the final acc.
+class ForExprAst : public ExprAst {
+public:
+  ForExprAst(
+    std::string const &v,
+    Ast *lo,
+    Ast *hi,
+    std::string const &a,
+    Ast *i,
+    Ast *b,
+    LoopHints const &h):
+      ExprAst(AK::ForExpr), var(v), start(lo), end(hi), acc(a), init(i), body(b), hints(h) {
+  }
+  static bool classof(Ast const *a) {
+    return a->get_kind() == AK::ForExpr;
+  }
+  std::string get_var_name() const {
+    return var;
+  }
+  Ast *get_start() {
+    return start;
+  }
+  Ast *get_end() {
+    return end;
+  }
+  std::string get_acc_name() const {
+    return acc;
+  }
+  Ast *get_init() {
+    return init;
+  }
+  Ast *get_body() {
+    return body;
+  }
+  LoopHints const &get_hints() const {
+    return hints;
+  }
+
+private:
+  std::string var;
+  Ast *start;
+  Ast *end;
+  std::string acc;
+  Ast *init;
+  Ast *body;
+  LoopHints hints;
+};
+
 class IntegerLiteralExpr : public ExprAst {
 public:
-  IntegerLiteralExpr(int v): ExprAst(AK::IntegerLiteral), val(v) {
+  IntegerLiteralExpr(uint64_t v, Type *suffix = nullptr):
+      ExprAst(AK::IntegerLiteral), val(v), suffix_type(suffix) {
   }
   static bool classof(Ast const *a) {
     return a->get_kind() == AK::IntegerLiteral;
   }
-  int get_value() const {
+  uint64_t get_value() const {
     return val;
   }
+  // type written as a suffix (10i64), nullptr if the type is left to the context
+  Type *get_suffix_type() const {
+    return suffix_type;
+  }
 
 private:
-  int val;
+  uint64_t val;
+  Type *suffix_type;
 };
 
 class IfExprAst : public ExprAst {
@@ -280,9 +460,48 @@ private:
   std::string content; // as written
 };
 
+// Par body
+//
+// Evaluates the operands of body, the two sides of a binary expression or the arguments of a call,
+// as parallel tasks before combining them.
+class ParExprAst : public ExprAst {
+public:
+  ParExprAst(Ast *b): ExprAst(AK::ParExpr), body(b) {
+  }
+  static bool classof(Ast const *a) {
+    return a->get_kind() == AK::ParExpr;
+  }
+  Ast *get_body() {
+    return body;
+  }
+  // empty unless body is a binary expression or a call
+  std::vector<Ast *> get_operands() {
+    if (body->get_kind() == AK::BinaryExpr) {
+      auto const bin = static_cast<BinaryExprAst *>(body);
+      return {bin->get_lhs(), bin->get_rhs()};
+    }
+    if (body->get_kind() == AK::CallExpr) {
+      auto const call = static_cast<CallExprAst *>(body);
+      std::vector<Ast *> args;
+      for (size_t i = 0, len = call->get_nargs(); i < len; ++i) {
+        args.push_back(call->get_nth_arg(i));
+      }
+      return args;
+    }
+    return {};
+  }
+
+private:
+  Ast *body;
+};
+
 class TranslationUnitAst : public Ast {
 public:
-  TranslationUnitAst(std::vector<Ast *> const &fn): Ast(AK::TranslationUnit), funcs(fn) {
+  TranslationUnitAst(
+    std::vector<Ast *> const &fn,
+    std::vector<std::string> const &modules = {},
+    std::vector<EmbedExprAst *> const &embedded = {}):
+      Ast(AK::TranslationUnit), funcs(fn), imports(modules), embeds(embedded) {
   }
   static bool classof(Ast const *a) {
     return a->get_kind() == AK::TranslationUnit;
@@ -293,9 +512,29 @@ public:
   Ast *get_nth_func(size_t n) {
     return funcs[n];
   }
+  std::vector<std::string> const &get_imports() const {
+    return imports;
+  }
+  // Decls of the functions brought in by the imports, visible to every function
+  void add_import_decl(Ast *decl) {
+    import_decls.push_back(decl);
+  }
+  size_t get_import_decl_count() const {
+    return import_decls.size();
+  }
+  Ast *get_nth_import_decl(size_t n) {
+    return import_decls[n];
+  }
+  // every Embed in the functions, for mapping their files
+  std::vector<EmbedExprAst *> const &get_embeds() const {
+    return embeds;
+  }
 
 private:
   std::vector<Ast *> funcs;
+  std::vector<std::string> imports;
+  std::vector<Ast *> import_decls;
+  std::vector<EmbedExprAst *> embeds;
 };
 
 class VarRefExprAst : public ExprAst {
@@ -313,4 +552,119 @@ private:
   std::string name;
 };
 
+// While cond With acc = init Do body
+//
+// Replaces acc by the value of body as long as cond holds for it. The value is the final acc.
+class WhileExprAst : public ExprAst {
+public:
+  WhileExprAst(Ast *c, std::string const &a, Ast *i, Ast *b, LoopHints const &h):
+      ExprAst(AK::WhileExpr), cond(c), acc(a), init(i), body(b), hints(h) {
+  }
+  static bool classof(Ast const *a) {
+    return a->get_kind() == AK::WhileExpr;
+  }
+  Ast *get_cond() {
+    return cond;
+  }
+  std::string get_acc_name() const {
+    return acc;
+  }
+  Ast *get_init() {
+    return init;
+  }
+  Ast *get_body() {
+    return body;
+  }
+  LoopHints const &get_hints() const {
+    return hints;
+  }
+
+private:
+  Ast *cond;
+  std::string acc;
+  Ast *init;
+  Ast *body;
+  LoopHints hints;
+};
+
+// Calls f on each child of ast in evaluation order: the functions of a translation unit, the body
+// of a DefFn and the subexpressions of an expression. Names bound by Let, Decl and loops are not
+// children, so passes that track scopes handle those nodes themselves. New kinds of node go here
+// too; the switch has no default so that -Wswitch points them out.
+template <typename F>
+void
+for_each_child(Ast *ast, F &&f) {
+  switch (ast->get_kind()) {
+    case Ast::AK::TranslationUnit: {
+      auto const tunit = static_cast<TranslationUnitAst *>(ast);
+      for (size_t i = 0, len = tunit->size(); i < len; ++i) {
+        f(tunit->get_nth_func(i));
+      }
+      break;
+    }
+    case Ast::AK::DefFn:
+      f(static_cast<DefFnAst *>(ast)->get_body());
+      break;
+    case Ast::AK::AwaitExpr:
+      f(static_cast<AwaitExprAst *>(ast)->get_body());
+      break;
+    case Ast::AK::BinaryExpr: {
+      auto const bin = static_cast<BinaryExprAst *>(ast);
+      f(bin->get_lhs());
+      f(bin->get_rhs());
+      break;
+    }
+    case Ast::AK::BlockExpr: {
+      auto const block = static_cast<BlockExprAst *>(ast);
+      for (size_t i = 0, len = block->size(); i < len; ++i) {
+        f(block->get_nth_stmt(i));
+      }
+      break;
+    }
+    case Ast::AK::CallExpr: {
+      auto const call = static_cast<CallExprAst *>(ast);
+      f(call->get_callee());
+      for (size_t i = 0, len = call->get_nargs(); i < len; ++i) {
+        f(call->get_nth_arg(i));
+      }
+      break;
+    }
+    case Ast::AK::ForExpr: {
+      auto const loop = static_cast<ForExprAst *>(ast);
+      f(loop->get_start());
+      f(loop->get_end());
+      f(loop->get_init());
+      f(loop->get_body());
+      break;
+    }
+    case Ast::AK::IfExpr: {
+      auto const ife = static_cast<IfExprAst *>(ast);
+      f(ife->get_cond());
+      f(ife->get_then());
+      f(ife->get_else());
+      break;
+    }
+    case Ast::AK::LetStmt:
+      f(static_cast<LetStmtAst *>(ast)->get_init());
+      break;
+    case Ast::AK::ParExpr:
+      f(static_cast<ParExprAst *>(ast)->get_body());
+      break;
+    case Ast::AK::WhileExpr: {
+      auto const loop = static_cast<WhileExprAst *>(ast);
+      f(loop->get_init());
+      f(loop->get_cond());
+      f(loop->get_body());
+      break;
+    }
+    case Ast::AK::BoolLiteral:
+    case Ast::AK::DeclStmt:
+    case Ast::AK::EmbedExpr:
+    case Ast::AK::IntegerLiteral:
+    case Ast::AK::OctetSeqLiteral:
+    case Ast::AK::VarRefExpr:
+      break;
+  }
+}
+
 #endif /* !AST_HPP */
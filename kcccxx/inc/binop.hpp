@@ -15,8 +15,7 @@ enum class BO {
 
 class BinOp {
 public:
-  BinOp(BO op): kind(op) {
-  }
+  BinOp(BO op);
   virtual ~BinOp() = 0;
   BO get_kind() const {
     return kind;
@@ -0,0 +1,52 @@
+#ifndef BUILTIN_HPP
+#define BUILTIN_HPP
+
+#include <string>
+
+#include "llvm/ADT/Optional.h"
+
+class FunctionType;
+
+// Byte-slice and Vec operations that the code generator expands in place instead of calling, so
+// that LLVM sees through them, and the I/O operations of the kcrt event loop. A function, Decl, Let
+// or parameter of the same name hides the builtin.
+enum class Builtin {
+  Find,    // find(s, b) -> i32: index of the first b in s, or -1
+  Compare, // compare(s, t) -> i32: negative, zero or positive as s sorts before, with or after t
+  Copy,    // copy(dst, src): copies the first min(len dst, len src) bytes; the slices may overlap
+  Fill,    // fill(dst, b): sets every byte of dst to b
+  Count,   // count(s, b) -> i32: number of b in s
+  Equal,   // equal(s, t) -> Bool
+
+  // Async: suspend the caller under Await, or run the event loop until done when called directly
+  ReadAsync,  // read_async(fd, buf) -> i32: bytes read into buf, 0 at end of file, or -errno
+  WriteAsync, // write_async(fd, s) -> i32: writes all of s; len s, or -errno
+  SleepAsync, // sleep_async(ms) -> i32: 0 after ms milliseconds
+
+  // Vec: typed per call, N and lane indices must be integer literals; indices and ranges past the
+  // end trap
+  Splat,     // splat(N, x) -> Vec N T: x in every lane
+  Extract,   // extract(v, i) -> T: lane i
+  Shuffle,   // shuffle(v, w, i...) -> Vec: lanes of v then w, one per index
+  Select,    // select(m, v, w) -> Vec N T: the lanes of v where m holds, of w elsewhere
+  ReduceAdd, // reduce_add(v) -> T: sum of the lanes, likewise reduce_mul, reduce_min, reduce_max
+  ReduceMul,
+  ReduceMin,
+  ReduceMax,
+  ReduceAnd, // reduce_and(m) -> Bool: every lane of m holds
+  ReduceOr,  // reduce_or(m) -> Bool: some lane of m holds
+  LoadVec,   // load_vec(N, s, i) -> Vec N T: s[i] to s[i + N - 1]
+  StoreVec,  // store_vec(s, i, v): the lanes of v to s[i] onward
+};
+
+llvm::Optional<Builtin> lookup_builtin(std::string const &name);
+// nullptr for the Vec builtins, which the type checker types per call
+FunctionType *get_builtin_type(Builtin builtin);
+// copy, fill and store_vec write through their first argument and the async builtins do I/O
+bool is_pure_builtin(Builtin builtin);
+// reads the bytes of a slice argument
+bool reads_memory_builtin(Builtin builtin);
+bool is_async_builtin(Builtin builtin);
+bool is_vector_builtin(Builtin builtin);
+
+#endif /* !BUILTIN_HPP */
@@ -5,27 +5,60 @@ class Ast;
 class BinaryExprAst;
 class DefFnAst;
 class IntegerLiteralExpr;
+class ProfileData;
+class SourceFile;
 
 class CodeGenImpl;
 
+namespace llvm {
+class TargetMachine;
+} // namespace llvm
+
+struct CodeGenOptions {
+  // -fprofile-generate: count function entries and IfExpr arms, append them to profile_output
+  bool profile_generate = false;
+  std::string profile_output = "default.kcprof";
+  // -fprofile-use: attach entry counts and branch weights from a previous run
+  ProfileData const *profile_use = nullptr;
+  // -fmemo-stats: report hit rates of Memo caches at exit
+  bool memo_stats = false;
+  // -g: emit DWARF line tables and variable locations for source
+  bool debug_info = false;
+  SourceFile const *source = nullptr;
+  // recorded in the debug info so that debuggers expect optimized-out variables
+  bool optimized = false;
+  // sizes the vector loops of the byte-slice builtins; 16 bytes without one
+  llvm::TargetMachine *target_machine = nullptr;
+};
+
 class CodeGen {
 public:
-  CodeGen(llvm::LLVMContext &ctxt, llvm::Module &mod, llvm::IRBuilder<> &builder);
+  CodeGen(
+    llvm::LLVMContext &ctxt,
+    llvm::Module &mod,
+    llvm::IRBuilder<> &builder,
+    CodeGenOptions const &opts = CodeGenOptions());
   ~CodeGen();
   bool execute(Ast *translation_unit);
 
   llvm::Value *generate_expr(Ast *);
+  llvm::Value *generate_async_call(CallExprAst *, llvm::Value *join);
+  llvm::Value *generate_await_expr(AwaitExprAst *);
   llvm::Value *generate_binary_expr(BinaryExprAst *);
   llvm::Value *generate_block_expr(BlockExprAst *);
   llvm::Value *generate_bool_literal(BoolLiteralExprAst *);
   llvm::Value *generate_call_expr(CallExprAst *);
   llvm::Value *generate_decl_stmt(DeclStmtAst *);
-  llvm::Value *generate_function_definition(DefFnAst *);
+  llvm::Value *generate_embed_expr(EmbedExprAst *);
+  llvm::Value *generate_for_expr(ForExprAst *);
+  llvm::Value *generate_function_definition(DefFnAst *, llvm::Function *);
   llvm::Value *generate_if_expr(IfExprAst *);
   llvm::Value *generate_integer_literal(IntegerLiteralExpr *);
   llvm::Value *generate_let_stmt(LetStmtAst *);
   llvm::Value *generate_octet_seq_literal(OctetSeqLiteralAst *);
+  llvm::Value *generate_par_expr(ParExprAst *);
   llvm::Value *generate_var_ref(VarRefExprAst *);
+  llvm::Value *generate_while_expr(WhileExprAst *);
 
 private:
   CodeGenImpl *pimpl;
@@ -0,0 +1,121 @@
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+
+#include "driver.hpp"
+#include "interface.hpp"
+#include "stats.hpp"
+
+namespace llvm {
+class LLVMContext;
+class Module;
+class TargetMachine;
+class ToolOutputFile;
+class raw_ostream;
+class raw_pwrite_stream;
+namespace orc {
+class LLJIT;
+}
+} // namespace llvm
+
+class SourceFile;
+class TranslationUnitAst;
+
+// The compiler as a library (libkccc). A CompilerInstance is one compilation: a source buffer goes
+// in, and an object, bitcode, IR or a JIT comes out. Everything a compilation touches hangs off
+// its instance, so a host may run any number of instances on different threads at once; they only
+// share the TargetMachinePool handed to them, which locks.
+//
+//   CompilerInstance ci(opts, &pool);
+//   if (auto err = ci.compile(SourceFile("f.kcea", text))) ...
+//   llvm::SmallVector<char, 0> object;
+//   llvm::raw_svector_ostream os(object);
+//   if (auto err = ci.emit_object(os)) ...
+//
+// Process-wide LLVM facilities stay with the host: -ftime-trace and pass timing are switched on
+// by it, and a CompileStats is activated per thread.
+class CompilerInstance {
+public:
+  // -Rpass remarks are printed to diag, and dropped without one.
+  explicit CompilerInstance(
+    CompileOptions options, TargetMachinePool *pool = nullptr, llvm::raw_ostream *diag = nullptr);
+  ~CompilerInstance();
+  CompilerInstance(CompilerInstance const &) = delete;
+  CompilerInstance &operator=(CompilerInstance const &) = delete;
+
+  // Lexes, parses, type checks and generates the module, then runs the optimization pipeline of
+  // options.opt_level. Imports are looked up next to options.input_filename, which need not exist
+  // when the source comes from memory. Can be called once.
+  llvm::Error compile(SourceFile source);
+  // compile() with the contents of options.input_filename
+  llvm::Error compile_file();
+
+  // The emitters need a successful compile(). With options.lto the module records its exports
+  // for --lto-link, so emit_bitcode() is what goes into an LTO link.
+  llvm::Error emit_object(llvm::raw_pwrite_stream &dest);
+  llvm::Error emit_bitcode(llvm::raw_ostream &dest);
+  llvm::Error emit_llvm_ir(llvm::raw_ostream &dest);
+  // Moves the module into a new LLJIT; symbols it does not define, the runtime library among them,
+  // resolve against the host process. The instance has no module afterwards.
+  llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> create_jit();
+
+  CompileOptions const &get_options() const {
+    return options;
+  }
+  // Export functions of the compiled module, for its .kci
+  ModuleInterface const &get_interface() const {
+    return iface;
+  }
+  // -ffunction-stats after CodeGen and Optimize
+  PhaseFunctionStats const &get_function_stats() const {
+    return function_stats;
+  }
+  llvm::Module *get_module() const {
+    return mod.get();
+  }
+
+private:
+  llvm::Error run_safely(std::function<llvm::Error()> const &fn);
+  llvm::Error generate();
+  llvm::Error setup_remarks(TranslationUnitAst *tunit);
+  void record_function_stats(char const *phase);
+
+  CompileOptions options;
+  TargetMachinePool *pool;
+  llvm::raw_ostream *diag;
+  std::unique_ptr<SourceFile> source;
+  // declared before the context, whose remark streamer writes to it, so that it is closed after
+  std::unique_ptr<llvm::ToolOutputFile> remarks_record;
+  std::unique_ptr<llvm::LLVMContext> ctxt;
+  std::unique_ptr<llvm::Module> mod;
+  std::unique_ptr<llvm::TargetMachine> target_machine;
+  ModuleInterface iface;
+  PhaseFunctionStats function_stats;
+  bool compiled = false;
+};
+
+// One compilation phase: a -ftime-report timer, a -ftime-trace span and a -fmem-report sample.
+class PhaseScope {
+public:
+  PhaseScope(char const *phase_name, char const *description, bool time_report);
+  ~PhaseScope();
+
+private:
+  char const *name;
+  llvm::NamedRegionTimer timer;
+  llvm::TimeTraceScope trace;
+};
+
+// Makes report_fatal_error() and crashes inside a CompilerInstance fail its call with an error
+// instead of ending the process. This installs process-wide signal and fatal error handlers, so
+// the host opts in; only the first call does the work.
+void enable_crash_recovery();
+
+#endif /* !COMPILER_HPP */
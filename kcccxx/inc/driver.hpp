@@ -0,0 +1,92 @@
+#ifndef DRIVER_HPP
+#define DRIVER_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace llvm {
+class LLVMContext;
+class Module;
+class raw_fd_ostream;
+class raw_pwrite_stream;
+} // namespace llvm
+
+// Back half of the compiler shared by kccc++ and its benchmarks: target setup, the optimization
+// pipeline and output.
+
+// One compilation, as given on the command line or sent by a --client.
+struct CompileOptions {
+  std::string input_filename;
+  std::string output_filename; // empty: kc.o, or <input>.ll with emit_llvm
+  unsigned opt_level = 0;
+  bool emit_llvm = false; // -S -emit-llvm
+  bool debug_info = false;
+  bool memo_stats = false;
+  bool profile_generate = false;
+  std::string profile_output; // empty: CodeGenOptions' default
+  std::string profile_use;
+  std::vector<std::string> import_paths; // -I, searched after the input's directory
+  std::string interface_filename;        // empty: no .kci is written
+  bool lto = false;                      // -flto: bitcode for --lto-link instead of an object
+  bool time_report = false;              // -ftime-report phase timers, never sent to a server
+  std::string remarks_passed;            // -Rpass, -Rpass-missed and -Rpass-analysis patterns
+  std::string remarks_missed;
+  std::string remarks_analysis;
+  std::string remarks_record;  // -fsave-optimization-record: YAML file of every remark
+  bool function_stats = false; // -ffunction-stats
+};
+
+llvm::Expected<std::unique_ptr<llvm::raw_fd_ostream>>
+create_raw_fd_stream(llvm::StringRef filename, llvm::sys::fs::OpenFlags flags);
+
+// Safe to call from several threads; only the first call does the work.
+void initialize_targets();
+
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>> create_target_machine(unsigned opt_level);
+// Sets the module's target triple and DataLayout to the target machine's.
+void configure_module(llvm::Module &mod, llvm::TargetMachine const &target_machine);
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+create_target_machine(llvm::Module &mod, unsigned opt_level);
+
+// TargetMachines are costly to build but must not be shared by concurrent compilations, so the
+// pool lends each one to a single compilation at a time and keeps it for the next.
+class TargetMachinePool {
+public:
+  llvm::Expected<std::unique_ptr<llvm::TargetMachine>> acquire(unsigned opt_level);
+  void release(unsigned opt_level, std::unique_ptr<llvm::TargetMachine> target_machine);
+
+private:
+  std::mutex mutex;
+  std::map<unsigned, std::vector<std::unique_ptr<llvm::TargetMachine>>> idle;
+};
+
+void optimize_module(llvm::Module &mod, llvm::TargetMachine &target_machine, unsigned opt_level);
+// The link-time pipeline, for a module that holds the whole program.
+void optimize_linked_module(llvm::Module &mod, llvm::TargetMachine &machine, unsigned opt_level);
+
+// -flto modules list the names of their Export functions, which --lto-link keeps external along
+// with main; everything else becomes internal to the linked module.
+void record_exports(llvm::Module &mod, std::vector<std::string> const &names);
+llvm::Expected<std::unique_ptr<llvm::Module>>
+link_modules(llvm::LLVMContext &ctxt, std::vector<std::string> const &filenames);
+
+llvm::Error emit_object_code(
+  llvm::Module &mod, llvm::TargetMachine &target_machine, llvm::raw_pwrite_stream &dest);
+llvm::Error output_object_code(
+  llvm::Module &mod, llvm::TargetMachine &target_machine, std::string const &filename);
+llvm::Error output_bitcode(llvm::Module &mod, std::string const &filename);
+llvm::Error output_llvm_ir(llvm::Module &mod, std::string const &filename);
+
+// Combines objects into the single relocatable object output with `ld -r`.
+llvm::Error link_relocatable(std::vector<std::string> const &objects, std::string const &output);
+
+std::string replace_file_extension(std::string const &filename, std::string const &extension);
+
+#endif /* !DRIVER_HPP */
@@ -0,0 +1,54 @@
+#ifndef EFFECT_HPP
+#define EFFECT_HPP
+
+#include <map>
+#include <set>
+#include <string>
+
+class ParExprAst;
+class TranslationUnitAst;
+
+// Call-graph effect analysis over the DefFns of a translation unit.
+//
+// Apart from Decl'd externals and the builtins that write slices, the language has no side
+// effects, so a function is pure when nothing it can reach calls one of those or an unknown
+// function value. A pure function may still read the slices it is given.
+class EffectAnalysis {
+public:
+  void analyze(TranslationUnitAst *tunit);
+
+  bool is_pure(std::string const &fn) const;
+  // fn or something it calls reads through a slice
+  bool reads_memory(std::string const &fn) const;
+  // fn or something it calls keeps a Memo cache (module-private state)
+  bool touches_memo_cache(std::string const &fn) const;
+  // fn or something it calls has a Par, whose tasks go through the runtime's deques and budget
+  bool spawns_tasks(std::string const &fn) const;
+  // fn can reach a call cycle or a While loop, so termination is not provable
+  bool may_diverge(std::string const &fn) const;
+
+  // the same for the operands of a Par, which run as parallel tasks
+  bool is_pure(ParExprAst const *par) const;
+  bool touches_memo_cache(ParExprAst const *par) const;
+
+private:
+  struct FnInfo {
+    std::set<std::string> callees;
+    bool calls_unknown = false;
+    bool reads = false;
+    bool memo = false;
+    bool par = false;
+    bool while_loop = false;
+
+    bool pure = false;
+    bool reads_reachable = false;
+    bool memo_reachable = false;
+    bool par_reachable = false;
+    bool diverges = false;
+  };
+  std::map<std::string, FnInfo> fns;
+  // only callees and calls_unknown are used
+  std::map<ParExprAst const *, FnInfo> pars;
+};
+
+#endif /* !EFFECT_HPP */
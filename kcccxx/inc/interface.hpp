@@ -0,0 +1,47 @@
+#ifndef INTERFACE_HPP
+#define INTERFACE_HPP
+
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+
+class FunctionType;
+class TranslationUnitAst;
+
+// Exported functions of a compiled module, as read by `Import` from the .kci file written next to
+// the module's object. The file is little-endian and made of 32-bit words:
+//
+//   "KCI1" <number of types> <number of params> <number of functions> <string table size>
+//   types:     <code> <a> <b> <c>          Function: a = return type, b = first param, c = arity
+//                                          IntN: a = width, b = signed; Slice: a = element type
+//   params:    <type index>                parameter lists of the Function types
+//   functions: <name offset> <name length> <type index>
+//   string table
+//
+// Structurally equal types are written once, and types only refer to types before them.
+class ModuleInterface {
+public:
+  struct Function {
+    std::string name;
+    FunctionType *type;
+  };
+
+  static ModuleInterface of(TranslationUnitAst *tunit);
+  // runtime/kcrt.h, which `Import kcrt` reads without an interface file
+  static ModuleInterface runtime();
+  static llvm::Expected<ModuleInterface> load(std::string const &filename);
+  llvm::Error write(std::string const &filename) const;
+
+  bool empty() const {
+    return functions.empty();
+  }
+  std::vector<Function> const &get_functions() const {
+    return functions;
+  }
+
+private:
+  std::vector<Function> functions;
+};
+
+#endif /* !INTERFACE_HPP */
@@ -1,6 +1,7 @@
 #ifndef LEXER_HPP
 #define LEXER_HPP
 
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -27,17 +28,22 @@ public:
   BadGetterException(std::string const &cause);
 };
 
+class SourceFile;
+
 class Token {
 public:
-  Token(TokenType type, std::string const &literal);
+  Token(TokenType type, std::string const &literal, uint32_t offset = 0);
   TokenType type() const;
   std::string representation() const;
+  uint32_t get_offset() const;
   std::string get_as_name() const;
-  int get_as_integer() const;
+  uint64_t get_as_integer() const;
+  std::string get_integer_suffix() const;
 
 private:
   TokenType token_type;
   std::string literal;
+  uint32_t offset; // in the source file
 };
 
 class TokenStream {
@@ -55,5 +61,6 @@ private:
 };
 
 std::vector<Token> LexicalAnalysis(std::string const &filename);
+std::vector<Token> LexicalAnalysis(SourceFile const &source);
 
 #endif /* !LEXER_HPP */
@@ -1,32 +1,46 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include <map>
+#include <string>
+
 class Parser {
 public:
   Parser(TokenStream const &stream): tokens(stream) {
   }
   TranslationUnitAst *parse_top_level_decl();
   Ast *parse_deffn_decl();
+  std::vector<TyVar *> parse_type_params();
 
   std::vector<Ast *> parse_stmt_seq();
   Ast *parse_stmt();
 
   Ast *parse_expr();
+  Ast *parse_await_expr();
   Ast *parse_binary_expr_seq();
   Ast *parse_block_expr();
   Ast *parse_decl_stmt();
+  Ast *parse_embed_expr();
+  Ast *parse_for_expr();
   Ast *parse_primary_expr();
   Ast *parse_integer_literal();
   Ast *parse_ident_expr();
   Ast *parse_if_expr();
   Ast *parse_let_stmt();
   Ast *parse_octet_seq_literal();
+  Ast *parse_par_expr();
+  Ast *parse_while_expr();
+  LoopHints parse_loop_hints();
 
   Type *parse_type();
   Type *parse_fn_type();
 
 private:
   TokenStream tokens;
+  // type parameters of the DefFn being parsed
+  std::map<std::string, TyVar *> type_param_scope;
+  size_t next_type_param = 0;
+  std::vector<EmbedExprAst *> embeds;
 };
 
 #endif /* !PARSER_HPP */
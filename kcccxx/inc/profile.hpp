@@ -0,0 +1,30 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+
+// Execution counts written by a -fprofile-generate build and read back by -fprofile-use.
+//
+// The file is plain text with one record per function per run:
+//
+//   <function hash in hex> <number of counters> <counter 0> <counter 1> ...
+//
+// Counter 0 counts function entries; every IfExpr then owns two consecutive counters (then, else)
+// in code generation order. Records with the same hash are summed, so repeated runs accumulate.
+class ProfileData {
+public:
+  static llvm::Expected<ProfileData> load(std::string const &filename);
+  std::vector<uint64_t> const *lookup(uint64_t hash) const;
+
+private:
+  std::map<uint64_t, std::vector<uint64_t>> counts;
+};
+
+uint64_t function_hash(std::string const &name);
+
+#endif /* !PROFILE_HPP */
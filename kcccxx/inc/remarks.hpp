@@ -0,0 +1,56 @@
+#ifndef REMARKS_HPP
+#define REMARKS_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Regex.h"
+
+namespace llvm {
+class raw_ostream;
+}
+
+class SourceFile;
+class TranslationUnitAst;
+
+// -Rpass, -Rpass-missed and -Rpass-analysis: optimization remarks of the passes whose name
+// matches the option's regular expression are printed clang style,
+//
+//   fib.kcea:9:14: remark: fib inlined into main with (cost=35, threshold=337) [-Rpass=inline]
+//
+// A remark is placed where its debug location says when the module has -g debug info, and
+// otherwise at the DefFn of the function it is about, instances and coroutine parts included.
+class RemarkHandler : public llvm::DiagnosticHandler {
+public:
+  // Empty patterns leave their kind of remark off.
+  static llvm::Expected<std::unique_ptr<RemarkHandler>> create(
+    std::string const &passed,
+    std::string const &missed,
+    std::string const &analysis,
+    SourceFile const &source,
+    TranslationUnitAst *tunit,
+    llvm::raw_ostream &diag);
+
+  bool handleDiagnostics(llvm::DiagnosticInfo const &info) override;
+  bool isAnalysisRemarkEnabled(llvm::StringRef pass) const override;
+  bool isMissedOptRemarkEnabled(llvm::StringRef pass) const override;
+  bool isPassedOptRemarkEnabled(llvm::StringRef pass) const override;
+  bool isAnyRemarkEnabled() const override;
+
+private:
+  RemarkHandler(SourceFile const &source, llvm::raw_ostream &diag);
+
+  // Regex::match() is not const
+  mutable llvm::Optional<llvm::Regex> passed;
+  mutable llvm::Optional<llvm::Regex> missed;
+  mutable llvm::Optional<llvm::Regex> analysis;
+  SourceFile const &source;
+  std::map<std::string, uint32_t> definitions; // DefFn name to its source offset
+  llvm::raw_ostream &diag;
+};
+
+#endif /* !REMARKS_HPP */
@@ -0,0 +1,35 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <functional>
+#include <string>
+
+#include "llvm/ADT/Optional.h"
+
+#include "driver.hpp"
+
+namespace llvm {
+class raw_ostream;
+}
+
+// Compile server for builds that run kccc++ on many small files. A --server process pays for
+// option parsing, target initialization and TargetMachine construction once, then compiles
+// requests from --client processes on a Unix socket, several at a time.
+//
+// Each request is a CompileOptions with absolute paths; the reply is the exit status and whatever
+// the compilation printed as diagnostics. A compilation that hits a fatal error or crashes fails
+// that request only.
+
+using CompileFunction = std::function<int(CompileOptions const &, llvm::raw_ostream &diag)>;
+
+// $XDG_RUNTIME_DIR/kccc++.sock, or /tmp/kccc++-<uid>.sock without a runtime directory
+std::string default_socket_path();
+
+// Returns only if the socket cannot be set up. nthreads 0 means one per hardware thread.
+int run_server(std::string const &socket_path, unsigned nthreads, CompileFunction compile);
+
+// Exit status of the compilation, or None if no server is listening on socket_path.
+llvm::Optional<int>
+run_client(std::string const &socket_path, CompileOptions const &opts, llvm::raw_ostream &diag);
+
+#endif /* !SERVER_HPP */
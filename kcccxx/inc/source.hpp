@@ -0,0 +1,32 @@
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+
+// Contents of one .kcea file. Tokens and AST nodes only carry byte offsets into it; lines and
+// columns are recovered here when diagnostics or debug info need them.
+class SourceFile {
+public:
+  SourceFile(std::string const &filename, std::string const &text);
+  static llvm::Expected<SourceFile> open(std::string const &filename);
+
+  std::string const &get_name() const {
+    return name;
+  }
+  std::string const &get_text() const {
+    return contents;
+  }
+  unsigned get_line(uint32_t offset) const;   // 1-origin
+  unsigned get_column(uint32_t offset) const; // 1-origin
+
+private:
+  std::string name;
+  std::string contents;
+  std::vector<uint32_t> line_starts;
+};
+
+#endif /* !SOURCE_HPP */
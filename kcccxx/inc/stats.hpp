@@ -0,0 +1,74 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ast.hpp"
+#include "type.hpp"
+
+namespace llvm {
+class Module;
+class raw_ostream;
+} // namespace llvm
+
+// Counters behind -fmem-report. The compiler's objects are never freed, so how many of each kind a
+// compilation creates is a direct measure of its memory use.
+//
+// Counting sites report into the instance activated on the current thread and do nothing when
+// there is none.
+class CompileStats {
+public:
+  static CompileStats *active() {
+    return current;
+  }
+  static void set_active(CompileStats *stats) {
+    current = stats;
+  }
+
+  size_t tokens = 0;
+  std::map<Ast::AK, size_t> ast_nodes;
+  std::map<Type::TK, size_t> types;
+  size_t binops = 0;
+  size_t typechecker_lookups = 0;
+  size_t codegen_lookups = 0;
+  std::vector<std::pair<std::string, size_t>> llvm_instructions; // after named phases
+  std::vector<std::pair<std::string, long>> peak_rss_kb;         // after named phases
+
+  void record_peak_rss(std::string const &phase);
+
+  // includes llvm::Statistic counters, which LLVM only collects in builds with statistics enabled
+  void print(llvm::raw_ostream &os) const;
+  void print_json(llvm::raw_ostream &os) const;
+
+private:
+  static thread_local CompileStats *current;
+};
+
+// One row of -ffunction-stats: the shape of a defined function's IR after some phase.
+struct FunctionStats {
+  std::string name;
+  size_t instructions = 0; // debug intrinsics excluded
+  size_t blocks = 0;
+  size_t allocas = 0;
+  size_t calls = 0;
+  // static allocas laid out with their alignment, an estimate of the frame before isel
+  uint64_t stack_bytes = 0;
+  bool dynamic_stack = false; // some alloca is sized at run time
+};
+
+using PhaseFunctionStats = std::vector<std::pair<std::string, std::vector<FunctionStats>>>;
+
+std::vector<FunctionStats> collect_function_stats(llvm::Module const &mod);
+// a row per function and phase; a function missing from a phase shows as -
+void print_function_stats(
+  llvm::raw_ostream &os, std::string const &module, PhaseFunctionStats const &phases);
+
+// high-water mark of this process's resident set
+long peak_rss_kb();
+
+#endif /* !STATS_HPP */
@@ -1,6 +1,10 @@
 #ifndef TYPE_HPP
 #define TYPE_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
 #include <vector>
 
 class Type {
@@ -13,11 +17,11 @@ public:
     Unit,
     Slice,
     TyVar,
+    Vec,
   };
 
 public:
-  Type(TK k): kind(k) {
-  }
+  Type(TK k);
   virtual ~Type() = 0;
   TK get_kind() const {
     return kind;
@@ -32,7 +36,7 @@ private:
 
 class IntNType : public Type {
 public:
-  IntNType(int w): Type(TK::IntN), width(w) {
+  IntNType(int w, bool s = true): Type(TK::IntN), width(w), sign(s) {
   }
   static bool classof(Type const *t) {
     return t->get_kind() == TK::IntN;
@@ -40,10 +44,14 @@ public:
   int get_width() const {
     return width;
   }
+  bool is_signed() const {
+    return sign;
+  }
   bool equal(Type *) const override;
 
 private:
   int const width;
+  bool const sign;
 };
 
 class BoolType : public Type {
@@ -98,22 +106,68 @@ public:
   Type *get_elem_type() const {
     return elem;
   }
+  bool equal(Type *) const override;
 
 private:
   Type *elem;
 };
 
+// type parameter of a generic DefFn
 class TyVar : public Type {
 public:
-  TyVar(size_t type_id): Type(TK::TyVar), id(type_id) {
+  // what the arguments of the parameter may be; Int ones allow arithmetic and comparisons
+  enum class Bound {
+    Any,
+    Int,
+  };
+
+public:
+  TyVar(size_t type_id, std::string const &param_name = "", Bound b = Bound::Any):
+      Type(TK::TyVar), id(type_id), name(param_name), bound(b) {
   }
   static bool classof(Type const *t) {
     return t->get_kind() == TK::TyVar;
   }
+  size_t get_id() const {
+    return id;
+  }
+  std::string get_name() const {
+    return name;
+  }
+  Bound get_bound() const {
+    return bound;
+  }
   bool equal(Type *) const override;
 
 private:
   size_t id;
+  std::string name;
+  Bound bound;
+};
+
+// Vec N T: N lanes of an integer type, u8 or Bool
+class VecType : public Type {
+public:
+  VecType(unsigned n, Type *el): Type(TK::Vec), lanes(n), elem(el) {
+  }
+  static bool classof(Type const *t) {
+    return t->get_kind() == TK::Vec;
+  }
+  // powers of two up to 64 lanes, which the targets have instructions for
+  static bool valid_lanes(uint64_t n) {
+    return n != 0 && n <= 64 && (n & (n - 1)) == 0;
+  }
+  unsigned get_lanes() const {
+    return lanes;
+  }
+  Type *get_elem_type() const {
+    return elem;
+  }
+  bool equal(Type *) const override;
+
+private:
+  unsigned lanes;
+  Type *elem;
 };
 
 class U8Type : public Type {
@@ -125,4 +179,11 @@ public:
   }
 };
 
+// arguments of type parameters, by TyVar id
+using TypeBindings = std::map<size_t, Type *>;
+// ty with the type parameters bound in bindings replaced; ty itself if none of them occurs
+Type *substitute(Type *ty, TypeBindings const &bindings);
+// ty as written in source, like "Slice u8"; canonical, so equal types have the same name
+std::string type_name(Type *ty);
+
 #endif /* !TYPE_HPP */
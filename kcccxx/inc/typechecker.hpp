@@ -1,12 +1,14 @@
 #ifndef TYPECHECKER_HPP
 #define TYPECHECKER_HPP
 
+enum class Builtin;
 class DefFnAst;
 class IfExprAst;
 class IntegerLiteral;
 class LetStmtAst;
 class TranslationUnitAst;
 
+class FunctionType;
 class Type;
 class TypeCheckerImpl;
 
@@ -19,14 +21,21 @@ public:
   Type *traverse_deffn(DefFnAst *);
 
   Type *traverse_expr(Ast *);
+  Type *traverse_await_expr(AwaitExprAst *);
   Type *traverse_binary_expr(BinaryExprAst *);
+  Type *traverse_operands(BinaryExprAst *);
   Type *traverse_block_expr(BlockExprAst *);
   Type *traverse_call_expr(CallExprAst *);
+  Type *traverse_generic_call(CallExprAst *, DefFnAst *, FunctionType *);
   Type *traverse_decl_stmt(DeclStmtAst *);
+  Type *traverse_for_expr(ForExprAst *);
   Type *traverse_if_expr(IfExprAst *);
   Type *traverse_integer_literal(IntegerLiteralExpr *);
   Type *traverse_let_stmt(LetStmtAst *);
+  Type *traverse_par_expr(ParExprAst *);
   Type *traverse_var_ref(VarRefExprAst *);
+  Type *traverse_vector_builtin(CallExprAst *, Builtin);
+  Type *traverse_while_expr(WhileExprAst *);
 
 private:
   std::unique_ptr<TypeCheckerImpl> pimpl;
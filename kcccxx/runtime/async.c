@@ -0,0 +1,346 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "kcrt.h"
+
+/* coroutine frames up to this size are recycled through per-size free lists */
+#define KCRT_FRAME_CLASS_SIZE 64
+#define KCRT_FRAME_CLASSES 32
+#define KCRT_MAX_EVENTS 64
+
+/* Frames are allocated with a header recording their size class, KCRT_FRAME_CLASSES for ones too
+ * large to recycle; the header keeps the frame 16-byte aligned. */
+union frame_header {
+  union frame_header *next;
+  unsigned class;
+  _Alignas(16) char pad[16];
+};
+
+static union frame_header *free_frames[KCRT_FRAME_CLASSES];
+
+void *
+kcrt_frame_alloc(unsigned long size) {
+  unsigned const class = (size + KCRT_FRAME_CLASS_SIZE - 1) / KCRT_FRAME_CLASS_SIZE;
+  union frame_header *h;
+  if (class < KCRT_FRAME_CLASSES && free_frames[class]) {
+    h = free_frames[class];
+    free_frames[class] = h->next;
+  } else {
+    unsigned long const rounded =
+      class < KCRT_FRAME_CLASSES ? (unsigned long)class * KCRT_FRAME_CLASS_SIZE : size;
+    h = malloc(sizeof(*h) + rounded);
+    if (!h) {
+      abort();
+    }
+  }
+  h->class = class < KCRT_FRAME_CLASSES ? class : KCRT_FRAME_CLASSES;
+  return h + 1;
+}
+
+void
+kcrt_frame_free(void *frame) {
+  if (!frame) {
+    return;
+  }
+  union frame_header *h = (union frame_header *)frame - 1;
+  unsigned const class = h->class;
+  if (class == KCRT_FRAME_CLASSES) {
+    free(h);
+    return;
+  }
+  h->next = free_frames[class];
+  free_frames[class] = h;
+}
+
+/* joins whose operations have all finished, in order; their coroutines resume from the loop so
+ * that an operation finishing never runs the waiting coroutine on top of its own stack */
+static struct kcrt_join *ready_head;
+static struct kcrt_join *ready_tail;
+
+void
+kcrt_join_done(struct kcrt_join *join) {
+  if (--join->pending > 0 || !join->resume) {
+    return;
+  }
+  join->next = NULL;
+  if (ready_tail) {
+    ready_tail->next = join;
+  } else {
+    ready_head = join;
+  }
+  ready_tail = join;
+}
+
+enum op_kind {
+  OP_READ,
+  OP_WRITE,
+  OP_SLEEP,
+};
+
+struct op {
+  enum op_kind kind;
+  int fd;
+  char *data;
+  int len;
+  int written;
+  int *result;
+  struct kcrt_join *join;
+  struct op *next;
+};
+
+/* Operations waiting for a file descriptor, and what the descriptor looked like before the first
+ * operation on it. */
+struct fd_state {
+  struct op *waiting;
+  unsigned events; /* registered with epoll, 0 if not registered */
+  int saved_flags; /* -1 unless made non-blocking here */
+};
+
+static int epfd = -1;
+static struct fd_state *fds;
+static int nfds;
+/* operations in the waiting lists */
+static int nwaiting;
+
+static struct fd_state *
+fd_state(int fd) {
+  if (fd >= nfds) {
+    int n = nfds ? nfds : 64;
+    while (n <= fd) {
+      n *= 2;
+    }
+    fds = realloc(fds, n * sizeof(*fds));
+    if (!fds) {
+      abort();
+    }
+    for (int i = nfds; i < n; ++i) {
+      fds[i] = (struct fd_state){NULL, 0, -1};
+    }
+    nfds = n;
+  }
+  return &fds[fd];
+}
+
+static void
+make_nonblocking(int fd) {
+  struct fd_state *st = fd_state(fd);
+  int const flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || (flags & O_NONBLOCK)) {
+    return;
+  }
+  if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 && st->saved_flags < 0) {
+    st->saved_flags = flags;
+  }
+}
+
+/* descriptors are shared with the parent process, stdin and stdout typically */
+__attribute__((destructor)) static void
+restore_blocking(void) {
+  for (int fd = 0; fd < nfds; ++fd) {
+    if (fds[fd].saved_flags >= 0) {
+      fcntl(fd, F_SETFL, fds[fd].saved_flags);
+    }
+  }
+}
+
+static void
+complete(struct op *op, int value) {
+  *op->result = value;
+  kcrt_join_done(op->join);
+  free(op);
+}
+
+/* Carries op as far as it goes without blocking. Returns 0 if it has to wait, or 1 once it has
+ * completed and is freed. */
+static int
+attempt(struct op *op) {
+  for (;;) {
+    ssize_t n;
+    switch (op->kind) {
+      case OP_READ:
+        n = read(op->fd, op->data, op->len);
+        break;
+      case OP_WRITE:
+        n = op->written < op->len ? write(op->fd, op->data + op->written, op->len - op->written)
+                                  : 0;
+        break;
+      case OP_SLEEP: {
+        uint64_t expirations;
+        n = read(op->fd, &expirations, sizeof(expirations));
+        break;
+      }
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+      n = -errno;
+    } else if (op->kind == OP_WRITE && op->written < op->len) {
+      op->written += n;
+      continue;
+    } else if (op->kind == OP_WRITE) {
+      n = op->written;
+    } else if (op->kind == OP_SLEEP) {
+      n = 0;
+    }
+    if (op->kind == OP_SLEEP) {
+      struct fd_state *st = fd_state(op->fd);
+      if (st->events) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, op->fd, NULL);
+        st->events = 0;
+      }
+      close(op->fd);
+    }
+    complete(op, (int)n);
+    return 1;
+  }
+}
+
+/* registers the events the waiting operations of fd need, and nothing once there are none */
+static int
+update_interest(int fd) {
+  struct fd_state *st = fd_state(fd);
+  unsigned events = 0;
+  for (struct op *op = st->waiting; op; op = op->next) {
+    events |= op->kind == OP_WRITE ? EPOLLOUT : EPOLLIN;
+  }
+  if (events == st->events) {
+    return 0;
+  }
+  int status;
+  if (events == 0) {
+    status = epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+  } else {
+    struct epoll_event ev = {.events = events, .data.fd = fd};
+    status = epoll_ctl(epfd, st->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+  }
+  st->events = events;
+  return status;
+}
+
+static void
+start(struct op *op) {
+  if (attempt(op)) {
+    return;
+  }
+  if (epfd < 0) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+      complete(op, -errno);
+      return;
+    }
+  }
+  struct fd_state *st = fd_state(op->fd);
+  op->next = st->waiting;
+  st->waiting = op;
+  if (update_interest(op->fd) < 0) {
+    int const err = errno;
+    st->waiting = op->next;
+    update_interest(op->fd);
+    complete(op, -err);
+    return;
+  }
+  ++nwaiting;
+}
+
+static struct op *
+new_op(enum op_kind kind, int fd, int *result, struct kcrt_join *join) {
+  struct op *op = malloc(sizeof(*op));
+  if (!op) {
+    abort();
+  }
+  *op = (struct op){kind, fd, NULL, 0, 0, result, join, NULL};
+  return op;
+}
+
+void
+kcrt_read_async(int fd, struct kcrt_slice buf, int *result, struct kcrt_join *join) {
+  struct op *op = new_op(OP_READ, fd, result, join);
+  op->data = (char *)buf.data;
+  op->len = buf.len;
+  make_nonblocking(fd);
+  start(op);
+}
+
+void
+kcrt_write_async(int fd, struct kcrt_slice s, int *result, struct kcrt_join *join) {
+  struct op *op = new_op(OP_WRITE, fd, result, join);
+  op->data = (char *)s.data;
+  op->len = s.len;
+  make_nonblocking(fd);
+  start(op);
+}
+
+void
+kcrt_sleep_async(int ms, int *result, struct kcrt_join *join) {
+  if (ms <= 0) {
+    *result = 0;
+    kcrt_join_done(join);
+    return;
+  }
+  int const fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    *result = -errno;
+    kcrt_join_done(join);
+    return;
+  }
+  struct itimerspec spec = {{0, 0}, {ms / 1000, (long)(ms % 1000) * 1000000}};
+  timerfd_settime(fd, 0, &spec, NULL);
+  start(new_op(OP_SLEEP, fd, result, join));
+}
+
+/* retries the operations waiting for fd that the events let through */
+static void
+dispatch(int fd, unsigned events) {
+  struct fd_state *st = fd_state(fd);
+  struct op **link = &st->waiting;
+  while (*link) {
+    struct op *op = *link;
+    unsigned const wanted = op->kind == OP_WRITE ? EPOLLOUT : EPOLLIN;
+    if (!(events & (wanted | EPOLLERR | EPOLLHUP))) {
+      link = &op->next;
+      continue;
+    }
+    *link = op->next;
+    if (attempt(op)) {
+      --nwaiting;
+    } else {
+      op->next = *link;
+      *link = op;
+      link = &op->next;
+    }
+  }
+  update_interest(fd);
+}
+
+void
+kcrt_async_run(struct kcrt_join *join) {
+  struct epoll_event events[KCRT_MAX_EVENTS];
+  while (join->pending > 0) {
+    if (ready_head) {
+      struct kcrt_join *ready = ready_head;
+      ready_head = ready->next;
+      if (!ready_head) {
+        ready_tail = NULL;
+      }
+      ready->resume(ready->handle);
+      continue;
+    }
+    if (nwaiting == 0) {
+      /* nothing could ever finish the join */
+      abort();
+    }
+    int const n = epoll_wait(epfd, events, KCRT_MAX_EVENTS, -1);
+    for (int i = 0; i < n; ++i) {
+      dispatch(events[i].data.fd, events[i].events);
+    }
+  }
+}
@@ -0,0 +1,182 @@
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "kcrt.h"
+
+#define KCRT_BUFFER_SIZE 65536
+/* iovecs per writev(2), well below IOV_MAX */
+#define KCRT_IOV_COUNT 64
+/* slices at least this long are handed to writev(2) in place instead of being copied */
+#define KCRT_COPY_LIMIT 512
+/* queueing a slice costs an iovec, so shorter static slices are copied all the same */
+#define KCRT_STATIC_COPY_LIMIT 64
+
+/* Pending output: iov lists the pieces in order, each either a run of buf or memory of the
+ * program that was queued in place. */
+struct channel {
+  int fd;
+  int niov;
+  size_t used;
+  struct iovec iov[KCRT_IOV_COUNT];
+  char buf[KCRT_BUFFER_SIZE];
+};
+
+static struct channel out = {1};
+
+static int
+flush_channel(struct channel *ch) {
+  struct iovec *iov = ch->iov;
+  int n = ch->niov;
+  int status = 0;
+  while (n > 0) {
+    ssize_t written = writev(ch->fd, iov, n);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      /* the fd was made non-blocking by an async operation on it */
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd pfd = {ch->fd, POLLOUT, 0};
+        poll(&pfd, 1, -1);
+        continue;
+      }
+      status = -1;
+      break;
+    }
+    while (n > 0 && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --n;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  ch->niov = 0;
+  ch->used = 0;
+  return status;
+}
+
+static int
+queue_in_place(struct channel *ch, char const *data, size_t len) {
+  if (ch->niov == KCRT_IOV_COUNT && flush_channel(ch) < 0) {
+    return -1;
+  }
+  ch->iov[ch->niov].iov_base = (void *)data;
+  ch->iov[ch->niov].iov_len = len;
+  ++ch->niov;
+  return 0;
+}
+
+static int
+append(struct channel *ch, char const *data, size_t len) {
+  /* make room first: a flush empties buf */
+  if ((ch->used + len > KCRT_BUFFER_SIZE || ch->niov == KCRT_IOV_COUNT)
+      && flush_channel(ch) < 0) {
+    return -1;
+  }
+  char *dst = ch->buf + ch->used;
+  memcpy(dst, data, len);
+  ch->used += len;
+  if (ch->niov > 0) {
+    struct iovec *last = &ch->iov[ch->niov - 1];
+    if ((char *)last->iov_base + last->iov_len == dst) {
+      last->iov_len += len;
+      return 0;
+    }
+  }
+  return queue_in_place(ch, dst, len);
+}
+
+int
+kcrt_write(struct kcrt_slice s) {
+  if (s.len <= 0) {
+    return 0;
+  }
+  if (s.len < KCRT_COPY_LIMIT) {
+    return append(&out, s.data, s.len);
+  }
+  /* written before returning, so the caller may reuse its memory */
+  if (queue_in_place(&out, s.data, s.len) < 0) {
+    return -1;
+  }
+  return flush_channel(&out);
+}
+
+int
+kcrt_write_static(struct kcrt_slice s) {
+  if (s.len <= 0) {
+    return 0;
+  }
+  if (s.len < KCRT_STATIC_COPY_LIMIT) {
+    return append(&out, s.data, s.len);
+  }
+  return queue_in_place(&out, s.data, s.len);
+}
+
+int
+kcrt_write_byte(unsigned char b) {
+  return append(&out, (char const *)&b, 1);
+}
+
+static char const digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+/* writes the digits of v so that they end at end, two at a time; returns their start */
+static char *
+format_u64(char *end, unsigned long long v) {
+  while (v >= 100) {
+    unsigned pair = (v % 100) * 2;
+    v /= 100;
+    *--end = digit_pairs[pair + 1];
+    *--end = digit_pairs[pair];
+  }
+  if (v >= 10) {
+    *--end = digit_pairs[v * 2 + 1];
+    *--end = digit_pairs[v * 2];
+  } else {
+    *--end = (char)('0' + v);
+  }
+  return end;
+}
+
+int
+kcrt_write_u64(unsigned long long v) {
+  char digits[20];
+  char *end = digits + sizeof(digits);
+  char *start = format_u64(end, v);
+  return append(&out, start, end - start);
+}
+
+int
+kcrt_write_i64(long long v) {
+  char digits[21];
+  char *end = digits + sizeof(digits);
+  char *start = format_u64(end, v < 0 ? 0 - (unsigned long long)v : (unsigned long long)v);
+  if (v < 0) {
+    *--start = '-';
+  }
+  return append(&out, start, end - start);
+}
+
+int
+kcrt_flush(void) {
+  return flush_channel(&out);
+}
+
+__attribute__((destructor)) static void
+flush_at_exit(void) {
+  flush_channel(&out);
+}
@@ -0,0 +1,75 @@
+/* kcrt: runtime library of programs compiled by kccc++. kcea code reaches it with `Import kcrt`;
+ * C code linked into the same program can use these declarations. */
+#ifndef KCRT_H
+#define KCRT_H
+
+/* Slice u8 */
+struct kcrt_slice {
+  char const *data;
+  int len;
+};
+
+/* Output to stdout goes through one buffer that is written with writev(2) when it fills, on
+ * kcrt_flush() and at exit. The functions return 0, or -1 when a write failed. They are not
+ * thread-safe. */
+
+/* copies s, or writes it at once in place when it is long */
+int kcrt_write(struct kcrt_slice s);
+/* queues s without copying it, so s must stay unchanged until the next flush; meant for Oc
+ * literals */
+int kcrt_write_static(struct kcrt_slice s);
+int kcrt_write_byte(unsigned char b);
+/* decimal */
+int kcrt_write_i64(long long v);
+int kcrt_write_u64(unsigned long long v);
+int kcrt_flush(void);
+
+/* Fork-join tasks behind Par expressions; kccc++ emits these calls itself. The generated code owns
+ * the task and its frame, fn(frame) evaluates one operand and leaves the value in the frame.
+ *
+ * kcrt_par_budget is the number of nested Par levels that still spawn tasks on this thread; below
+ * that the operands run sequentially in place. kcrt_par_init() starts one worker per online CPU,
+ * or KCRT_WORKERS of them, and sets the budget to KCRT_PAR_CUTOFF levels (12 by default). Idle
+ * workers steal from the others' deques. */
+struct kcrt_task {
+  void (*fn)(void *frame);
+  void *frame;
+  int budget;
+  _Atomic int done;
+};
+
+extern _Thread_local int kcrt_par_budget;
+
+void kcrt_par_init(void);
+/* queues task, or runs it at once when the queue is full */
+void kcrt_spawn(struct kcrt_task *task, void (*fn)(void *frame), void *frame);
+/* returns once task has run, running it here unless it was stolen */
+void kcrt_sync(struct kcrt_task *task);
+
+/* Async functions and the async builtins, on one event loop per program; kccc++ emits these calls
+ * itself. An Async function is a coroutine whose frame comes from kcrt_frame_alloc(). Await starts
+ * its operations with a join counting them and suspends the coroutine; the operation that finishes
+ * last queues the join, and the loop resumes the coroutine through join->resume. A call outside
+ * Await gets a join of its own with no resume and runs the loop in kcrt_async_run() until done.
+ *
+ * The loop waits with epoll(7). A file descriptor is switched to non-blocking mode by its first
+ * read or write operation, and back at exit. Not thread-safe. */
+struct kcrt_join {
+  int pending;
+  void (*resume)(void *handle);
+  void *handle;
+  struct kcrt_join *next;
+};
+
+void *kcrt_frame_alloc(unsigned long size);
+void kcrt_frame_free(void *frame);
+/* one operation of join has finished */
+void kcrt_join_done(struct kcrt_join *join);
+/* resumes ready coroutines and waits for I/O until join has no operations pending */
+void kcrt_async_run(struct kcrt_join *join);
+/* the async builtins: each leaves its value in *result, then counts down join */
+void kcrt_read_async(int fd, struct kcrt_slice buf, int *result, struct kcrt_join *join);
+void kcrt_write_async(int fd, struct kcrt_slice s, int *result, struct kcrt_join *join);
+void kcrt_sleep_async(int ms, int *result, struct kcrt_join *join);
+
+#endif /* !KCRT_H */
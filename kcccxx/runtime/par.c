@@ -0,0 +1,223 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "kcrt.h"
+
+#define KCRT_MAX_WORKERS 256
+#define KCRT_DEFAULT_CUTOFF 12
+/* a power of two; with the cutoff in place a deque rarely holds more than a few dozen tasks */
+#define KCRT_DEQUE_SIZE 1024
+/* rounds of failed steals before an idle worker goes to sleep */
+#define KCRT_IDLE_ROUNDS 64
+
+/* Chase-Lev work-stealing deque, in the C11 formulation of Lê et al. (PPoPP 2013). The owner
+ * pushes and pops at bottom, thieves take the oldest task at top. The array does not grow: a full
+ * deque makes kcrt_spawn() run the task in place. */
+struct deque {
+  _Alignas(64) atomic_long top;
+  _Alignas(64) atomic_long bottom;
+  _Atomic(struct kcrt_task *) tasks[KCRT_DEQUE_SIZE];
+};
+
+struct worker {
+  struct deque deque;
+  unsigned seed;
+};
+
+static struct worker workers[KCRT_MAX_WORKERS];
+static int nworkers;
+static _Thread_local struct worker *self;
+_Thread_local int kcrt_par_budget;
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int sleepers;
+
+static int
+push(struct deque *d, struct kcrt_task *task) {
+  long const b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  long const t = atomic_load_explicit(&d->top, memory_order_acquire);
+  if (b - t >= KCRT_DEQUE_SIZE) {
+    return 0;
+  }
+  atomic_store_explicit(&d->tasks[b & (KCRT_DEQUE_SIZE - 1)], task, memory_order_relaxed);
+  /* publishes the task to thieves, which load bottom with acquire */
+  atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+  return 1;
+}
+
+static struct kcrt_task *
+pop(struct deque *d) {
+  long const b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+  if (t > b) {
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return NULL;
+  }
+  struct kcrt_task *task =
+    atomic_load_explicit(&d->tasks[b & (KCRT_DEQUE_SIZE - 1)], memory_order_relaxed);
+  if (t == b) {
+    /* the last task: race the thieves for it */
+    if (!atomic_compare_exchange_strong_explicit(
+          &d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+      task = NULL;
+    }
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  }
+  return task;
+}
+
+static struct kcrt_task *
+steal(struct deque *d) {
+  long t = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long const b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+  if (t >= b) {
+    return NULL;
+  }
+  struct kcrt_task *task =
+    atomic_load_explicit(&d->tasks[t & (KCRT_DEQUE_SIZE - 1)], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(
+        &d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+    return NULL;
+  }
+  return task;
+}
+
+/* one pass over the other workers, starting at a random one */
+static struct kcrt_task *
+steal_any(struct worker *w) {
+  w->seed = w->seed * 1103515245 + 12345;
+  int const start = (int)((w->seed >> 16) % (unsigned)nworkers);
+  for (int i = 0; i < nworkers; ++i) {
+    struct worker *victim = &workers[(start + i) % nworkers];
+    if (victim == w) {
+      continue;
+    }
+    struct kcrt_task *task = steal(&victim->deque);
+    if (task) {
+      return task;
+    }
+  }
+  return NULL;
+}
+
+static void
+run(struct kcrt_task *task) {
+  int const saved = kcrt_par_budget;
+  kcrt_par_budget = task->budget;
+  task->fn(task->frame);
+  kcrt_par_budget = saved;
+  /* the spawner may return as soon as it sees this, taking task with it */
+  atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+static void *
+worker_main(void *arg) {
+  self = arg;
+  for (;;) {
+    struct kcrt_task *task = NULL;
+    for (int round = 0; !task && round < KCRT_IDLE_ROUNDS; ++round) {
+      task = steal_any(self);
+      if (!task) {
+        sched_yield();
+      }
+    }
+    if (!task) {
+      /* Either kcrt_spawn() sees sleepers raised and signals under the lock, or the steal
+       * attempt below sees its push: each side has a full fence between its store and its load. */
+      pthread_mutex_lock(&idle_lock);
+      atomic_fetch_add(&sleepers, 1);
+      atomic_thread_fence(memory_order_seq_cst);
+      task = steal_any(self);
+      if (!task) {
+        pthread_cond_wait(&idle_cond, &idle_lock);
+      }
+      atomic_fetch_sub(&sleepers, 1);
+      pthread_mutex_unlock(&idle_lock);
+    }
+    if (task) {
+      run(task);
+    }
+  }
+  return NULL;
+}
+
+static int
+env_int(char const *name, int fallback) {
+  char const *value = getenv(name);
+  return value && *value ? atoi(value) : fallback;
+}
+
+void
+kcrt_par_init(void) {
+  if (self) {
+    return;
+  }
+  long n = env_int("KCRT_WORKERS", (int)sysconf(_SC_NPROCESSORS_ONLN));
+  n = n < 1 ? 1 : n > KCRT_MAX_WORKERS ? KCRT_MAX_WORKERS : n;
+  nworkers = (int)n;
+  self = &workers[0];
+  for (int i = 0; i < nworkers; ++i) {
+    workers[i].seed = (unsigned)i * 2654435761u + 1;
+  }
+  if (nworkers == 1) {
+    return;
+  }
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (int i = 1; i < nworkers; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, worker_main, &workers[i]) != 0) {
+      nworkers = i;
+      break;
+    }
+  }
+  pthread_attr_destroy(&attr);
+  if (nworkers > 1) {
+    kcrt_par_budget = env_int("KCRT_PAR_CUTOFF", KCRT_DEFAULT_CUTOFF);
+  }
+}
+
+void
+kcrt_spawn(struct kcrt_task *task, void (*fn)(void *frame), void *frame) {
+  task->fn = fn;
+  task->frame = frame;
+  task->budget = --kcrt_par_budget;
+  atomic_store_explicit(&task->done, 0, memory_order_relaxed);
+  if (!self || !push(&self->deque, task)) {
+    run(task);
+    return;
+  }
+  /* keeps the load of sleepers from moving before the push */
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&sleepers) > 0) {
+    pthread_mutex_lock(&idle_lock);
+    pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+  }
+}
+
+void
+kcrt_sync(struct kcrt_task *task) {
+  /* Tasks are synced in the reverse order of spawning, so the bottom of the deque is either task
+   * or, once task was stolen, nothing. While the thief works, help the others. */
+  while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+    struct kcrt_task *next = pop(&self->deque);
+    if (!next) {
+      next = steal_any(self);
+    }
+    if (next) {
+      run(next);
+    } else {
+      sched_yield();
+    }
+  }
+  ++kcrt_par_budget;
+}
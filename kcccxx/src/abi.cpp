@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Casting.h"
+
+#include "abi.hpp"
+#include "type.hpp"
+
+static llvm::Attribute::AttrKind
+get_extension(Type *type) {
+  if (llvm::isa<BoolType>(type) || llvm::isa<U8Type>(type)) {
+    return llvm::Attribute::ZExt;
+  }
+  if (auto const intty = llvm::dyn_cast<IntNType>(type)) {
+    if (intty->get_width() < 32) {
+      return intty->is_signed() ? llvm::Attribute::SExt : llvm::Attribute::ZExt;
+    }
+  }
+  return llvm::Attribute::None;
+}
+
+FunctionAbi::Arg
+FunctionAbi::classify(llvm::DataLayout const &layout, Type *type, llvm::Type *llt, bool result) {
+  Arg arg{Arg::Direct, llt, nullptr, get_extension(type)};
+  if (!sysv) {
+    return arg;
+  }
+  if (llvm::isa<SliceType>(type)) {
+    // a struct goes to the stack whole when its eightbytes do not all fit in registers
+    if (!result && free_int_regs >= 2) {
+      arg.kind = Arg::Expand;
+      free_int_regs -= 2;
+    } else if (!result) {
+      arg.kind = Arg::Indirect;
+    }
+    return arg;
+  }
+  auto const vec = llvm::dyn_cast<VecType>(type);
+  if (!vec) {
+    if (!result && free_int_regs > 0) {
+      --free_int_regs;
+    }
+    return arg;
+  }
+  // vectors of Bool have no C counterpart
+  if (llvm::isa<BoolType>(vec->get_elem_type())) {
+    return arg;
+  }
+  auto &ctxt = llt->getContext();
+  auto const size = layout.getTypeAllocSize(llt);
+  switch (size) {
+    case 1:
+    case 2:
+    case 4:
+      arg.kind = Arg::Coerce;
+      arg.coerced = llvm::Type::getIntNTy(ctxt, 8 * size);
+      if (!result && free_int_regs > 0) {
+        --free_int_regs;
+      }
+      break;
+    case 8:
+      arg.kind = Arg::Coerce;
+      arg.coerced = llvm::Type::getDoubleTy(ctxt);
+      break;
+    case 16:
+      break;
+    default:
+      arg.kind = Arg::Indirect;
+      break;
+  }
+  return arg;
+}
+
+FunctionAbi::FunctionAbi(
+  llvm::Module &mod, llvm::ArrayRef<Type *> params, Type *ret, llvm::FunctionType *natural):
+    natural(natural) {
+  auto &ctxt = mod.getContext();
+  auto const &layout = mod.getDataLayout();
+  llvm::Triple const triple(mod.getTargetTriple());
+  sysv = triple.getArch() == llvm::Triple::x86_64 && !triple.isOSWindows();
+
+  std::vector<llvm::Type *> types;
+  std::vector<llvm::AttributeSet> param_attrs;
+  llvm::AttributeSet ret_attrs;
+  auto const attribute_set = [&](llvm::ArrayRef<llvm::Attribute> attrs) {
+    return llvm::AttributeSet::get(ctxt, attrs);
+  };
+  this->ret = classify(layout, ret, natural->getReturnType(), true);
+  auto ret_type = this->ret.kind == Arg::Coerce ? this->ret.coerced : this->ret.type;
+  if (this->ret.kind == Arg::Indirect) {
+    // the slot takes the first register
+    --free_int_regs;
+    types.push_back(this->ret.type->getPointerTo());
+    param_attrs.push_back(attribute_set(
+      {llvm::Attribute::get(ctxt, llvm::Attribute::StructRet),
+       llvm::Attribute::get(ctxt, llvm::Attribute::NoAlias)}));
+    ret_type = llvm::Type::getVoidTy(ctxt);
+  } else if (this->ret.extension != llvm::Attribute::None) {
+    ret_attrs = attribute_set({llvm::Attribute::get(ctxt, this->ret.extension)});
+  }
+
+  for (size_t i = 0; i < params.size(); ++i) {
+    auto const arg = classify(layout, params[i], natural->getParamType(i), false);
+    switch (arg.kind) {
+      case Arg::Direct:
+        types.push_back(arg.type);
+        param_attrs.push_back(
+          arg.extension != llvm::Attribute::None
+            ? attribute_set({llvm::Attribute::get(ctxt, arg.extension)})
+            : llvm::AttributeSet());
+        break;
+      case Arg::Expand:
+        for (auto &&member : llvm::cast<llvm::StructType>(arg.type)->elements()) {
+          types.push_back(member);
+          param_attrs.emplace_back();
+        }
+        break;
+      case Arg::Coerce:
+        types.push_back(arg.coerced);
+        param_attrs.emplace_back();
+        break;
+      case Arg::Indirect: {
+        auto const align = std::max<uint64_t>(layout.getABITypeAlignment(arg.type), 8);
+        types.push_back(arg.type->getPointerTo());
+        param_attrs.push_back(attribute_set(
+          {llvm::Attribute::getWithByValType(ctxt, arg.type),
+           llvm::Attribute::getWithAlignment(ctxt, llvm::Align(align))}));
+        break;
+      }
+    }
+    this->params.push_back(arg);
+  }
+  lowered = llvm::FunctionType::get(ret_type, types, false /* not variadic */);
+  attributes = llvm::AttributeList::get(ctxt, llvm::AttributeSet(), ret_attrs, param_attrs);
+}
+
+bool
+FunctionAbi::is_natural() const {
+  auto const natural_arg = [](Arg const &arg) {
+    return arg.kind == Arg::Direct && arg.extension == llvm::Attribute::None;
+  };
+  return natural_arg(ret) && std::all_of(params.begin(), params.end(), natural_arg);
+}
+
+bool
+FunctionAbi::passes_in_memory() const {
+  auto const indirect = [](Arg const &arg) { return arg.kind == Arg::Indirect; };
+  return indirect(ret) || std::any_of(params.begin(), params.end(), indirect);
+}
+
+llvm::CallInst *
+FunctionAbi::create_call(
+  llvm::IRBuilder<> &b, llvm::FunctionCallee callee, llvm::ArrayRef<llvm::Value *> args) const {
+  auto const caller = b.GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entry(&caller->getEntryBlock(), caller->getEntryBlock().begin());
+  std::vector<llvm::Value *> lowered_args;
+  if (ret.kind == Arg::Indirect) {
+    lowered_args.push_back(entry.CreateAlloca(ret.type, nullptr, "sret"));
+  }
+  for (size_t i = 0; i < params.size(); ++i) {
+    auto const &param = params[i];
+    switch (param.kind) {
+      case Arg::Direct:
+        lowered_args.push_back(args[i]);
+        break;
+      case Arg::Expand:
+        for (unsigned j = 0, len = param.type->getStructNumElements(); j < len; ++j) {
+          lowered_args.push_back(b.CreateExtractValue(args[i], j));
+        }
+        break;
+      case Arg::Coerce:
+        lowered_args.push_back(b.CreateBitCast(args[i], param.coerced));
+        break;
+      case Arg::Indirect: {
+        auto const copy = entry.CreateAlloca(param.type, nullptr, "byval");
+        b.CreateStore(args[i], copy);
+        lowered_args.push_back(copy);
+        break;
+      }
+    }
+  }
+  auto const call = b.CreateCall(callee, lowered_args);
+  call->setAttributes(attributes);
+  return call;
+}
+
+llvm::Value *
+FunctionAbi::get_result(llvm::IRBuilder<> &b, llvm::CallInst *call) const {
+  switch (ret.kind) {
+    case Arg::Coerce:
+      return b.CreateBitCast(call, ret.type);
+    case Arg::Indirect:
+      return b.CreateLoad(ret.type, call->getArgOperand(0));
+    default:
+      return call;
+  }
+}
+
+std::vector<llvm::Value *>
+FunctionAbi::get_params(llvm::IRBuilder<> &b, llvm::Function *fn) const {
+  std::vector<llvm::Value *> vals;
+  auto arg = fn->arg_begin() + (ret.kind == Arg::Indirect ? 1 : 0);
+  for (auto &&param : params) {
+    switch (param.kind) {
+      case Arg::Direct:
+        vals.push_back(arg++);
+        break;
+      case Arg::Expand: {
+        llvm::Value *agg = llvm::UndefValue::get(param.type);
+        for (unsigned j = 0, len = param.type->getStructNumElements(); j < len; ++j) {
+          agg = b.CreateInsertValue(agg, arg++, j);
+        }
+        vals.push_back(agg);
+        break;
+      }
+      case Arg::Coerce:
+        vals.push_back(b.CreateBitCast(arg++, param.type));
+        break;
+      case Arg::Indirect:
+        vals.push_back(b.CreateLoad(param.type, arg++));
+        break;
+    }
+  }
+  return vals;
+}
+
+void
+FunctionAbi::create_return(llvm::IRBuilder<> &b, llvm::Function *fn, llvm::Value *val) const {
+  switch (ret.kind) {
+    case Arg::Coerce:
+      b.CreateRet(b.CreateBitCast(val, ret.coerced));
+      break;
+    case Arg::Indirect:
+      b.CreateStore(val, fn->arg_begin());
+      b.CreateRetVoid();
+      break;
+    default:
+      b.CreateRet(val);
+      break;
+  }
+}
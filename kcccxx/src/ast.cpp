@@ -1,7 +1,14 @@
 #include "ast.hpp"
+#include "stats.hpp"
 #include <string>
 #include <vector>
 
+Ast::Ast(AK k): kind(k) {
+  if (auto const stats = CompileStats::active()) {
+    ++stats->ast_nodes[k];
+  }
+}
+
 Ast::~Ast() {
 }
 
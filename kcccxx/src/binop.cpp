@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "ast.hpp"
+#include "stats.hpp"
 
 #include "binop.hpp"
 
@@ -40,6 +41,12 @@ bo_same(BO lhs, BO rhs) {
   return group[l] == group[r];
 }
 
+BinOp::BinOp(BO op): kind(op) {
+  if (auto const stats = CompileStats::active()) {
+    ++stats->binops;
+  }
+}
+
 BinOp::~BinOp() {
 }
 
@@ -0,0 +1,93 @@
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include "builtin.hpp"
+#include "type.hpp"
+
+llvm::Optional<Builtin>
+lookup_builtin(std::string const &name) {
+  // clang-format off
+  static struct { char const *name; Builtin builtin; } constexpr builtins[] = {
+    { "find", Builtin::Find }, { "compare", Builtin::Compare }, { "copy", Builtin::Copy },
+    { "fill", Builtin::Fill }, { "count", Builtin::Count }, { "equal", Builtin::Equal },
+    { "read_async", Builtin::ReadAsync }, { "write_async", Builtin::WriteAsync },
+    { "sleep_async", Builtin::SleepAsync },
+    { "splat", Builtin::Splat }, { "extract", Builtin::Extract }, { "shuffle", Builtin::Shuffle },
+    { "select", Builtin::Select }, { "reduce_add", Builtin::ReduceAdd },
+    { "reduce_mul", Builtin::ReduceMul }, { "reduce_min", Builtin::ReduceMin },
+    { "reduce_max", Builtin::ReduceMax }, { "reduce_and", Builtin::ReduceAnd },
+    { "reduce_or", Builtin::ReduceOr }, { "load_vec", Builtin::LoadVec },
+    { "store_vec", Builtin::StoreVec },
+  };
+  // clang-format on
+  for (auto &&b : builtins) {
+    if (name == b.name) {
+      return b.builtin;
+    }
+  }
+  return llvm::None;
+}
+
+FunctionType *
+get_builtin_type(Builtin builtin) {
+  if (is_vector_builtin(builtin)) {
+    return nullptr;
+  }
+  auto const bytes = new SliceType(new U8Type);
+  switch (builtin) {
+    case Builtin::Find:
+    case Builtin::Count:
+      return new FunctionType(new IntNType(32), {bytes, new U8Type});
+    case Builtin::Compare:
+      return new FunctionType(new IntNType(32), {bytes, bytes});
+    case Builtin::Copy:
+      return new FunctionType(new UnitType, {bytes, bytes});
+    case Builtin::Fill:
+      return new FunctionType(new UnitType, {bytes, new U8Type});
+    case Builtin::Equal:
+      return new FunctionType(new BoolType, {bytes, bytes});
+    case Builtin::ReadAsync:
+    case Builtin::WriteAsync:
+      return new FunctionType(new IntNType(32), {new IntNType(32), bytes});
+    case Builtin::SleepAsync:
+      return new FunctionType(new IntNType(32), {new IntNType(32)});
+    default:
+      break;
+  }
+  llvm_unreachable("unknown builtin");
+}
+
+bool
+is_pure_builtin(Builtin builtin) {
+  return builtin != Builtin::Copy && builtin != Builtin::Fill && builtin != Builtin::StoreVec
+    && !is_async_builtin(builtin);
+}
+
+bool
+is_async_builtin(Builtin builtin) {
+  return builtin == Builtin::ReadAsync || builtin == Builtin::WriteAsync
+    || builtin == Builtin::SleepAsync;
+}
+
+bool
+reads_memory_builtin(Builtin builtin) {
+  switch (builtin) {
+    case Builtin::Find:
+    case Builtin::Count:
+    case Builtin::Compare:
+    case Builtin::Equal:
+    case Builtin::Copy:
+    case Builtin::LoadVec:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool
+is_vector_builtin(Builtin builtin) {
+  return Builtin::Splat <= builtin && builtin <= Builtin::StoreVec;
+}
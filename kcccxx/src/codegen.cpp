@@ -1,26 +1,56 @@
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
+#include "abi.hpp"
 #include "ast.hpp"
 #include "binop.hpp"
+#include "builtin.hpp"
 #include "codegen.hpp"
+#include "effect.hpp"
+#include "profile.hpp"
+#include "source.hpp"
+#include "stats.hpp"
 #include "type.hpp"
+#include <algorithm>
 #include <array>
+#include <limits>
+#include <memory>
+#include <set>
 
 class CodeGenImpl {
 public:
-  CodeGenImpl(llvm::LLVMContext &ctxt, llvm::Module &mod, llvm::IRBuilder<> &builder):
-      thectxt(ctxt), themod(mod), thebuilder(builder) {
+  CodeGenImpl(
+    llvm::LLVMContext &ctxt,
+    llvm::Module &mod,
+    llvm::IRBuilder<> &builder,
+    CodeGenOptions const &options):
+      thectxt(ctxt), themod(mod), thebuilder(builder), opts(options) {
   }
 
   llvm::LLVMContext &thectxt;
   llvm::Module &themod;
   llvm::IRBuilder<> &thebuilder;
+  CodeGenOptions const opts;
+  EffectAnalysis effects;
 
   using varmap = std::map<std::string, llvm::Value *>;
   std::vector<varmap> vartab;
@@ -29,10 +59,84 @@ public:
   void pop_vartab();
   void register_val(std::string const &name, llvm::Value *val);
   llvm::AllocaInst *register_auto_var(std::string const &name, llvm::Value *val);
+
+  // profile instrumentation / annotation of the function being generated
+  llvm::GlobalVariable *prof_counters = nullptr;
+  std::vector<uint64_t> const *prof_counts = nullptr;
+  size_t prof_next = 0;
+  std::vector<std::pair<uint64_t, llvm::GlobalVariable *>> profiled;
+  void begin_profile(llvm::Function *fn, std::string const &name, size_t ncounters);
+  size_t allocate_counters(size_t n);
+  void increment_counter(size_t idx);
+  void emit_profile_writer();
+
+  // memo caches, reported at exit under -fmemo-stats
+  struct MemoCounters {
+    std::string name;
+    llvm::GlobalVariable *hits;
+    llvm::GlobalVariable *misses;
+  };
+  std::vector<MemoCounters> memoized;
+  void emit_memo_report();
+
+  void register_exit_hook(llvm::Function *hook);
+
+  llvm::Function *declare_function(DefFnAst *def, std::string const &name, bool used_as_value);
+
+  // generic functions by name; each instance is declared on first use and its body generated once
+  // the non-generic functions are done
+  struct Instance {
+    DefFnAst *def;
+    llvm::Function *fn;
+    TypeBindings type_args;
+    unsigned depth; // of instances that led to it, which polymorphic recursion lets grow forever
+  };
+  std::map<std::string, DefFnAst *> generics;
+  std::map<std::string, llvm::Function *> instances;
+  std::vector<Instance> pending;
+  // type arguments of the instance being generated
+  TypeBindings type_args;
+  unsigned instance_depth = 0;
+  llvm::Function *instantiate(DefFnAst *def, CallExprAst *call);
+  // operands of the Par or Await being generated that were already evaluated as tasks or awaited
+  std::map<Ast *, llvm::Value *> evaluated;
+  // calls in tail position of the function being generated; each one returns right away
+  std::set<CallExprAst *> tail_calls;
+  // one global per embedded file, however often it is embedded
+  std::map<char const *, llvm::Constant *> embedded;
+
+  // Decl'd functions whose C signature is not their natural one; calls convert at the call site,
+  // and a use as a value gets a front with the natural signature
+  std::map<llvm::Function *, FunctionAbi> c_functions;
+  std::map<llvm::Function *, llvm::Function *> c_fronts;
+  llvm::Function *get_c_front(llvm::Function *fn);
+
+  // Async functions are coroutines; the handle of the one being generated and its blocks that free
+  // the frame and that leave the function
+  std::set<llvm::Function *> async_fns;
+  llvm::Value *coro_handle = nullptr;
+  llvm::BasicBlock *coro_cleanup = nullptr;
+  llvm::BasicBlock *coro_suspend = nullptr;
+
+  // -g: discope is the innermost subprogram or lexical block being generated, if any
+  std::unique_ptr<llvm::DIBuilder> dibuilder;
+  llvm::DIFile *difile = nullptr;
+  llvm::DIScope *discope = nullptr;
+  void begin_debug_info();
+  llvm::DILocation *debug_location(Ast *ast) const;
+  void declare_variable(
+    llvm::AllocaInst *alloca,
+    std::string const &name,
+    llvm::DIType *type,
+    Ast *ast,
+    unsigned argno);
 };
 
 llvm::Value *
 CodeGenImpl::lookup_vartab(std::string const &name) const {
+  if (auto const stats = CompileStats::active()) {
+    ++stats->codegen_lookups;
+  }
   for (auto iter = vartab.rbegin(); iter != vartab.rend(); ++iter) {
     for (auto &&kv : *iter) {
       if (kv.first == name) {
@@ -68,8 +172,271 @@ CodeGenImpl::register_auto_var(std::string const &name, llvm::Value *val) {
   return alloca;
 }
 
-CodeGen::CodeGen(llvm::LLVMContext &ctxt, llvm::Module &mod, llvm::IRBuilder<> &builder):
-    pimpl(new CodeGenImpl(ctxt, mod, builder)) {
+void
+CodeGenImpl::begin_debug_info() {
+  llvm::SmallString<128> path(opts.source->get_name());
+  llvm::sys::fs::make_absolute(path);
+  dibuilder = std::make_unique<llvm::DIBuilder>(themod);
+  difile =
+    dibuilder->createFile(llvm::sys::path::filename(path), llvm::sys::path::parent_path(path));
+  // there is no DW_LANG for kcea; C gets debuggers to evaluate integer expressions the same way
+  dibuilder->createCompileUnit(llvm::dwarf::DW_LANG_C, difile, "kccc++", opts.optimized, "", 0);
+  themod.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+  themod.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+}
+
+llvm::DILocation *
+CodeGenImpl::debug_location(Ast *ast) const {
+  auto const &source = *opts.source;
+  auto const loc = ast->get_loc();
+  return llvm::DILocation::get(thectxt, source.get_line(loc), source.get_column(loc), discope);
+}
+
+void
+CodeGenImpl::declare_variable(
+  llvm::AllocaInst *alloca, std::string const &name, llvm::DIType *type, Ast *ast, unsigned argno) {
+  auto const line = opts.source->get_line(ast->get_loc());
+  auto const var = (argno > 0)
+    ? dibuilder->createParameterVariable(discope, name, argno, difile, line, type, true)
+    : dibuilder->createAutoVariable(discope, name, difile, line, type, true);
+  dibuilder->insertDeclare(
+    alloca, var, dibuilder->createExpression(), debug_location(ast), thebuilder.GetInsertBlock());
+}
+
+// Attributes everything generated for an AST node to the node's position in the source.
+class DebugLocScope {
+public:
+  DebugLocScope(CodeGenImpl *pimpl, Ast *ast):
+      builder(pimpl->thebuilder), saved(builder.getCurrentDebugLocation()) {
+    if (pimpl->discope) {
+      builder.SetCurrentDebugLocation(pimpl->debug_location(ast));
+    }
+  }
+  ~DebugLocScope() {
+    builder.SetCurrentDebugLocation(saved);
+  }
+
+private:
+  llvm::IRBuilder<> &builder;
+  llvm::DebugLoc saved;
+};
+
+void
+CodeGenImpl::begin_profile(llvm::Function *fn, std::string const &name, size_t ncounters) {
+  prof_counters = nullptr;
+  prof_counts = nullptr;
+  prof_next = 1; // counter 0 is the function entry
+
+  auto const hash = function_hash(name);
+  if (opts.profile_generate) {
+    auto const arrty = llvm::ArrayType::get(llvm::Type::getInt64Ty(thectxt), ncounters);
+    prof_counters = new llvm::GlobalVariable(
+      themod,
+      arrty,
+      false /* not constant */,
+      llvm::GlobalVariable::PrivateLinkage,
+      llvm::ConstantAggregateZero::get(arrty),
+      "prof." + name);
+    profiled.emplace_back(hash, prof_counters);
+    increment_counter(0);
+  }
+  if (opts.profile_use) {
+    auto const counts = opts.profile_use->lookup(hash);
+    if (counts && counts->size() != ncounters) {
+      llvm::errs() << "[kccc++] warning: profile for " << name << " is out of date; ignored\n";
+    } else if (counts) {
+      prof_counts = counts;
+      fn->setEntryCount((*counts)[0]);
+    }
+  }
+}
+
+size_t
+CodeGenImpl::allocate_counters(size_t n) {
+  auto const first = prof_next;
+  prof_next += n;
+  return first;
+}
+
+void
+CodeGenImpl::increment_counter(size_t idx) {
+  if (!prof_counters) {
+    return;
+  }
+  auto const i64 = llvm::Type::getInt64Ty(thectxt);
+  auto const ptr =
+    thebuilder.CreateConstInBoundsGEP2_64(prof_counters->getValueType(), prof_counters, 0, idx);
+  auto const count = thebuilder.CreateLoad(i64, ptr);
+  thebuilder.CreateStore(thebuilder.CreateAdd(count, llvm::ConstantInt::get(i64, 1)), ptr);
+}
+
+// Appends one record per instrumented function to the profile file at exit.
+void
+CodeGenImpl::emit_profile_writer() {
+  auto const i8p = llvm::Type::getInt8PtrTy(thectxt);
+  auto const i32 = llvm::Type::getInt32Ty(thectxt);
+  auto const i64 = llvm::Type::getInt64Ty(thectxt);
+  auto const hookty = llvm::FunctionType::get(llvm::Type::getVoidTy(thectxt), false);
+
+  auto const fopen =
+    themod.getOrInsertFunction("fopen", llvm::FunctionType::get(i8p, {i8p, i8p}, false));
+  auto const fprintf =
+    themod.getOrInsertFunction("fprintf", llvm::FunctionType::get(i32, {i8p, i8p}, true));
+  auto const fclose =
+    themod.getOrInsertFunction("fclose", llvm::FunctionType::get(i32, {i8p}, false));
+
+  auto const writer =
+    llvm::Function::Create(hookty, llvm::Function::InternalLinkage, "prof.write", themod);
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(thectxt, "entry", writer));
+  auto const file = b.CreateCall(
+    fopen, {b.CreateGlobalStringPtr(opts.profile_output), b.CreateGlobalStringPtr("a")});
+  auto const openBB = llvm::BasicBlock::Create(thectxt, "open", writer);
+  auto const doneBB = llvm::BasicBlock::Create(thectxt, "done", writer);
+  b.CreateCondBr(b.CreateIsNull(file), doneBB, openBB);
+
+  b.SetInsertPoint(openBB);
+  auto const header = b.CreateGlobalStringPtr("%llx %llu");
+  auto const item = b.CreateGlobalStringPtr(" %llu");
+  auto const newline = b.CreateGlobalStringPtr("\n");
+  for (auto &&entry : profiled) {
+    auto const counters = entry.second;
+    auto const len = counters->getValueType()->getArrayNumElements();
+    b.CreateCall(
+      fprintf,
+      {file, header, llvm::ConstantInt::get(i64, entry.first), llvm::ConstantInt::get(i64, len)});
+    for (uint64_t i = 0; i < len; ++i) {
+      auto const ptr = b.CreateConstInBoundsGEP2_64(counters->getValueType(), counters, 0, i);
+      b.CreateCall(fprintf, {file, item, b.CreateLoad(i64, ptr)});
+    }
+    b.CreateCall(fprintf, {file, newline});
+  }
+  b.CreateCall(fclose, {file});
+  b.CreateBr(doneBB);
+  b.SetInsertPoint(doneBB);
+  b.CreateRetVoid();
+
+  register_exit_hook(writer);
+}
+
+void
+CodeGenImpl::emit_memo_report() {
+  auto const i8p = llvm::Type::getInt8PtrTy(thectxt);
+  auto const i32 = llvm::Type::getInt32Ty(thectxt);
+  auto const i64 = llvm::Type::getInt64Ty(thectxt);
+  auto const dblty = llvm::Type::getDoubleTy(thectxt);
+  auto const hookty = llvm::FunctionType::get(llvm::Type::getVoidTy(thectxt), false);
+
+  auto const dprintf =
+    themod.getOrInsertFunction("dprintf", llvm::FunctionType::get(i32, {i32, i8p}, true));
+
+  auto const report =
+    llvm::Function::Create(hookty, llvm::Function::InternalLinkage, "memo.report", themod);
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(thectxt, "entry", report));
+  auto const format =
+    b.CreateGlobalStringPtr("[kccc++] memo %s: %llu hits, %llu misses (%.1f%% hit rate)\n");
+  for (auto &&memo : memoized) {
+    auto const hits = b.CreateLoad(i64, memo.hits);
+    auto const misses = b.CreateLoad(i64, memo.misses);
+    auto const total = b.CreateAdd(hits, misses);
+    auto const rate = b.CreateFDiv(
+      b.CreateFMul(b.CreateUIToFP(hits, dblty), llvm::ConstantFP::get(dblty, 100.0)),
+      b.CreateUIToFP(total, dblty));
+    b.CreateCall(
+      dprintf,
+      {llvm::ConstantInt::get(i32, 2),
+       format,
+       b.CreateGlobalStringPtr(memo.name),
+       hits,
+       misses,
+       b.CreateSelect(b.CreateIsNull(total), llvm::ConstantFP::get(dblty, 0.0), rate)});
+  }
+  b.CreateRetVoid();
+
+  register_exit_hook(report);
+}
+
+// Runs hook at exit, registered with atexit from a module constructor.
+void
+CodeGenImpl::register_exit_hook(llvm::Function *hook) {
+  auto const i32 = llvm::Type::getInt32Ty(thectxt);
+  auto const hookty = hook->getFunctionType();
+  auto const atexit = themod.getOrInsertFunction(
+    "atexit", llvm::FunctionType::get(i32, {llvm::PointerType::getUnqual(hookty)}, false));
+
+  auto const init = llvm::Function::Create(
+    hookty, llvm::Function::InternalLinkage, hook->getName() + ".init", themod);
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(thectxt, "entry", init));
+  b.CreateCall(atexit, {hook});
+  b.CreateRetVoid();
+  llvm::appendToGlobalCtors(themod, init, 0);
+}
+
+static llvm::MDNode *
+create_branch_weights(llvm::LLVMContext &ctxt, uint64_t taken, uint64_t not_taken) {
+  // scale into 32 bits like clang does; the +1 keeps never-executed arms from reading as "unknown"
+  uint64_t const scale = std::max(taken, not_taken) / std::numeric_limits<uint32_t>::max() + 1;
+  return llvm::MDBuilder(ctxt).createBranchWeights(taken / scale + 1, not_taken / scale + 1);
+}
+
+static size_t
+count_if_exprs(Ast *ast) {
+  size_t n = llvm::isa<IfExprAst>(ast) ? 1 : 0;
+  for_each_child(ast, [&](Ast *child) { n += count_if_exprs(child); });
+  return n;
+}
+
+// Collects the names used as values rather than as the callee of a direct call. Such functions may
+// be called through a pointer, so they keep the C calling convention.
+static void
+collect_function_values(Ast *ast, std::set<std::string> &names) {
+  using llvm::dyn_cast;
+  if (auto const var = dyn_cast<VarRefExprAst>(ast)) {
+    names.insert(var->get_name());
+    return;
+  }
+  // the callee of a direct call is no value
+  auto const call = dyn_cast<CallExprAst>(ast);
+  auto const direct =
+    call && llvm::isa<VarRefExprAst>(call->get_callee()) ? call->get_callee() : nullptr;
+  for_each_child(ast, [&](Ast *child) {
+    if (child != direct) {
+      collect_function_values(child, names);
+    }
+  });
+}
+
+// Collects every name referred to, callees included; a Par task captures those bound locally
+static void
+collect_var_refs(Ast *ast, std::set<std::string> &names) {
+  if (auto const var = llvm::dyn_cast<VarRefExprAst>(ast)) {
+    names.insert(var->get_name());
+  }
+  for_each_child(ast, [&](Ast *child) { collect_var_refs(child, names); });
+}
+
+// Collects the calls in tail position: the body itself, the last statement of a block and both arms
+// of an If.
+static void
+collect_tail_calls(Ast *ast, std::set<CallExprAst *> &calls) {
+  using llvm::dyn_cast;
+  if (auto const block = dyn_cast<BlockExprAst>(ast)) {
+    if (block->size() != 0) {
+      collect_tail_calls(block->get_nth_stmt(block->size() - 1), calls);
+    }
+  } else if (auto const call = dyn_cast<CallExprAst>(ast)) {
+    calls.insert(call);
+  } else if (auto const ife = dyn_cast<IfExprAst>(ast)) {
+    collect_tail_calls(ife->get_then(), calls);
+    collect_tail_calls(ife->get_else(), calls);
+  }
+}
+
+CodeGen::CodeGen(
+  llvm::LLVMContext &ctxt,
+  llvm::Module &mod,
+  llvm::IRBuilder<> &builder,
+  CodeGenOptions const &opts):
+    pimpl(new CodeGenImpl(ctxt, mod, builder, opts)) {
 }
 
 CodeGen::~CodeGen() {
@@ -81,19 +448,62 @@ CodeGen::execute(Ast *prog) {
   pimpl->push_vartab();
 
   auto const tunit = llvm::dyn_cast<TranslationUnitAst>(prog);
+  pimpl->effects.analyze(tunit);
+  if (pimpl->opts.debug_info) {
+    pimpl->begin_debug_info();
+  }
+  for (size_t i = 0, len = tunit->get_import_decl_count(); i < len; ++i) {
+    generate_decl_stmt(llvm::cast<DeclStmtAst>(tunit->get_nth_import_decl(i)));
+  }
+  std::set<std::string> values;
+  for (size_t i = 0, len = tunit->size(); i < len; ++i) {
+    collect_function_values(llvm::cast<DefFnAst>(tunit->get_nth_func(i))->get_body(), values);
+  }
+  // declare every function up front so that a body may call one defined after it
+  for (size_t i = 0, len = tunit->size(); i < len; ++i) {
+    auto const defun = llvm::cast<DefFnAst>(tunit->get_nth_func(i));
+    auto const name = defun->get_name();
+    if (defun->is_generic()) {
+      pimpl->generics[name] = defun;
+      continue;
+    }
+    pimpl->register_val(name, pimpl->declare_function(defun, name, values.count(name) != 0));
+  }
   for (size_t i = 0, len = tunit->size(); i < len; ++i) {
     auto const defun = llvm::dyn_cast<DefFnAst>(tunit->get_nth_func(i));
-    generate_function_definition(defun);
+    if (!defun->is_generic()) {
+      auto const fn = pimpl->lookup_vartab(defun->get_name());
+      generate_function_definition(defun, llvm::cast<llvm::Function>(fn));
+    }
+  }
+  // instances may call for further ones
+  for (size_t i = 0; i < pimpl->pending.size(); ++i) {
+    auto const instance = pimpl->pending[i];
+    pimpl->type_args = instance.type_args;
+    pimpl->instance_depth = instance.depth;
+    generate_function_definition(instance.def, instance.fn);
   }
+  pimpl->type_args.clear();
+  pimpl->instance_depth = 0;
 
   pimpl->pop_vartab();
 
+  if (pimpl->opts.profile_generate && !pimpl->profiled.empty()) {
+    pimpl->emit_profile_writer();
+  }
+  if (pimpl->opts.memo_stats && !pimpl->memoized.empty()) {
+    pimpl->emit_memo_report();
+  }
+  if (pimpl->dibuilder) {
+    pimpl->dibuilder->finalize();
+  }
+
   return true;
 }
 
 static llvm::StructType *
 get_slice_type(CodeGenImpl *pimpl, llvm::Type *elt) {
-  llvm::ArrayRef<llvm::Type *> slice_member_type{
+  std::array<llvm::Type *, 2> slice_member_type{
     llvm::PointerType::getUnqual(elt),
     llvm::Type::getInt32Ty(pimpl->thectxt) // FIXME
   };
@@ -117,12 +527,162 @@ generate_llvm_type(CodeGenImpl *pimpl, Type *type) {
   if (isa<U8Type>(type)) {
     return llvm::IntegerType::getInt8Ty(pimpl->thectxt);
   }
+  if (auto const vec = dyn_cast<VecType>(type)) {
+    return llvm::VectorType::get(generate_llvm_type(pimpl, vec->get_elem_type()), vec->get_lanes());
+  }
+  if (auto const tyvar = dyn_cast<TyVar>(type)) {
+    return generate_llvm_type(pimpl, pimpl->type_args.at(tyvar->get_id()));
+  }
   llvm_unreachable("not implemented");
 }
 
+static llvm::DIType *
+generate_di_type(CodeGenImpl *pimpl, Type *type) {
+  using llvm::dyn_cast;
+  using llvm::isa;
+  auto &dib = *pimpl->dibuilder;
+  if (auto const tyvar = dyn_cast<TyVar>(type)) {
+    return generate_di_type(pimpl, pimpl->type_args.at(tyvar->get_id()));
+  }
+  if (isa<BoolType>(type)) {
+    return dib.createBasicType("Bool", 8, llvm::dwarf::DW_ATE_boolean);
+  }
+  if (auto const intty = dyn_cast<IntNType>(type)) {
+    auto const width = intty->get_width();
+    auto const name = (intty->is_signed() ? "i" : "u") + std::to_string(width);
+    return dib.createBasicType(
+      name, width, intty->is_signed() ? llvm::dwarf::DW_ATE_signed : llvm::dwarf::DW_ATE_unsigned);
+  }
+  if (isa<U8Type>(type)) {
+    return dib.createBasicType("u8", 8, llvm::dwarf::DW_ATE_unsigned_char);
+  }
+  if (auto const vec = dyn_cast<VecType>(type)) {
+    auto const &layout = pimpl->themod.getDataLayout();
+    auto const llty = generate_llvm_type(pimpl, type);
+    std::array<llvm::Metadata *, 1> lanes{dib.getOrCreateSubrange(0, vec->get_lanes())};
+    return dib.createVectorType(
+      layout.getTypeAllocSizeInBits(llty),
+      layout.getABITypeAlignment(llty) * 8,
+      generate_di_type(pimpl, vec->get_elem_type()),
+      dib.getOrCreateArray(lanes));
+  }
+  if (auto const slice = dyn_cast<SliceType>(type)) {
+    auto const &layout = pimpl->themod.getDataLayout();
+    auto const llty = llvm::cast<llvm::StructType>(generate_llvm_type(pimpl, type));
+    auto const sl = layout.getStructLayout(llty);
+    auto const member = [&](char const *name, unsigned idx, llvm::DIType *ty) {
+      auto const elt = llty->getElementType(idx);
+      return dib.createMemberType(
+        pimpl->difile,
+        name,
+        pimpl->difile,
+        0,
+        layout.getTypeSizeInBits(elt),
+        layout.getABITypeAlignment(elt) * 8,
+        sl->getElementOffsetInBits(idx),
+        llvm::DINode::FlagZero,
+        ty);
+    };
+    auto const ptr = dib.createPointerType(
+      generate_di_type(pimpl, slice->get_elem_type()), layout.getPointerSizeInBits());
+    std::array<llvm::Metadata *, 2> members{
+      member("ptr", 0, ptr),
+      member("len", 1, dib.createBasicType("i32", 32, llvm::dwarf::DW_ATE_signed)),
+    };
+    return dib.createStructType(
+      pimpl->difile,
+      "Slice",
+      pimpl->difile,
+      0,
+      sl->getSizeInBits(),
+      sl->getAlignment().value() * 8,
+      llvm::DINode::FlagZero,
+      nullptr,
+      dib.getOrCreateArray(members));
+  }
+  llvm_unreachable("not implemented");
+}
+
+// struct kcrt_join
+static llvm::StructType *
+get_join_type(CodeGenImpl *pimpl) {
+  auto &ctxt = pimpl->thectxt;
+  auto const i8p = llvm::Type::getInt8PtrTy(ctxt);
+  auto const resumety = llvm::FunctionType::get(llvm::Type::getVoidTy(ctxt), {i8p}, false);
+  return llvm::StructType::get(
+    ctxt, {llvm::Type::getInt32Ty(ctxt), resumety->getPointerTo(), i8p, i8p});
+}
+
+static bool
+is_async_call(CodeGenImpl *pimpl, CallExprAst *call) {
+  auto const var = llvm::dyn_cast<VarRefExprAst>(call->get_callee());
+  if (!var) {
+    return false;
+  }
+  auto const val = pimpl->lookup_vartab(var->get_name());
+  if (!val) {
+    // generic functions are never Async
+    auto const builtin = lookup_builtin(var->get_name());
+    return !pimpl->generics.count(var->get_name()) && builtin && is_async_builtin(*builtin);
+  }
+  auto const fn = llvm::dyn_cast<llvm::Function>(val);
+  return fn && pimpl->async_fns.count(fn);
+}
+
+static llvm::FunctionCallee
+get_async_builtin(CodeGenImpl *pimpl, Builtin builtin) {
+  auto &ctxt = pimpl->thectxt;
+  auto const voidty = llvm::Type::getVoidTy(ctxt);
+  auto const i32 = llvm::Type::getInt32Ty(ctxt);
+  auto const bytes = get_slice_type(pimpl, llvm::Type::getInt8Ty(ctxt));
+  auto const resultty = i32->getPointerTo();
+  auto const joinpty = get_join_type(pimpl)->getPointerTo();
+  auto const iofnty = llvm::FunctionType::get(voidty, {i32, bytes, resultty, joinpty}, false);
+  auto &mod = pimpl->themod;
+  switch (builtin) {
+    case Builtin::ReadAsync:
+      return mod.getOrInsertFunction("kcrt_read_async", iofnty);
+    case Builtin::WriteAsync:
+      return mod.getOrInsertFunction("kcrt_write_async", iofnty);
+    case Builtin::SleepAsync:
+      return mod.getOrInsertFunction(
+        "kcrt_sleep_async", llvm::FunctionType::get(voidty, {i32, resultty, joinpty}, false));
+    default:
+      llvm_unreachable("not an async builtin");
+  }
+}
+
+// Makes the coroutine of join's waiter continue, for kcrt
+static llvm::Function *
+get_coro_resume(CodeGenImpl *pimpl) {
+  auto &mod = pimpl->themod;
+  if (auto const fn = mod.getFunction("kcea.coro.resume")) {
+    return fn;
+  }
+  auto const i8p = llvm::Type::getInt8PtrTy(pimpl->thectxt);
+  auto const fn = llvm::Function::Create(
+    llvm::FunctionType::get(llvm::Type::getVoidTy(pimpl->thectxt), {i8p}, false),
+    llvm::Function::InternalLinkage,
+    "kcea.coro.resume",
+    mod);
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(pimpl->thectxt, "entry", fn));
+  b.CreateCall(
+    llvm::Intrinsic::getDeclaration(&mod, llvm::Intrinsic::coro_resume), {fn->arg_begin()});
+  b.CreateRetVoid();
+  return fn;
+}
+
 llvm::Value *
 CodeGen::generate_expr(Ast *body) {
   using llvm::dyn_cast;
+  auto const result = pimpl->evaluated.find(body);
+  if (result != pimpl->evaluated.end()) {
+    return result->second;
+  }
+  DebugLocScope loc(pimpl, body);
+  if (auto const await = dyn_cast<AwaitExprAst>(body)) {
+    return generate_await_expr(await);
+  }
   if (auto const bin = dyn_cast<BinaryExprAst>(body)) {
     return generate_binary_expr(bin);
   }
@@ -138,6 +698,12 @@ CodeGen::generate_expr(Ast *body) {
   if (auto const decl = dyn_cast<DeclStmtAst>(body)) {
     return generate_decl_stmt(decl);
   }
+  if (auto const embed = dyn_cast<EmbedExprAst>(body)) {
+    return generate_embed_expr(embed);
+  }
+  if (auto const loop = dyn_cast<ForExprAst>(body)) {
+    return generate_for_expr(loop);
+  }
   if (auto const ife = dyn_cast<IfExprAst>(body)) {
     return generate_if_expr(ife);
   }
@@ -150,31 +716,94 @@ CodeGen::generate_expr(Ast *body) {
   if (auto const oseq = dyn_cast<OctetSeqLiteralAst>(body)) {
     return generate_octet_seq_literal(oseq);
   }
+  if (auto const par = dyn_cast<ParExprAst>(body)) {
+    return generate_par_expr(par);
+  }
   if (auto const var = dyn_cast<VarRefExprAst>(body)) {
     return generate_var_ref(var);
   }
+  if (auto const loop = dyn_cast<WhileExprAst>(body)) {
+    return generate_while_expr(loop);
+  }
   llvm_unreachable("not implemented");
 }
 
+static bool
+is_signed_type(CodeGenImpl *pimpl, Type *type) {
+  type = substitute(type, pimpl->type_args);
+  if (auto const vec = llvm::dyn_cast<VecType>(type)) {
+    type = vec->get_elem_type();
+  }
+  auto const intty = llvm::dyn_cast<IntNType>(type);
+  return intty && intty->is_signed();
+}
+
+// Starts the awaited calls with one join and suspends the coroutine until the last of them has
+// counted it down:
+//
+//   join = {pending: number of calls, resume: kcea.coro.resume, handle: this coroutine}
+//   each awaited call, with a slot for its value
+//   switch coro.suspend: 0 -> await.resume, 1 -> coro.cleanup, default -> coro.suspend
+//   await.resume: body, with the awaited calls taken from their slots
+llvm::Value *
+CodeGen::generate_await_expr(AwaitExprAst *await) {
+  auto &b = pimpl->thebuilder;
+  auto const fn = b.GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entry(&fn->getEntryBlock(), fn->getEntryBlock().begin());
+  auto const jointy = get_join_type(pimpl);
+  auto const join = entry.CreateAlloca(jointy, nullptr, "await.join");
+  auto const &calls = await->get_awaited();
+  b.CreateStore(b.getInt32(calls.size()), b.CreateStructGEP(jointy, join, 0));
+  b.CreateStore(get_coro_resume(pimpl), b.CreateStructGEP(jointy, join, 1));
+  b.CreateStore(pimpl->coro_handle, b.CreateStructGEP(jointy, join, 2));
+  std::vector<llvm::Value *> results;
+  for (auto &&call : calls) {
+    results.push_back(generate_async_call(call, join));
+  }
+
+  auto const suspend =
+    llvm::Intrinsic::getDeclaration(&pimpl->themod, llvm::Intrinsic::coro_suspend);
+  auto const state =
+    b.CreateCall(suspend, {llvm::ConstantTokenNone::get(pimpl->thectxt), b.getFalse()});
+  auto const resumeBB = llvm::BasicBlock::Create(pimpl->thectxt, "await.resume", fn);
+  auto const sw = b.CreateSwitch(state, pimpl->coro_suspend, 2);
+  sw->addCase(b.getInt8(0), resumeBB);
+  sw->addCase(b.getInt8(1), pimpl->coro_cleanup);
+
+  b.SetInsertPoint(resumeBB);
+  for (size_t i = 0; i < calls.size(); ++i) {
+    pimpl->evaluated[calls[i]] =
+      b.CreateLoad(generate_llvm_type(pimpl, calls[i]->get_type()), results[i]);
+  }
+  auto const value = generate_expr(await->get_body());
+  for (auto &&call : calls) {
+    pimpl->evaluated.erase(call);
+  }
+  return value;
+}
+
 llvm::Value *
 CodeGen::generate_binary_expr(BinaryExprAst *bin) {
   auto const lhs = generate_expr(bin->get_lhs());
   auto const rhs = generate_expr(bin->get_rhs());
+  // signed overflow is undefined, which lets LLVM widen induction variables and reassociate
+  auto const is_signed = is_signed_type(pimpl, llvm::cast<ExprAst>(bin->get_lhs())->get_type());
+  auto &builder = pimpl->thebuilder;
   switch (bin->get_op()->get_kind()) {
     case BO::Plus:
-      return pimpl->thebuilder.CreateAdd(lhs, rhs);
+      return is_signed ? builder.CreateNSWAdd(lhs, rhs) : builder.CreateAdd(lhs, rhs);
     case BO::Minus:
-      return pimpl->thebuilder.CreateSub(lhs, rhs);
+      return is_signed ? builder.CreateNSWSub(lhs, rhs) : builder.CreateSub(lhs, rhs);
     case BO::Mult:
-      return pimpl->thebuilder.CreateMul(lhs, rhs);
+      return is_signed ? builder.CreateNSWMul(lhs, rhs) : builder.CreateMul(lhs, rhs);
     case BO::Div:
-      return pimpl->thebuilder.CreateSDiv(lhs, rhs);
+      return is_signed ? builder.CreateSDiv(lhs, rhs) : builder.CreateUDiv(lhs, rhs);
     case BO::Eq:
-      return pimpl->thebuilder.CreateICmpEQ(lhs, rhs);
+      return builder.CreateICmpEQ(lhs, rhs);
     case BO::Lt:
-      return pimpl->thebuilder.CreateICmpSLT(lhs, rhs);
+      return is_signed ? builder.CreateICmpSLT(lhs, rhs) : builder.CreateICmpULT(lhs, rhs);
     case BO::Gt:
-      return pimpl->thebuilder.CreateICmpSGT(lhs, rhs);
+      return is_signed ? builder.CreateICmpSGT(lhs, rhs) : builder.CreateICmpUGT(lhs, rhs);
   }
   llvm_unreachable("not implemented");
 }
@@ -182,6 +811,12 @@ CodeGen::generate_binary_expr(BinaryExprAst *bin) {
 llvm::Value *
 CodeGen::generate_block_expr(BlockExprAst *block) {
   pimpl->push_vartab();
+  auto const outer = pimpl->discope;
+  if (outer) {
+    auto const loc = pimpl->debug_location(block);
+    pimpl->discope =
+      pimpl->dibuilder->createLexicalBlock(outer, pimpl->difile, loc->getLine(), loc->getColumn());
+  }
   auto const func = pimpl->thebuilder.GetInsertBlock()->getParent();
   auto BB = llvm::BasicBlock::Create(pimpl->thectxt, "block", func);
   pimpl->thebuilder.CreateBr(BB);
@@ -195,6 +830,7 @@ CodeGen::generate_block_expr(BlockExprAst *block) {
   }
 
   BB = pimpl->thebuilder.GetInsertBlock();
+  pimpl->discope = outer;
   pimpl->pop_vartab();
   return seq.back();
 }
@@ -205,69 +841,951 @@ CodeGen::generate_bool_literal(BoolLiteralExprAst *bl) {
   return llvm::ConstantInt::get(type, bl->get_value());
 }
 
+// Bytes compared per iteration by the vector loops of find and count: one vector register.
+static unsigned
+vector_bytes(CodeGenImpl *pimpl, llvm::Function *fn) {
+  auto const target_machine = pimpl->opts.target_machine;
+  if (!target_machine) {
+    return 16;
+  }
+  unsigned const bits = target_machine->getTargetTransformInfo(*fn).getRegisterBitWidth(true);
+  // the comparison mask of a vector is handled as one integer of up to 64 bits
+  return std::min(std::max(bits / 8, 8u), 64u);
+}
+
+// Compares the bytes of a slice with needle a vector register at a time, then the bytes left
+// over one at a time. find stops at the first match; count adds up the matches of each vector
+// with a popcount of the comparison mask.
+static llvm::Value *
+generate_byte_scan(CodeGenImpl *pimpl, Builtin builtin, llvm::Value *slice, llvm::Value *needle) {
+  auto &b = pimpl->thebuilder;
+  auto &ctxt = pimpl->thectxt;
+  auto const fn = b.GetInsertBlock()->getParent();
+  auto const width = vector_bytes(pimpl, fn);
+  auto const find = builtin == Builtin::Find;
+  auto const i64 = b.getInt64Ty();
+  auto const vecty = llvm::VectorType::get(b.getInt8Ty(), width);
+  auto const maskty = b.getIntNTy(width);
+
+  auto const data = b.CreateExtractValue(slice, 0, "data");
+  auto const len = b.CreateZExt(b.CreateExtractValue(slice, 1), i64, "len");
+  auto const vecend = b.CreateAnd(len, ~uint64_t(width - 1), "vecend");
+  auto const splat = b.CreateVectorSplat(width, needle);
+  auto const entry = b.GetInsertBlock();
+
+  auto const vec_cond = llvm::BasicBlock::Create(ctxt, "scan.vec.cond", fn);
+  auto const vec_body = llvm::BasicBlock::Create(ctxt, "scan.vec.body", fn);
+  auto const vec_next = find ? llvm::BasicBlock::Create(ctxt, "scan.vec.next", fn) : vec_body;
+  auto const tail_cond = llvm::BasicBlock::Create(ctxt, "scan.tail.cond", fn);
+  auto const tail_body = llvm::BasicBlock::Create(ctxt, "scan.tail.body", fn);
+  auto const tail_next = find ? llvm::BasicBlock::Create(ctxt, "scan.tail.next", fn) : tail_body;
+  auto const done = llvm::BasicBlock::Create(ctxt, "scan.done", fn);
+  b.CreateBr(vec_cond);
+
+  b.SetInsertPoint(vec_cond);
+  auto const i = b.CreatePHI(i64, 2, "i");
+  auto const vec_count = b.CreatePHI(b.getInt32Ty(), 2, "count");
+  i->addIncoming(b.getInt64(0), entry);
+  vec_count->addIncoming(b.getInt32(0), entry);
+  b.CreateCondBr(b.CreateICmpULT(i, vecend), vec_body, tail_cond);
+
+  b.SetInsertPoint(vec_body);
+  auto const vecptr =
+    b.CreateBitCast(b.CreateInBoundsGEP(b.getInt8Ty(), data, i), vecty->getPointerTo());
+  auto const chunk = b.CreateAlignedLoad(vecty, vecptr, llvm::MaybeAlign(1));
+  auto const mask = b.CreateBitCast(b.CreateICmpEQ(chunk, splat), maskty, "mask");
+  llvm::Value *vec_found = nullptr;
+  if (find) {
+    auto const first = b.CreateBinaryIntrinsic(llvm::Intrinsic::cttz, mask, b.getTrue());
+    vec_found = b.CreateTrunc(b.CreateAdd(i, b.CreateZExt(first, i64)), b.getInt32Ty());
+    b.CreateCondBr(b.CreateICmpNE(mask, llvm::ConstantInt::get(maskty, 0)), done, vec_next);
+    b.SetInsertPoint(vec_next);
+  }
+  auto const matches = b.CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, mask);
+  auto const vec_sum =
+    find ? vec_count : b.CreateAdd(vec_count, b.CreateZExtOrTrunc(matches, b.getInt32Ty()));
+  i->addIncoming(b.CreateAdd(i, b.getInt64(width)), vec_next);
+  vec_count->addIncoming(vec_sum, vec_next);
+  b.CreateBr(vec_cond);
+
+  b.SetInsertPoint(tail_cond);
+  auto const j = b.CreatePHI(i64, 2, "j");
+  auto const tail_count = b.CreatePHI(b.getInt32Ty(), 2, "count");
+  j->addIncoming(i, vec_cond);
+  tail_count->addIncoming(vec_count, vec_cond);
+  b.CreateCondBr(b.CreateICmpULT(j, len), tail_body, done);
+
+  b.SetInsertPoint(tail_body);
+  auto const byte = b.CreateLoad(b.getInt8Ty(), b.CreateInBoundsGEP(b.getInt8Ty(), data, j));
+  auto const match = b.CreateICmpEQ(byte, needle);
+  auto const tail_found = find ? b.CreateTrunc(j, b.getInt32Ty()) : nullptr;
+  if (find) {
+    b.CreateCondBr(match, done, tail_next);
+    b.SetInsertPoint(tail_next);
+  }
+  auto const tail_sum =
+    find ? tail_count : b.CreateAdd(tail_count, b.CreateZExt(match, b.getInt32Ty()));
+  j->addIncoming(b.CreateAdd(j, b.getInt64(1)), tail_next);
+  tail_count->addIncoming(tail_sum, tail_next);
+  b.CreateBr(tail_cond);
+
+  b.SetInsertPoint(done);
+  auto const result = b.CreatePHI(b.getInt32Ty(), 3, find ? "index" : "count");
+  if (find) {
+    result->addIncoming(b.getInt32(-1), tail_cond);
+    result->addIncoming(vec_found, vec_body);
+    result->addIncoming(tail_found, tail_body);
+  } else {
+    result->addIncoming(tail_count, tail_cond);
+  }
+  return result;
+}
+
+static llvm::Value *
+generate_memcmp(CodeGenImpl *pimpl, llvm::Value *lhs, llvm::Value *rhs, llvm::Value *len) {
+  auto &b = pimpl->thebuilder;
+  auto const i8p = b.getInt8PtrTy();
+  auto const memcmp = pimpl->themod.getOrInsertFunction(
+    "memcmp", llvm::FunctionType::get(b.getInt32Ty(), {i8p, i8p, b.getInt64Ty()}, false));
+  return b.CreateCall(memcmp, {lhs, rhs, b.CreateZExt(len, b.getInt64Ty())});
+}
+
+static llvm::Value *
+generate_builtin_call(CodeGenImpl *pimpl, Builtin builtin, std::vector<llvm::Value *> const &args) {
+  auto &b = pimpl->thebuilder;
+  auto const data = [&](size_t n) { return b.CreateExtractValue(args[n], 0); };
+  auto const len = [&](size_t n) { return b.CreateExtractValue(args[n], 1); };
+  auto const unit = llvm::UndefValue::get(b.getVoidTy());
+  switch (builtin) {
+    case Builtin::Find:
+    case Builtin::Count:
+      return generate_byte_scan(pimpl, builtin, args[0], args[1]);
+    case Builtin::Compare: {
+      // the common prefix decides unless one slice is a prefix of the other
+      auto const llen = len(0);
+      auto const rlen = len(1);
+      auto const prefix = b.CreateSelect(b.CreateICmpULT(llen, rlen), llen, rlen);
+      auto const order = generate_memcmp(pimpl, data(0), data(1), prefix);
+      auto const same = b.CreateICmpEQ(order, b.getInt32(0));
+      return b.CreateSelect(same, b.CreateSub(llen, rlen), order, "order");
+    }
+    case Builtin::Equal: {
+      auto const same_len = b.CreateICmpEQ(len(0), len(1));
+      auto const checked = b.CreateSelect(same_len, len(0), b.getInt32(0));
+      auto const order = generate_memcmp(pimpl, data(0), data(1), checked);
+      return b.CreateAnd(same_len, b.CreateICmpEQ(order, b.getInt32(0)), "equal");
+    }
+    case Builtin::Copy: {
+      auto const dlen = len(0);
+      auto const slen = len(1);
+      auto const n = b.CreateSelect(b.CreateICmpULT(dlen, slen), dlen, slen);
+      b.CreateMemMove(
+        data(0),
+        llvm::MaybeAlign(1),
+        data(1),
+        llvm::MaybeAlign(1),
+        b.CreateZExt(n, b.getInt64Ty()));
+      return unit;
+    }
+    case Builtin::Fill:
+      b.CreateMemSet(data(0), args[1], b.CreateZExt(len(0), b.getInt64Ty()), llvm::MaybeAlign(1));
+      return unit;
+    case Builtin::ReadAsync:
+    case Builtin::WriteAsync:
+    case Builtin::SleepAsync:
+      break; // started by generate_async_call
+    default:
+      break; // Vec builtins, see generate_vector_builtin
+  }
+  llvm_unreachable("unknown builtin");
+}
+
+// Continues where in_range holds and traps elsewhere
+static void
+generate_range_check(CodeGenImpl *pimpl, llvm::Value *in_range) {
+  auto &b = pimpl->thebuilder;
+  auto const fn = b.GetInsertBlock()->getParent();
+  auto const ok = llvm::BasicBlock::Create(pimpl->thectxt, "range.ok", fn);
+  auto const fail = llvm::BasicBlock::Create(pimpl->thectxt, "range.fail", fn);
+  b.CreateCondBr(in_range, ok, fail, llvm::MDBuilder(pimpl->thectxt).createBranchWeights(2000, 1));
+  b.SetInsertPoint(fail);
+  b.CreateCall(llvm::Intrinsic::getDeclaration(&pimpl->themod, llvm::Intrinsic::trap));
+  b.CreateUnreachable();
+  b.SetInsertPoint(ok);
+}
+
+// Address of the lanes s[i] to s[i + lanes - 1], checked to lie within s. The data pointer of a
+// slice is only known to be aligned for its elements, so that is the alignment of the access.
+static std::pair<llvm::Value *, llvm::MaybeAlign>
+generate_lanes_address(
+  CodeGenImpl *pimpl, llvm::VectorType *vecty, llvm::Value *slice, llvm::Value *index) {
+  auto &b = pimpl->thebuilder;
+  auto const i64 = b.getInt64Ty();
+  // a negative index wraps past any i32 length
+  auto const start = b.CreateZExt(index, i64);
+  auto const end = b.CreateAdd(start, b.getInt64(vecty->getNumElements()));
+  auto const len = b.CreateZExt(b.CreateExtractValue(slice, 1), i64);
+  generate_range_check(pimpl, b.CreateICmpULE(end, len));
+  auto const elt = vecty->getElementType();
+  auto const ptr = b.CreateInBoundsGEP(elt, b.CreateExtractValue(slice, 0), start);
+  auto const align = pimpl->themod.getDataLayout().getABITypeAlignment(elt);
+  return {b.CreateBitCast(ptr, vecty->getPointerTo()), llvm::MaybeAlign(align)};
+}
+
+// Lane counts and shuffle indices are literals, so they arrive as constants
+static unsigned
+literal_lane(llvm::Value *arg) {
+  return llvm::cast<llvm::ConstantInt>(arg)->getZExtValue();
+}
+
+static llvm::Value *
+generate_vector_builtin(
+  CodeGenImpl *pimpl, Builtin builtin, CallExprAst *call, std::vector<llvm::Value *> const &args) {
+  auto &b = pimpl->thebuilder;
+  auto const first = llvm::cast<ExprAst>(call->get_nth_arg(0));
+  auto const is_signed = is_signed_type(pimpl, first->get_type());
+  switch (builtin) {
+    case Builtin::Splat:
+      return b.CreateVectorSplat(literal_lane(args[0]), args[1], "splat");
+    case Builtin::Extract: {
+      auto const lanes = llvm::cast<llvm::VectorType>(args[0]->getType())->getNumElements();
+      generate_range_check(pimpl, b.CreateICmpULT(args[1], b.getInt32(lanes)));
+      return b.CreateExtractElement(args[0], args[1], "lane");
+    }
+    case Builtin::Shuffle: {
+      std::vector<uint32_t> mask;
+      for (size_t i = 2; i < args.size(); ++i) {
+        mask.push_back(literal_lane(args[i]));
+      }
+      return b.CreateShuffleVector(
+        args[0], args[1], llvm::ConstantDataVector::get(pimpl->thectxt, mask), "shuffle");
+    }
+    case Builtin::Select:
+      return b.CreateSelect(args[0], args[1], args[2], "select");
+    case Builtin::ReduceAdd:
+      return b.CreateAddReduce(args[0]);
+    case Builtin::ReduceMul:
+      return b.CreateMulReduce(args[0]);
+    case Builtin::ReduceMin:
+      return b.CreateIntMinReduce(args[0], is_signed);
+    case Builtin::ReduceMax:
+      return b.CreateIntMaxReduce(args[0], is_signed);
+    case Builtin::ReduceAnd:
+      return b.CreateAndReduce(args[0]);
+    case Builtin::ReduceOr:
+      return b.CreateOrReduce(args[0]);
+    case Builtin::LoadVec: {
+      auto const vecty = llvm::cast<llvm::VectorType>(generate_llvm_type(pimpl, call->get_type()));
+      auto const addr = generate_lanes_address(pimpl, vecty, args[1], args[2]);
+      return b.CreateAlignedLoad(vecty, addr.first, addr.second, "lanes");
+    }
+    case Builtin::StoreVec: {
+      auto const vecty = llvm::cast<llvm::VectorType>(args[2]->getType());
+      auto const addr = generate_lanes_address(pimpl, vecty, args[0], args[1]);
+      b.CreateAlignedStore(args[2], addr.first, addr.second);
+      return llvm::UndefValue::get(b.getVoidTy());
+    }
+    default:
+      break;
+  }
+  llvm_unreachable("not a Vec builtin");
+}
+
+// Starts call, to an Async function or an async builtin, with a slot for its value; the call counts
+// down join once the value is there. Returns the slot.
 llvm::Value *
-CodeGen::generate_call_expr(CallExprAst *call) {
-  auto const fn = generate_expr(call->get_callee());
+CodeGen::generate_async_call(CallExprAst *call, llvm::Value *join) {
+  auto &b = pimpl->thebuilder;
+  auto const caller = b.GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entry(&caller->getEntryBlock(), caller->getEntryBlock().begin());
+  auto const result =
+    entry.CreateAlloca(generate_llvm_type(pimpl, call->get_type()), nullptr, "async.result");
 
+  auto const var = llvm::cast<VarRefExprAst>(call->get_callee());
+  llvm::FunctionCallee callee;
+  if (auto const val = pimpl->lookup_vartab(var->get_name())) {
+    callee = llvm::cast<llvm::Function>(val);
+  } else {
+    callee = get_async_builtin(pimpl, *lookup_builtin(var->get_name()));
+  }
   std::vector<llvm::Value *> args;
   for (size_t i = 0, len = call->get_nargs(); i < len; ++i) {
-    auto const expr = generate_expr(call->get_nth_arg(i));
-    args.push_back(expr);
+    args.push_back(generate_expr(call->get_nth_arg(i)));
+  }
+  args.push_back(result);
+  args.push_back(join);
+  auto const inst = b.CreateCall(callee, args);
+  if (auto const fn = llvm::dyn_cast<llvm::Function>(callee.getCallee())) {
+    inst->setCallingConv(fn->getCallingConv());
   }
-  return pimpl->thebuilder.CreateCall(fn, args, "calltmp");
+  return result;
 }
 
+llvm::Value *
+CodeGen::generate_call_expr(CallExprAst *call) {
+  if (is_async_call(pimpl, call)) {
+    // outside Await: run the event loop until the call is done
+    auto &b = pimpl->thebuilder;
+    auto const caller = b.GetInsertBlock()->getParent();
+    llvm::IRBuilder<> entry(&caller->getEntryBlock(), caller->getEntryBlock().begin());
+    auto const jointy = get_join_type(pimpl);
+    auto const join = entry.CreateAlloca(jointy, nullptr, "async.join");
+    b.CreateStore(b.getInt32(1), b.CreateStructGEP(jointy, join, 0));
+    b.CreateStore(
+      llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(jointy->getElementType(1))),
+      b.CreateStructGEP(jointy, join, 1));
+    auto const result = generate_async_call(call, join);
+    auto const run = pimpl->themod.getOrInsertFunction(
+      "kcrt_async_run", llvm::FunctionType::get(b.getVoidTy(), {jointy->getPointerTo()}, false));
+    b.CreateCall(run, {join});
+    return b.CreateLoad(generate_llvm_type(pimpl, call->get_type()), result);
+  }
+
+  std::vector<llvm::Value *> args;
+  auto const generate_args = [&] {
+    for (size_t i = 0, len = call->get_nargs(); i < len; ++i) {
+      auto const expr = generate_expr(call->get_nth_arg(i));
+      args.push_back(expr);
+    }
+  };
+
+  auto const var = llvm::dyn_cast<VarRefExprAst>(call->get_callee());
+  llvm::Function *instance = nullptr;
+  if (var && !pimpl->lookup_vartab(var->get_name())) {
+    auto const generic = pimpl->generics.find(var->get_name());
+    if (generic != pimpl->generics.end()) {
+      instance = pimpl->instantiate(generic->second, call);
+    } else if (auto const builtin = lookup_builtin(var->get_name())) {
+      generate_args();
+      if (is_vector_builtin(*builtin)) {
+        return generate_vector_builtin(pimpl, *builtin, call, args);
+      }
+      return generate_builtin_call(pimpl, *builtin, args);
+    }
+  }
+
+  // Decl'd functions are called with their C signature
+  auto const external =
+    var ? llvm::dyn_cast_or_null<llvm::Function>(pimpl->lookup_vartab(var->get_name())) : nullptr;
+  auto const abi = external ? pimpl->c_functions.find(external) : pimpl->c_functions.end();
+  llvm::CallInst *inst;
+  llvm::Value *result;
+  if (abi != pimpl->c_functions.end()) {
+    generate_args();
+    inst = abi->second.create_call(pimpl->thebuilder, external, args);
+    result = abi->second.get_result(pimpl->thebuilder, inst);
+  } else {
+    llvm::Value *const fn = instance ? instance : generate_expr(call->get_callee());
+    generate_args();
+    inst = pimpl->thebuilder.CreateCall(fn, args, "calltmp");
+    if (auto const callee = llvm::dyn_cast<llvm::Function>(fn)) {
+      inst->setCallingConv(callee->getCallingConv());
+    }
+    result = inst;
+  }
+  if (pimpl->tail_calls.count(call) == 0) {
+    return result;
+  }
+
+  // return the result right here so that nothing stands between the call and the ret; whatever
+  // the enclosing expressions still generate lands in a block without predecessors
+  auto const caller = pimpl->thebuilder.GetInsertBlock()->getParent();
+  auto const same_signature = result == inst && inst->getCallingConv() == caller->getCallingConv()
+    && inst->getFunctionType() == caller->getFunctionType() && inst->getAttributes().isEmpty();
+  if (same_signature) {
+    inst->setTailCallKind(llvm::CallInst::TCK_MustTail);
+  } else if (abi == pimpl->c_functions.end() || !abi->second.passes_in_memory()) {
+    // a byval copy or an sret slot lives in the caller's frame
+    inst->setTailCallKind(llvm::CallInst::TCK_Tail);
+  }
+  pimpl->thebuilder.CreateRet(result);
+  pimpl->thebuilder.SetInsertPoint(llvm::BasicBlock::Create(pimpl->thectxt, "tailcont", caller));
+  return llvm::UndefValue::get(result->getType());
+}
+
+// A Decl'd function is declared with the C signature of its type. Repeated Decls of a name, imports
+// included, share one declaration.
 llvm::Value *
 CodeGen::generate_decl_stmt(DeclStmtAst *decl) {
   auto const fnt = llvm::cast<FunctionType>(decl->get_type());
+  auto const name = decl->get_var_name();
 
+  std::vector<Type *> params;
   std::vector<llvm::Type *> llparams;
   for (size_t i = 0, arity = fnt->get_arity(); i < arity; ++i) {
-    auto const llt = generate_llvm_type(pimpl, fnt->get_nth_param(i));
-    llparams.push_back(llt);
+    params.push_back(fnt->get_nth_param(i));
+    llparams.push_back(generate_llvm_type(pimpl, fnt->get_nth_param(i)));
   }
   auto const llfnt = llvm::FunctionType::get(
     generate_llvm_type(pimpl, fnt->get_return_type()), llparams, false /* not variadic */);
-  auto const fn = llvm::Function::Create(
-    llfnt, llvm::Function::ExternalLinkage, llvm::Twine(decl->get_var_name()), pimpl->themod);
-  pimpl->register_val(decl->get_var_name(), fn);
+  FunctionAbi abi(pimpl->themod, params, fnt->get_return_type(), llfnt);
+
+  auto fn = pimpl->themod.getFunction(name);
+  if (!fn) {
+    fn = llvm::Function::Create(
+      abi.get_type(), llvm::Function::ExternalLinkage, llvm::Twine(name), pimpl->themod);
+    fn->setAttributes(abi.get_attributes());
+  } else if (fn->hasLocalLinkage() || fn->getFunctionType() != abi.get_type()) {
+    llvm::report_fatal_error(llvm::Twine("conflicting declarations of ") + name);
+  }
+  if (!abi.is_natural()) {
+    pimpl->c_functions.emplace(fn, abi);
+  }
+  pimpl->register_val(name, fn);
   return llvm::UndefValue::get(llvm::Type::getVoidTy(pimpl->thectxt));
 }
 
-llvm::Value *
-CodeGen::generate_function_definition(DefFnAst *def) {
+llvm::Function *
+CodeGenImpl::get_c_front(llvm::Function *fn) {
+  auto const found = c_fronts.find(fn);
+  if (found != c_fronts.end()) {
+    return found->second;
+  }
+  auto const &abi = c_functions.at(fn);
+  auto const front = llvm::Function::Create(
+    abi.get_natural_type(), llvm::Function::InternalLinkage, fn->getName() + ".front", themod);
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(thectxt, "entry", front));
+  std::vector<llvm::Value *> args;
+  for (auto &&arg : front->args()) {
+    args.push_back(&arg);
+  }
+  auto const call = abi.create_call(b, fn, args);
+  b.CreateRet(abi.get_result(b, call));
+  c_fronts.emplace(fn, front);
+  return front;
+}
+
+// Key spaces up to this size get a direct-mapped table; larger ones share an open-addressing table
+static uint64_t constexpr memo_direct_limit = 1 << 16;
+static uint64_t constexpr memo_hash_capacity = 1 << 12;
+static uint64_t constexpr memo_probe_limit = 8;
+
+// number of distinct values of a Memo parameter, 0 if too many to enumerate
+static uint64_t
+memo_key_domain(Type *type) {
+  if (llvm::isa<BoolType>(type)) {
+    return 2;
+  }
+  if (llvm::isa<U8Type>(type)) {
+    return 256;
+  }
+  if (auto const intty = llvm::dyn_cast<IntNType>(type)) {
+    return (intty->get_width() <= 16) ? (uint64_t(1) << intty->get_width()) : 0;
+  }
+  return 0;
+}
+
+// Defines fn as a cached front for impl. Recursive calls inside impl go through fn, so they hit
+// the cache as well.
+static void
+generate_memo_wrapper(CodeGenImpl *pimpl, DefFnAst *def, llvm::Function *fn, llvm::Function *impl) {
+  auto &ctxt = pimpl->thectxt;
+  auto const i8 = llvm::Type::getInt8Ty(ctxt);
+  auto const i64 = llvm::Type::getInt64Ty(ctxt);
+  auto const retty = fn->getReturnType();
+  auto const name = def->get_name();
   auto const arity = def->get_arity();
+
+  auto const create_global = [&](llvm::Type *type, std::string const &suffix) {
+    return new llvm::GlobalVariable(
+      pimpl->themod,
+      type,
+      false /* not constant */,
+      llvm::GlobalVariable::PrivateLinkage,
+      llvm::Constant::getNullValue(type),
+      name + suffix);
+  };
+  auto const hits = create_global(i64, ".memo.hits");
+  auto const misses = create_global(i64, ".memo.misses");
+  pimpl->memoized.push_back({name, hits, misses});
+
+  std::vector<llvm::Value *> args;
+  for (auto &&arg : fn->args()) {
+    args.push_back(&arg);
+  }
+
+  uint64_t domain = 1;
+  for (size_t i = 0; i < arity && domain != 0; ++i) {
+    auto const d = memo_key_domain(def->get_nth_type(i));
+    domain = (d != 0 && domain * d <= memo_direct_limit) ? domain * d : 0;
+  }
+
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(ctxt, "entry", fn));
+  auto const zero = llvm::ConstantInt::get(i64, 0);
+  auto const hitBB = llvm::BasicBlock::Create(ctxt, "hit", fn);
+  auto const missBB = llvm::BasicBlock::Create(ctxt, "miss", fn);
+
+  llvm::StructType *slotty;
+  llvm::Value *hit_slot;
+  llvm::Value *miss_slot;
+  std::vector<llvm::Value *> keys;
+  if (domain != 0) {
+    // direct-mapped: { valid, value } indexed by the arguments in mixed radix
+    slotty = llvm::StructType::get(ctxt, {i8, retty});
+    auto const tablety = llvm::ArrayType::get(slotty, domain);
+    auto const table = create_global(tablety, ".memo.table");
+
+    llvm::Value *idx = zero;
+    for (size_t i = 0; i < arity; ++i) {
+      auto const d = llvm::ConstantInt::get(i64, memo_key_domain(def->get_nth_type(i)));
+      idx = b.CreateAdd(b.CreateMul(idx, d), b.CreateZExt(args[i], i64));
+    }
+    auto const slot = b.CreateInBoundsGEP(tablety, table, {zero, idx});
+    auto const valid = b.CreateLoad(i8, b.CreateStructGEP(slotty, slot, 0));
+    b.CreateCondBr(b.CreateIsNotNull(valid), hitBB, missBB);
+    hit_slot = miss_slot = slot;
+  } else {
+    // open addressing: { used, keys, value }, linear probing, evicting the home slot when the
+    // probe sequence is exhausted
+    auto const keysty = llvm::ArrayType::get(i64, arity);
+    slotty = llvm::StructType::get(ctxt, {i8, keysty, retty});
+    auto const tablety = llvm::ArrayType::get(slotty, memo_hash_capacity);
+    auto const table = create_global(tablety, ".memo.table");
+    auto const mask = llvm::ConstantInt::get(i64, memo_hash_capacity - 1);
+
+    llvm::Value *hash = zero;
+    for (size_t i = 0; i < arity; ++i) {
+      auto const key = b.CreateIntCast(args[i], i64, is_signed_type(pimpl, def->get_nth_type(i)));
+      keys.push_back(key);
+      hash = b.CreateMul(b.CreateXor(hash, key), llvm::ConstantInt::get(i64, 0x9e3779b97f4a7c15));
+    }
+    hash = b.CreateXor(hash, b.CreateLShr(hash, 32));
+    auto const home = b.CreateAnd(hash, mask);
+    auto const entryBB = b.GetInsertBlock();
+
+    auto const probeBB = llvm::BasicBlock::Create(ctxt, "probe", fn);
+    auto const checkBB = llvm::BasicBlock::Create(ctxt, "check", fn);
+    auto const nextBB = llvm::BasicBlock::Create(ctxt, "next", fn);
+    auto const evictBB = llvm::BasicBlock::Create(ctxt, "evict", fn);
+    b.CreateBr(probeBB);
+
+    b.SetInsertPoint(probeBB);
+    auto const step = b.CreatePHI(i64, 2, "step");
+    step->addIncoming(zero, entryBB);
+    auto const pos = b.CreateAnd(b.CreateAdd(home, step), mask);
+    auto const slot = b.CreateInBoundsGEP(tablety, table, {zero, pos});
+    auto const used = b.CreateLoad(i8, b.CreateStructGEP(slotty, slot, 0));
+    b.CreateCondBr(b.CreateIsNull(used), missBB, checkBB);
+
+    b.SetInsertPoint(checkBB);
+    llvm::Value *same = b.getTrue();
+    for (size_t i = 0; i < arity; ++i) {
+      auto const stored = b.CreateLoad(
+        i64, b.CreateInBoundsGEP(slotty, slot, {b.getInt32(0), b.getInt32(1), b.getInt32(i)}));
+      same = b.CreateAnd(same, b.CreateICmpEQ(stored, keys[i]));
+    }
+    b.CreateCondBr(same, hitBB, nextBB);
+
+    b.SetInsertPoint(nextBB);
+    auto const next = b.CreateAdd(step, llvm::ConstantInt::get(i64, 1));
+    step->addIncoming(next, nextBB);
+    b.CreateCondBr(
+      b.CreateICmpULT(next, llvm::ConstantInt::get(i64, memo_probe_limit)), probeBB, evictBB);
+
+    b.SetInsertPoint(evictBB);
+    auto const home_slot = b.CreateInBoundsGEP(tablety, table, {zero, home});
+    b.CreateBr(missBB);
+
+    b.SetInsertPoint(missBB);
+    auto const target = b.CreatePHI(slot->getType(), 2, "slot");
+    target->addIncoming(slot, probeBB);
+    target->addIncoming(home_slot, evictBB);
+    hit_slot = slot;
+    miss_slot = target;
+  }
+  auto const value_idx = slotty->getNumElements() - 1;
+
+  auto const bump = [&](llvm::GlobalVariable *counter) {
+    auto const count = b.CreateLoad(i64, counter);
+    b.CreateStore(b.CreateAdd(count, llvm::ConstantInt::get(i64, 1)), counter);
+  };
+
+  b.SetInsertPoint(hitBB);
+  bump(hits);
+  b.CreateRet(b.CreateLoad(retty, b.CreateStructGEP(slotty, hit_slot, value_idx)));
+
+  b.SetInsertPoint(missBB);
+  bump(misses);
+  auto const val = b.CreateCall(impl, args);
+  val->setCallingConv(impl->getCallingConv());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    b.CreateStore(
+      keys[i],
+      b.CreateInBoundsGEP(slotty, miss_slot, {b.getInt32(0), b.getInt32(1), b.getInt32(i)}));
+  }
+  b.CreateStore(val, b.CreateStructGEP(slotty, miss_slot, value_idx));
+  b.CreateStore(llvm::ConstantInt::get(i8, 1), b.CreateStructGEP(slotty, miss_slot, 0));
+  b.CreateRet(val);
+}
+
+// Lets GVN, LICM and dead call elimination treat calls to pure DefFns as plain values. Those that
+// read slices are only readonly, so that no call moves across a write to what they read. They also
+// read constant literals and Embeds, which are globals, so argmemonly would be wrong.
+static void
+add_effect_attributes(CodeGenImpl *pimpl, llvm::Function *fn, std::string const &name) {
+  auto const &effects = pimpl->effects;
+  if (!effects.is_pure(name)) {
+    return;
+  }
+  fn->addFnAttr(llvm::Attribute::NoUnwind);
+  if (!effects.may_diverge(name)) {
+    fn->addFnAttr(llvm::Attribute::WillReturn);
+  }
+  // caches, profile counters and Par tasks are memory writes the caller must not drop
+  auto const writes =
+    effects.touches_memo_cache(name) || effects.spawns_tasks(name) || pimpl->opts.profile_generate;
+  if (writes) {
+    return;
+  }
+  if (effects.reads_memory(name)) {
+    fn->addFnAttr(llvm::Attribute::ReadOnly);
+  } else {
+    fn->addFnAttr(llvm::Attribute::ReadNone);
+  }
+}
+
+static llvm::DISubprogram *
+generate_di_subprogram(CodeGenImpl *pimpl, DefFnAst *def, llvm::Function *fn) {
+  auto &dib = *pimpl->dibuilder;
+  std::vector<llvm::Metadata *> types{generate_di_type(pimpl, def->get_return_type())};
+  for (size_t i = 0, arity = def->get_arity(); i < arity; ++i) {
+    types.push_back(generate_di_type(pimpl, def->get_nth_type(i)));
+  }
+  auto const line = pimpl->opts.source->get_line(def->get_loc());
+  auto flags = llvm::DISubprogram::SPFlagDefinition;
+  if (pimpl->opts.optimized) {
+    flags |= llvm::DISubprogram::SPFlagOptimized;
+  }
+  if (fn->hasLocalLinkage()) {
+    flags |= llvm::DISubprogram::SPFlagLocalToUnit;
+  }
+  auto const sp = dib.createFunction(
+    pimpl->difile,
+    def->get_name(),
+    fn->getName(),
+    pimpl->difile,
+    line,
+    dib.createSubroutineType(dib.getOrCreateTypeArray(types)),
+    line,
+    llvm::DINode::FlagPrototyped,
+    flags);
+  fn->setSubprogram(sp);
+  return sp;
+}
+
+// Only main and Export functions are visible outside the module and use the C calling convention;
+// the rest are internal and fastcc unless they are used as values. When the C signature of an
+// exported function is not its natural one, C callers enter through a function of that name that
+// converts, and the function itself is internal. An Async function is a coroutine that returns
+// once it has finished or suspended, and takes the slot for its value and the join to count down
+// last.
+llvm::Function *
+CodeGenImpl::declare_function(DefFnAst *def, std::string const &name, bool used_as_value) {
+  std::vector<Type *> params;
   std::vector<llvm::Type *> param_types;
-  for (size_t i = 0; i < arity; ++i) {
-    auto const type = generate_llvm_type(pimpl, def->get_nth_type(i));
-    param_types.push_back(type);
+  for (size_t i = 0, arity = def->get_arity(); i < arity; ++i) {
+    params.push_back(def->get_nth_type(i));
+    param_types.push_back(generate_llvm_type(this, def->get_nth_type(i)));
+  }
+  auto ret_type = generate_llvm_type(this, def->get_return_type());
+  auto const async = def->has_modifier(DefFnAst::Async);
+  if (async) {
+    param_types.push_back(ret_type->getPointerTo());
+    param_types.push_back(get_join_type(this)->getPointerTo());
+    ret_type = llvm::Type::getVoidTy(thectxt);
+  }
+  llvm::FunctionType *fn_type =
+    llvm::FunctionType::get(ret_type, param_types, false /* not variadic */);
+  auto exported = def->has_modifier(DefFnAst::Export) || def->get_name() == "main";
+  llvm::Function *entry = nullptr;
+  llvm::Optional<FunctionAbi> abi;
+  if (exported) {
+    abi.emplace(themod, params, def->get_return_type(), fn_type);
+    if (!abi->is_natural()) {
+      entry = llvm::Function::Create(
+        abi->get_type(), llvm::Function::ExternalLinkage, llvm::Twine(name), themod);
+      entry->setAttributes(abi->get_attributes());
+      exported = false;
+    }
   }
-  llvm::FunctionType *fn_type = llvm::FunctionType::get(
-    generate_llvm_type(pimpl, def->get_return_type()), param_types, false /* not variadic */);
   llvm::Function *fn = llvm::Function::Create(
-    fn_type, llvm::Function::ExternalLinkage, llvm::Twine(def->get_name()), pimpl->themod);
-  pimpl->register_val(def->get_name(), fn);
+    fn_type,
+    exported ? llvm::Function::ExternalLinkage : llvm::Function::InternalLinkage,
+    entry ? name + ".body" : name,
+    themod);
+  if (!exported && !used_as_value) {
+    fn->setCallingConv(llvm::CallingConv::Fast);
+  }
+  if (async) {
+    // CoroSplit only takes functions that the front end marks as coroutines not yet split
+    fn->addFnAttr("coroutine.presplit", "0");
+    async_fns.insert(fn);
+  }
+  add_effect_attributes(this, fn, def->get_name());
+  if (entry) {
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(thectxt, "entry", entry));
+    auto const call = b.CreateCall(fn, abi->get_params(b, entry));
+    call->setCallingConv(fn->getCallingConv());
+    abi->create_return(b, entry, call);
+  }
+  return fn;
+}
+
+// Allocates the frame of the Async function being generated from kcrt and adds the blocks that free
+// the frame and that leave the function, the latter also where it suspends
+static void
+begin_coroutine(CodeGenImpl *pimpl) {
+  auto &b = pimpl->thebuilder;
+  auto &mod = pimpl->themod;
+  auto const fn = b.GetInsertBlock()->getParent();
+  auto const i8p = b.getInt8PtrTy();
+  auto const null = llvm::ConstantPointerNull::get(i8p);
+  auto const intrinsic = [&](llvm::Intrinsic::ID id, llvm::ArrayRef<llvm::Type *> types = {}) {
+    return llvm::Intrinsic::getDeclaration(&mod, id, types);
+  };
+  auto const alloc = mod.getOrInsertFunction(
+    "kcrt_frame_alloc", llvm::FunctionType::get(i8p, {b.getInt64Ty()}, false));
+  auto const dealloc = mod.getOrInsertFunction(
+    "kcrt_frame_free", llvm::FunctionType::get(b.getVoidTy(), {i8p}, false));
+
+  auto const id =
+    b.CreateCall(intrinsic(llvm::Intrinsic::coro_id), {b.getInt32(0), null, null, null});
+  auto const size = b.CreateCall(intrinsic(llvm::Intrinsic::coro_size, {b.getInt64Ty()}));
+  auto const frame = b.CreateCall(alloc, {size}, "frame");
+  auto const handle = b.CreateCall(intrinsic(llvm::Intrinsic::coro_begin), {id, frame}, "handle");
+
+  auto const cleanupBB = llvm::BasicBlock::Create(pimpl->thectxt, "coro.cleanup", fn);
+  auto const suspendBB = llvm::BasicBlock::Create(pimpl->thectxt, "coro.suspend", fn);
+  llvm::IRBuilder<> cleanup(cleanupBB);
+  auto const dead_frame = cleanup.CreateCall(intrinsic(llvm::Intrinsic::coro_free), {id, handle});
+  cleanup.CreateCall(dealloc, {dead_frame});
+  cleanup.CreateBr(suspendBB);
+  llvm::IRBuilder<> suspend(suspendBB);
+  suspend.CreateCall(intrinsic(llvm::Intrinsic::coro_end), {handle, suspend.getFalse()});
+  suspend.CreateRetVoid();
+
+  pimpl->coro_handle = handle;
+  pimpl->coro_cleanup = cleanupBB;
+  pimpl->coro_suspend = suspendBB;
+}
+
+static unsigned constexpr max_instance_depth = 64;
+
+// The instance of def for the type arguments of call, named after them like max[i64]. The name is
+// the key of the instance cache, so each instance is emitted once per module.
+llvm::Function *
+CodeGenImpl::instantiate(DefFnAst *def, CallExprAst *call) {
+  auto const &tyvars = def->get_type_params();
+  auto const &args = call->get_type_args();
+  TypeBindings bindings;
+  std::string name = def->get_name() + "[";
+  for (size_t i = 0; i < tyvars.size(); ++i) {
+    auto const ty = substitute(args[i], type_args);
+    bindings[tyvars[i]->get_id()] = ty;
+    name += (i ? ", " : "") + type_name(ty);
+  }
+  name += "]";
+  auto const found = instances.find(name);
+  if (found != instances.end()) {
+    return found->second;
+  }
+  if (instance_depth >= max_instance_depth) {
+    llvm::report_fatal_error(llvm::Twine("instances of ") + def->get_name() + " nest too deeply");
+  }
+  auto const outer = type_args;
+  type_args = bindings;
+  auto const fn = declare_function(def, name, false);
+  type_args = outer;
+  instances[name] = fn;
+  pending.push_back({def, fn, bindings, instance_depth + 1});
+  return fn;
+}
+
+llvm::Value *
+CodeGen::generate_function_definition(DefFnAst *def, llvm::Function *fn) {
+  llvm::TimeTraceScope scope("CodeGenFunction", [&] { return fn->getName().str(); });
+  auto const arity = def->get_arity();
 
-  llvm::BasicBlock *BB = llvm::BasicBlock::Create(pimpl->thectxt, "entry", fn);
+  // a Memo function's body lives in a private function behind the cache
+  auto impl = fn;
+  if (def->has_modifier(DefFnAst::Memo)) {
+    impl = llvm::Function::Create(
+      fn->getFunctionType(),
+      llvm::Function::InternalLinkage,
+      def->get_name() + ".memo.body",
+      pimpl->themod);
+    impl->setCallingConv(fn->getCallingConv());
+    add_effect_attributes(pimpl, impl, def->get_name());
+  }
+
+  if (pimpl->dibuilder) {
+    pimpl->discope = generate_di_subprogram(pimpl, def, impl);
+  }
+
+  llvm::BasicBlock *BB = llvm::BasicBlock::Create(pimpl->thectxt, "entry", impl);
   pimpl->thebuilder.SetInsertPoint(BB);
+  auto const async = def->has_modifier(DefFnAst::Async);
+  if (async) {
+    begin_coroutine(pimpl);
+  }
+  pimpl->begin_profile(impl, fn->getName().str(), 1 + 2 * count_if_exprs(def->get_body()));
 
   pimpl->push_vartab();
   size_t i = 0;
-  for (auto AI = fn->arg_begin(); i < arity; ++i, ++AI) {
+  for (auto AI = impl->arg_begin(); i < arity; ++i, ++AI) {
     auto const name = def->get_nth_name(i);
     AI->setName(name);
-    pimpl->register_val(name, AI);
+    if (!pimpl->discope) {
+      pimpl->register_val(name, AI);
+      continue;
+    }
+    // spill parameters so that they stay visible to the debugger for the whole body
+    auto const alloca = pimpl->register_auto_var(name, AI);
+    pimpl->thebuilder.CreateStore(AI, alloca);
+    pimpl->declare_variable(
+      alloca, name, generate_di_type(pimpl, def->get_nth_type(i)), def, i + 1);
   }
 
+  pimpl->tail_calls.clear();
+  if (!async) {
+    collect_tail_calls(def->get_body(), pimpl->tail_calls);
+  }
   auto const val = generate_expr(def->get_body());
-  pimpl->thebuilder.CreateRet(val);
+  if (async) {
+    // leave the value for the caller; the frame goes once the caller is told
+    auto &b = pimpl->thebuilder;
+    auto const join = impl->arg_end() - 1;
+    auto const result = join - 1;
+    result->setName("result");
+    join->setName("join");
+    b.CreateStore(val, result);
+    auto const done = pimpl->themod.getOrInsertFunction(
+      "kcrt_join_done", llvm::FunctionType::get(b.getVoidTy(), {join->getType()}, false));
+    b.CreateCall(done, {join});
+    b.CreateBr(pimpl->coro_cleanup);
+    pimpl->coro_handle = nullptr;
+    pimpl->coro_cleanup = nullptr;
+    pimpl->coro_suspend = nullptr;
+  } else {
+    pimpl->thebuilder.CreateRet(val);
+  }
 
   pimpl->pop_vartab();
-  llvm::verifyFunction(*fn);
+  pimpl->discope = nullptr;
+  llvm::verifyFunction(*impl);
+
+  if (impl != fn) {
+    generate_memo_wrapper(pimpl, def, fn, impl);
+    llvm::verifyFunction(*fn);
+  }
 
   return fn;
 }
 
+// The llvm.loop metadata carrying the Hint clause of a loop, attached to its latch branch
+static llvm::MDNode *
+create_loop_metadata(llvm::LLVMContext &ctxt, LoopHints const &hints) {
+  std::vector<llvm::Metadata *> ops{nullptr}; // the loop ID refers to itself
+  auto const add = [&](char const *name, llvm::Metadata *value) {
+    std::vector<llvm::Metadata *> property{llvm::MDString::get(ctxt, name)};
+    if (value) {
+      property.push_back(value);
+    }
+    ops.push_back(llvm::MDNode::get(ctxt, property));
+  };
+  auto const constant = [&](llvm::Type *type, unsigned value) {
+    return llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(type, value));
+  };
+  auto const i1 = llvm::Type::getInt1Ty(ctxt);
+  auto const i32 = llvm::Type::getInt32Ty(ctxt);
+
+  if (hints.vectorize == 1) {
+    add("llvm.loop.vectorize.enable", constant(i1, 0));
+  } else if (hints.vectorize > 1) {
+    add("llvm.loop.vectorize.enable", constant(i1, 1));
+    add("llvm.loop.vectorize.width", constant(i32, hints.vectorize));
+  }
+  if (hints.interleave > 0) {
+    add("llvm.loop.interleave.count", constant(i32, hints.interleave));
+  }
+  if (hints.unroll == 1) {
+    add("llvm.loop.unroll.disable", nullptr);
+  } else if (hints.unroll > 1) {
+    add("llvm.loop.unroll.count", constant(i32, hints.unroll));
+  }
+
+  auto const loop_id = llvm::MDNode::getDistinct(ctxt, ops);
+  loop_id->replaceOperandWith(0, loop_id);
+  return loop_id;
+}
+
+// Makes the value of a loop variable in the current iteration visible to the loop body. Under -g
+// it is spilled like a Let so that the debugger can show it.
+static void
+bind_loop_variable(
+  CodeGenImpl *pimpl, std::string const &name, llvm::Value *val, Type *type, Ast *loop) {
+  if (!pimpl->discope) {
+    pimpl->register_val(name, val);
+    return;
+  }
+  auto const alloca = pimpl->register_auto_var(name, val);
+  pimpl->declare_variable(alloca, name, generate_di_type(pimpl, type), loop, 0);
+  pimpl->thebuilder.CreateStore(val, alloca);
+}
+
+// Lowers to a guarded bottom-tested loop whose induction variable and accumulator are phis:
+//
+//   entry:    br (start < end), body, exit
+//   body:     var = phi [start, entry], [next, latch]; acc = phi [init, entry], [value, latch]
+//             ...
+//   latch:    value = body; next = var + 1; br (next < end), body, exit
+//   exit:     phi [init, entry], [value, latch]
+llvm::Value *
+CodeGen::generate_for_expr(ForExprAst *loop) {
+  auto &b = pimpl->thebuilder;
+  auto const start = generate_expr(loop->get_start());
+  auto const end = generate_expr(loop->get_end());
+  auto const init = generate_expr(loop->get_init());
+  auto const varty = llvm::cast<ExprAst>(loop->get_start())->get_type();
+  auto const signed_var = is_signed_type(pimpl, varty);
+  auto const less = [&](llvm::Value *lhs, llvm::Value *rhs) {
+    return signed_var ? b.CreateICmpSLT(lhs, rhs) : b.CreateICmpULT(lhs, rhs);
+  };
+
+  auto const func = b.GetInsertBlock()->getParent();
+  auto const entryBB = b.GetInsertBlock();
+  auto const bodyBB = llvm::BasicBlock::Create(pimpl->thectxt, "for.body", func);
+  auto const exitBB = llvm::BasicBlock::Create(pimpl->thectxt, "for.end");
+  b.CreateCondBr(less(start, end), bodyBB, exitBB);
+
+  b.SetInsertPoint(bodyBB);
+  auto const var = b.CreatePHI(start->getType(), 2, loop->get_var_name());
+  auto const acc = b.CreatePHI(init->getType(), 2, loop->get_acc_name());
+  var->addIncoming(start, entryBB);
+  acc->addIncoming(init, entryBB);
+
+  pimpl->push_vartab();
+  bind_loop_variable(pimpl, loop->get_var_name(), var, varty, loop);
+  bind_loop_variable(pimpl, loop->get_acc_name(), acc, loop->get_type(), loop);
+  auto const value = generate_expr(loop->get_body());
+  pimpl->pop_vartab();
+
+  auto const one = llvm::ConstantInt::get(var->getType(), 1);
+  auto const next = signed_var ? b.CreateNSWAdd(var, one) : b.CreateNUWAdd(var, one);
+  auto const latchBB = b.GetInsertBlock();
+  auto const loop_id = create_loop_metadata(pimpl->thectxt, loop->get_hints());
+  b.CreateCondBr(less(next, end), bodyBB, exitBB)->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+  var->addIncoming(next, latchBB);
+  acc->addIncoming(value, latchBB);
+
+  func->getBasicBlockList().push_back(exitBB);
+  b.SetInsertPoint(exitBB);
+  auto const result = b.CreatePHI(init->getType(), 2, "for.result");
+  result->addIncoming(init, entryBB);
+  result->addIncoming(value, latchBB);
+  return result;
+}
+
 llvm::Value *
 CodeGen::generate_if_expr(IfExprAst *ife) {
   auto const cond = generate_expr(ife->get_cond());
@@ -277,9 +1795,17 @@ CodeGen::generate_if_expr(IfExprAst *ife) {
   auto thenBB = llvm::BasicBlock::Create(pimpl->thectxt, "then", func);
   auto elseBB = llvm::BasicBlock::Create(pimpl->thectxt, "else");
   auto const mergeBB = llvm::BasicBlock::Create(pimpl->thectxt, "ifcont");
-  pimpl->thebuilder.CreateCondBr(cond, thenBB, elseBB);
+  auto const br = pimpl->thebuilder.CreateCondBr(cond, thenBB, elseBB);
+
+  auto const counter = pimpl->allocate_counters(2);
+  if (auto const counts = pimpl->prof_counts) {
+    br->setMetadata(
+      llvm::LLVMContext::MD_prof,
+      create_branch_weights(pimpl->thectxt, (*counts)[counter], (*counts)[counter + 1]));
+  }
 
   pimpl->thebuilder.SetInsertPoint(thenBB);
+  pimpl->increment_counter(counter);
   auto const thenV = generate_expr(ife->get_then());
 
   pimpl->thebuilder.CreateBr(mergeBB);
@@ -287,6 +1813,7 @@ CodeGen::generate_if_expr(IfExprAst *ife) {
 
   func->getBasicBlockList().push_back(elseBB);
   pimpl->thebuilder.SetInsertPoint(elseBB);
+  pimpl->increment_counter(counter + 1);
   auto const elseV = generate_expr(ife->get_else());
   pimpl->thebuilder.CreateBr(mergeBB);
   elseBB = pimpl->thebuilder.GetInsertBlock();
@@ -303,7 +1830,7 @@ CodeGen::generate_if_expr(IfExprAst *ife) {
 
 llvm::Value *
 CodeGen::generate_integer_literal(IntegerLiteralExpr *num) {
-  auto const type = llvm::Type::getInt32Ty(pimpl->thectxt);
+  auto const type = generate_llvm_type(pimpl, num->get_type());
   return llvm::ConstantInt::get(type, num->get_value());
 }
 
@@ -313,13 +1840,17 @@ CodeGen::generate_let_stmt(LetStmtAst *let) {
 
   auto const name = let->get_var_name();
   auto const alloca = pimpl->register_auto_var(name, val);
+  if (pimpl->discope) {
+    auto const type = llvm::cast<ExprAst>(let->get_init())->get_type();
+    pimpl->declare_variable(alloca, name, generate_di_type(pimpl, type), let, 0);
+  }
   pimpl->thebuilder.CreateStore(val, alloca);
 
   return alloca;
 }
 
 static llvm::Constant *
-create_global_octet_seq_ptr(CodeGenImpl *pimpl, std::string const &data) {
+create_global_octet_seq_ptr(CodeGenImpl *pimpl, llvm::StringRef data) {
   // See llvm::IRBuilderBase::CreateGlobalStringPtr()
   auto const strval = llvm::ConstantDataArray::getString(pimpl->thectxt, data, false /* no \0 */);
   auto global = new llvm::GlobalVariable(
@@ -345,7 +1876,7 @@ CodeGen::generate_octet_seq_literal(OctetSeqLiteralAst *oseq) {
   auto const content = oseq->get_content();
   auto const pai8 = create_global_octet_seq_ptr(pimpl, content);
 
-  llvm::ArrayRef<llvm::Constant *> members{
+  std::array<llvm::Constant *, 2> members{
     pai8, llvm::ConstantInt::get(llvm::Type::getInt32Ty(pimpl->thectxt), content.size())};
   auto const slice_t = get_slice_type(pimpl, llvm::IntegerType::getInt8Ty(pimpl->thectxt));
   auto const val = llvm::ConstantStruct::get(slice_t, members);
@@ -353,6 +1884,199 @@ CodeGen::generate_octet_seq_literal(OctetSeqLiteralAst *oseq) {
   return val;
 }
 
+// The file's bytes go straight from its mapping into the constant; mapped files are never
+// NUL-terminated, so no terminator is added either.
+llvm::Value *
+CodeGen::generate_embed_expr(EmbedExprAst *embed) {
+  if (!embed->get_data()) {
+    llvm::report_fatal_error(llvm::Twine("Embed \"") + embed->get_path() + "\" was not loaded");
+  }
+  auto &ptr = pimpl->embedded[embed->get_data()];
+  if (!ptr) {
+    ptr = create_global_octet_seq_ptr(pimpl, llvm::StringRef(embed->get_data(), embed->get_size()));
+  }
+  std::array<llvm::Constant *, 2> members{
+    ptr, llvm::ConstantInt::get(llvm::Type::getInt32Ty(pimpl->thectxt), embed->get_size())};
+  auto const slice_t = get_slice_type(pimpl, llvm::IntegerType::getInt8Ty(pimpl->thectxt));
+  return llvm::ConstantStruct::get(slice_t, members);
+}
+
+// Every operand but the last is outlined into a task function over a frame holding the locals it
+// refers to and, last, its value. The task is spawned on the kcrt scheduler while this thread has
+// Par budget left, and called in place otherwise:
+//
+//   parallel = kcrt_par_budget > 0
+//   parallel ? kcrt_spawn(task, f.par, frame) : f.par(frame)   for each outlined operand
+//   last operand
+//   parallel ? kcrt_sync(task)                                 in reverse
+//   body, with the operands taken from the frames
+llvm::Value *
+CodeGen::generate_par_expr(ParExprAst *par) {
+  auto &ctxt = pimpl->thectxt;
+  auto &mod = pimpl->themod;
+  auto &b = pimpl->thebuilder;
+  auto const voidty = llvm::Type::getVoidTy(ctxt);
+  auto const i8p = llvm::Type::getInt8PtrTy(ctxt);
+  auto const i32 = llvm::Type::getInt32Ty(ctxt);
+  auto const taskty = llvm::StructType::get(ctxt, {i8p, i8p, i32, i32});
+  auto const taskfnty = llvm::FunctionType::get(voidty, {i8p}, false);
+  auto const spawn = mod.getOrInsertFunction(
+    "kcrt_spawn",
+    llvm::FunctionType::get(
+      voidty, {taskty->getPointerTo(), taskfnty->getPointerTo(), i8p}, false));
+  auto const sync = mod.getOrInsertFunction(
+    "kcrt_sync", llvm::FunctionType::get(voidty, {taskty->getPointerTo()}, false));
+  if (!mod.getFunction("kcrt_par_init")) {
+    auto const init = llvm::Function::Create(
+      llvm::FunctionType::get(voidty, false),
+      llvm::Function::ExternalLinkage,
+      "kcrt_par_init",
+      mod);
+    llvm::appendToGlobalCtors(mod, init, 0);
+  }
+  auto budget = mod.getNamedGlobal("kcrt_par_budget");
+  if (!budget) {
+    budget = new llvm::GlobalVariable(
+      mod,
+      i32,
+      false /* not constant */,
+      llvm::GlobalValue::ExternalLinkage,
+      nullptr,
+      "kcrt_par_budget",
+      nullptr,
+      llvm::GlobalValue::InitialExecTLSModel);
+  }
+
+  auto const caller = b.GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entry(&caller->getEntryBlock(), caller->getEntryBlock().begin());
+  auto const parallel = b.CreateICmpSGT(b.CreateLoad(i32, budget), llvm::ConstantInt::get(i32, 0));
+
+  struct Task {
+    Ast *operand;
+    llvm::StructType *framety;
+    llvm::Value *frame;
+    llvm::Value *task;
+  };
+  std::vector<Task> tasks;
+  auto const operands = par->get_operands();
+  for (size_t i = 0; i + 1 < operands.size(); ++i) {
+    auto const operand = operands[i];
+
+    // functions and Decls are visible to the task as they are; other locals go through the frame
+    std::set<std::string> names;
+    collect_var_refs(operand, names);
+    CodeGenImpl::varmap visible;
+    std::vector<std::pair<std::string, llvm::Value *>> captures;
+    std::vector<llvm::Type *> fields;
+    for (auto &&name : names) {
+      auto val = pimpl->lookup_vartab(name);
+      if (!val) {
+        continue; // a builtin
+      }
+      if (llvm::isa<llvm::GlobalValue>(val)) {
+        visible[name] = val;
+        continue;
+      }
+      if (auto const alloca = llvm::dyn_cast<llvm::AllocaInst>(val)) {
+        val = b.CreateLoad(alloca->getAllocatedType(), alloca, name);
+      }
+      captures.emplace_back(name, val);
+      fields.push_back(val->getType());
+    }
+    fields.push_back(generate_llvm_type(pimpl, llvm::cast<ExprAst>(operand)->get_type()));
+    auto const framety = llvm::StructType::get(ctxt, fields);
+    auto const frame = entry.CreateAlloca(framety, nullptr, "par.frame");
+    for (size_t j = 0; j < captures.size(); ++j) {
+      b.CreateStore(captures[j].second, b.CreateStructGEP(framety, frame, j));
+    }
+
+    auto const fn = llvm::Function::Create(
+      taskfnty, llvm::Function::InternalLinkage, caller->getName() + ".par", mod);
+    {
+      llvm::IRBuilderBase::InsertPointGuard guard(b);
+      auto const outer_vartab = pimpl->vartab;
+      auto const outer_scope = pimpl->discope;
+      b.SetInsertPoint(llvm::BasicBlock::Create(ctxt, "entry", fn));
+      b.SetCurrentDebugLocation(llvm::DebugLoc());
+      if (auto const dib = pimpl->dibuilder.get()) {
+        auto const line = pimpl->opts.source->get_line(operand->get_loc());
+        auto flags = llvm::DISubprogram::SPFlagDefinition | llvm::DISubprogram::SPFlagLocalToUnit;
+        if (pimpl->opts.optimized) {
+          flags |= llvm::DISubprogram::SPFlagOptimized;
+        }
+        auto const sp = dib->createFunction(
+          pimpl->difile,
+          fn->getName(),
+          fn->getName(),
+          pimpl->difile,
+          line,
+          dib->createSubroutineType(dib->getOrCreateTypeArray({nullptr, nullptr})),
+          line,
+          llvm::DINode::FlagArtificial,
+          flags);
+        fn->setSubprogram(sp);
+        pimpl->discope = sp;
+      }
+
+      // only the top-level functions stay in scope
+      pimpl->vartab.resize(1);
+      pimpl->vartab.push_back(visible);
+      auto const arg = b.CreateBitCast(fn->arg_begin(), framety->getPointerTo());
+      for (size_t j = 0; j < captures.size(); ++j) {
+        auto const &name = captures[j].first;
+        pimpl->register_val(
+          name, b.CreateLoad(fields[j], b.CreateStructGEP(framety, arg, j), name));
+      }
+      auto const value = generate_expr(operand);
+      b.CreateStore(value, b.CreateStructGEP(framety, arg, captures.size()));
+      b.CreateRetVoid();
+
+      pimpl->vartab = outer_vartab;
+      pimpl->discope = outer_scope;
+      llvm::verifyFunction(*fn);
+    }
+
+    auto const task = entry.CreateAlloca(taskty, nullptr, "par.task");
+    auto const spawnBB = llvm::BasicBlock::Create(ctxt, "par.spawn", caller);
+    auto const inlineBB = llvm::BasicBlock::Create(ctxt, "par.inline", caller);
+    auto const contBB = llvm::BasicBlock::Create(ctxt, "par.cont", caller);
+    b.CreateCondBr(parallel, spawnBB, inlineBB);
+    b.SetInsertPoint(spawnBB);
+    b.CreateCall(spawn, {task, fn, b.CreateBitCast(frame, i8p)});
+    b.CreateBr(contBB);
+    b.SetInsertPoint(inlineBB);
+    b.CreateCall(fn, {b.CreateBitCast(frame, i8p)});
+    b.CreateBr(contBB);
+    b.SetInsertPoint(contBB);
+    tasks.push_back({operand, framety, frame, task});
+  }
+
+  auto const last = operands.back();
+  pimpl->evaluated[last] = generate_expr(last);
+
+  auto const func = b.GetInsertBlock()->getParent();
+  auto const syncBB = llvm::BasicBlock::Create(ctxt, "par.sync", func);
+  auto const joinBB = llvm::BasicBlock::Create(ctxt, "par.join", func);
+  b.CreateCondBr(parallel, syncBB, joinBB);
+  b.SetInsertPoint(syncBB);
+  for (auto iter = tasks.rbegin(); iter != tasks.rend(); ++iter) {
+    b.CreateCall(sync, {iter->task});
+  }
+  b.CreateBr(joinBB);
+  b.SetInsertPoint(joinBB);
+  for (auto &&t : tasks) {
+    auto const index = t.framety->getNumElements() - 1;
+    pimpl->evaluated[t.operand] =
+      b.CreateLoad(t.framety->getElementType(index), b.CreateStructGEP(t.framety, t.frame, index));
+  }
+
+  auto const value = generate_expr(par->get_body());
+  for (auto &&operand : operands) {
+    pimpl->evaluated.erase(operand);
+  }
+  return value;
+}
+
 llvm::Value *
 CodeGen::generate_var_ref(VarRefExprAst *var) {
   auto const name = var->get_name();
@@ -360,5 +2084,50 @@ CodeGen::generate_var_ref(VarRefExprAst *var) {
   if (auto const alloc = llvm::dyn_cast<llvm::AllocaInst>(val)) {
     return pimpl->thebuilder.CreateLoad(alloc, name);
   }
+  // function values have the natural signature
+  auto const fn = llvm::dyn_cast<llvm::Function>(val);
+  if (fn && pimpl->c_functions.count(fn) != 0) {
+    return pimpl->get_c_front(fn);
+  }
   return val;
 }
+
+// Lowers to a top-tested loop over one phi; loop rotation turns it into the guarded form
+//
+//   entry:    br cond
+//   cond:     acc = phi [init, entry], [value, latch]; br cond, body, exit
+//   latch:    value = body; br cond
+//   exit:     acc
+llvm::Value *
+CodeGen::generate_while_expr(WhileExprAst *loop) {
+  auto &b = pimpl->thebuilder;
+  auto const init = generate_expr(loop->get_init());
+
+  auto const func = b.GetInsertBlock()->getParent();
+  auto const entryBB = b.GetInsertBlock();
+  auto const condBB = llvm::BasicBlock::Create(pimpl->thectxt, "while.cond", func);
+  auto const bodyBB = llvm::BasicBlock::Create(pimpl->thectxt, "while.body");
+  auto const exitBB = llvm::BasicBlock::Create(pimpl->thectxt, "while.end");
+  b.CreateBr(condBB);
+
+  b.SetInsertPoint(condBB);
+  auto const acc = b.CreatePHI(init->getType(), 2, loop->get_acc_name());
+  acc->addIncoming(init, entryBB);
+
+  pimpl->push_vartab();
+  bind_loop_variable(pimpl, loop->get_acc_name(), acc, loop->get_type(), loop);
+  b.CreateCondBr(generate_expr(loop->get_cond()), bodyBB, exitBB);
+
+  func->getBasicBlockList().push_back(bodyBB);
+  b.SetInsertPoint(bodyBB);
+  auto const value = generate_expr(loop->get_body());
+  pimpl->pop_vartab();
+  auto const latchBB = b.GetInsertBlock();
+  auto const loop_id = create_loop_metadata(pimpl->thectxt, loop->get_hints());
+  b.CreateBr(condBB)->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+  acc->addIncoming(value, latchBB);
+
+  func->getBasicBlockList().push_back(exitBB);
+  b.SetInsertPoint(exitBB);
+  return acc;
+}
@@ -0,0 +1,377 @@
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/RemarkStreamer.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "compiler.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "profile.hpp"
+#include "remarks.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "typechecker.hpp"
+
+PhaseScope::PhaseScope(char const *phase_name, char const *description, bool time_report):
+    name(phase_name),
+    timer(name, description, "kccc++", "Compilation phases", time_report),
+    trace(name) {
+}
+
+PhaseScope::~PhaseScope() {
+  if (auto const stats = CompileStats::active()) {
+    stats->record_peak_rss(name);
+  }
+}
+
+// report_fatal_error() would exit the whole process; inside a CompilerInstance call it unwinds to
+// the call's CrashRecoveryContext instead, and the call fails with the message.
+static thread_local std::string *fatal_error_message = nullptr;
+
+static void
+recover_from_fatal_error(void *, std::string const &reason, bool) {
+  if (auto const crc = llvm::CrashRecoveryContext::GetCurrent()) {
+    if (fatal_error_message) {
+      *fatal_error_message = reason;
+    }
+    crc->HandleCrash();
+  }
+}
+
+void
+enable_crash_recovery() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    llvm::CrashRecoveryContext::Enable();
+    llvm::install_fatal_error_handler(recover_from_fatal_error);
+  });
+}
+
+static llvm::Error
+make_compile_error(llvm::Twine const &message) {
+  return llvm::make_error<llvm::StringError>(
+    message, std::make_error_code(std::errc::invalid_argument));
+}
+
+// `Import m` reads m.kci from the directory of the importing file, then from each -I directory.
+// The runtime library needs no file.
+static llvm::Expected<ModuleInterface>
+load_import(std::string const &module, CompileOptions const &opts) {
+  if (module == "kcrt") {
+    return ModuleInterface::runtime();
+  }
+  std::vector<std::string> dirs = {llvm::sys::path::parent_path(opts.input_filename).str()};
+  dirs.insert(dirs.end(), opts.import_paths.begin(), opts.import_paths.end());
+  for (auto &&dir : dirs) {
+    llvm::SmallString<128> path(dir);
+    llvm::sys::path::append(path, module + ".kci");
+    if (llvm::sys::fs::exists(path)) {
+      return ModuleInterface::load(path.str().str());
+    }
+  }
+  return llvm::make_error<llvm::StringError>(
+    "cannot find the interface of module " + module,
+    std::make_error_code(std::errc::no_such_file_or_directory));
+}
+
+// `Embed "p"` reads p relative to the directory of the embedding file. Files past a few pages are
+// mapped rather than read, which needs them not to be NUL-terminated.
+static llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+map_embedded_file(std::string const &path, CompileOptions const &opts) {
+  llvm::SmallString<128> resolved(path);
+  if (llvm::sys::path::is_relative(path)) {
+    resolved = llvm::sys::path::parent_path(opts.input_filename);
+    llvm::sys::path::append(resolved, path);
+  }
+  auto buffer = llvm::MemoryBuffer::getFile(resolved, -1, false);
+  if (!buffer) {
+    return llvm::make_error<llvm::StringError>(
+      "cannot embed " + path + ": " + buffer.getError().message(), buffer.getError());
+  }
+  // Slice lengths are i32
+  if (buffer.get()->getBufferSize() > INT32_MAX) {
+    return llvm::make_error<llvm::StringError>(
+      "cannot embed " + path + ": larger than 2 GiB",
+      std::make_error_code(std::errc::file_too_large));
+  }
+  return std::move(buffer.get());
+}
+
+CompilerInstance::CompilerInstance(
+  CompileOptions options, TargetMachinePool *pool, llvm::raw_ostream *diag):
+    options(std::move(options)), pool(pool), diag(diag) {
+}
+
+CompilerInstance::~CompilerInstance() {
+  // the module must go before its context
+  mod.reset();
+  ctxt.reset();
+  if (pool && target_machine) {
+    pool->release(options.opt_level, std::move(target_machine));
+  }
+}
+
+llvm::Error
+CompilerInstance::run_safely(std::function<llvm::Error()> const &fn) {
+  std::string fatal;
+  auto const outer = fatal_error_message;
+  fatal_error_message = &fatal;
+  llvm::Error err = llvm::Error::success();
+  llvm::CrashRecoveryContext crc;
+  auto const completed = crc.RunSafely([&] {
+    llvm::ErrorAsOutParameter out(&err);
+    err = fn();
+  });
+  fatal_error_message = outer;
+  if (!completed) {
+    // whatever the crashed call had built is in an unknown state
+    mod.reset();
+    return make_compile_error(fatal.empty() ? "compiler crashed" : fatal);
+  }
+  return err;
+}
+
+llvm::Error
+CompilerInstance::compile_file() {
+  auto source = SourceFile::open(options.input_filename);
+  if (!source) {
+    return source.takeError();
+  }
+  return compile(std::move(source.get()));
+}
+
+llvm::Error
+CompilerInstance::compile(SourceFile source) {
+  if (compiled) {
+    return make_compile_error("a CompilerInstance compiles one source");
+  }
+  compiled = true;
+  this->source = std::make_unique<SourceFile>(std::move(source));
+  llvm::TimeTraceScope compile_scope("Compile", options.input_filename);
+  return run_safely([&] { return generate(); });
+}
+
+llvm::Error
+CompilerInstance::setup_remarks(TranslationUnitAst *tunit) {
+  auto const &passed = options.remarks_passed;
+  auto const &missed = options.remarks_missed;
+  auto const &analysis = options.remarks_analysis;
+  if (diag && !(passed.empty() && missed.empty() && analysis.empty())) {
+    auto handler = RemarkHandler::create(passed, missed, analysis, *source, tunit, *diag);
+    if (!handler) {
+      return handler.takeError();
+    }
+    ctxt->setDiagnosticHandler(std::move(handler.get()), true);
+  }
+  if (!options.remarks_record.empty()) {
+    auto record = llvm::setupOptimizationRemarks(*ctxt, options.remarks_record, "", "yaml", false);
+    if (!record) {
+      return record.takeError();
+    }
+    remarks_record = std::move(record.get());
+    remarks_record->keep();
+  }
+  return llvm::Error::success();
+}
+
+void
+CompilerInstance::record_function_stats(char const *phase) {
+  if (options.function_stats) {
+    function_stats.emplace_back(phase, collect_function_stats(*mod));
+  }
+}
+
+llvm::Error
+CompilerInstance::generate() {
+  std::vector<Token> tokens;
+  {
+    PhaseScope phase("Lex", "Lexical analysis", options.time_report);
+    tokens = LexicalAnalysis(*source);
+  }
+  TranslationUnitAst *tunit;
+  {
+    PhaseScope phase("Parse", "Parsing", options.time_report);
+    Parser parser(tokens);
+    tunit = parser.parse_top_level_decl();
+  }
+  {
+    PhaseScope phase("Import", "Interface loading", options.time_report);
+    for (auto &&module : tunit->get_imports()) {
+      auto imported = load_import(module, options);
+      if (!imported) {
+        return imported.takeError();
+      }
+      for (auto &&fn : imported->get_functions()) {
+        tunit->add_import_decl(new DeclStmtAst(fn.name, fn.type));
+      }
+    }
+  }
+  // kept until code generation has copied them into the module
+  std::map<std::string, std::unique_ptr<llvm::MemoryBuffer>> embedded;
+  {
+    PhaseScope phase("Embed", "Embedded file mapping", options.time_report);
+    for (auto &&embed : tunit->get_embeds()) {
+      auto &buffer = embedded[embed->get_path()];
+      if (!buffer) {
+        auto mapped = map_embedded_file(embed->get_path(), options);
+        if (!mapped) {
+          return mapped.takeError();
+        }
+        buffer = std::move(mapped.get());
+      }
+      embed->set_contents(buffer->getBufferStart(), buffer->getBufferSize());
+    }
+  }
+  {
+    PhaseScope phase("TypeCheck", "Type checking", options.time_report);
+    TypeChecker tc;
+    tc.traverse_tunit(tunit);
+  }
+
+  CodeGenOptions cgopts;
+  cgopts.memo_stats = options.memo_stats;
+  cgopts.debug_info = options.debug_info;
+  cgopts.source = source.get();
+  cgopts.optimized = options.opt_level > 0;
+  cgopts.profile_generate = options.profile_generate;
+  if (!options.profile_output.empty()) {
+    cgopts.profile_output = options.profile_output;
+  }
+  ProfileData profile;
+  if (!options.profile_use.empty()) {
+    auto loaded = ProfileData::load(options.profile_use);
+    if (!loaded) {
+      return loaded.takeError();
+    }
+    profile = std::move(loaded.get());
+    cgopts.profile_use = &profile;
+  }
+
+  ctxt = std::make_unique<llvm::LLVMContext>();
+  if (auto err = setup_remarks(tunit)) {
+    return err;
+  }
+  mod = std::make_unique<llvm::Module>(options.input_filename, *ctxt);
+  llvm::IRBuilder<> builder(*ctxt);
+
+  // codegen lays out debug info with the target's DataLayout
+  auto acquired =
+    pool ? pool->acquire(options.opt_level) : create_target_machine(options.opt_level);
+  if (!acquired) {
+    return acquired.takeError();
+  }
+  target_machine = std::move(acquired.get());
+  configure_module(*mod, *target_machine);
+  cgopts.target_machine = target_machine.get();
+
+  {
+    PhaseScope phase("CodeGen", "IR generation", options.time_report);
+    CodeGen codegen(*ctxt, *mod, builder, cgopts);
+    codegen.execute(tunit);
+  }
+  record_function_stats("CodeGen");
+  auto const stats = CompileStats::active();
+  if (stats) {
+    stats->llvm_instructions.emplace_back("CodeGen", mod->getInstructionCount());
+  }
+  {
+    PhaseScope phase("Optimize", "Optimization", options.time_report);
+    optimize_module(*mod, *target_machine, options.opt_level);
+  }
+  record_function_stats("Optimize");
+  if (stats) {
+    stats->llvm_instructions.emplace_back("Optimize", mod->getInstructionCount());
+  }
+
+  iface = ModuleInterface::of(tunit);
+  if (options.lto) {
+    std::vector<std::string> exports;
+    for (auto &&fn : iface.get_functions()) {
+      exports.push_back(fn.name);
+    }
+    record_exports(*mod, exports);
+  }
+  return llvm::Error::success();
+}
+
+llvm::Error
+CompilerInstance::emit_object(llvm::raw_pwrite_stream &dest) {
+  if (!mod) {
+    return make_compile_error("no compiled module to emit");
+  }
+  return run_safely([&] {
+    PhaseScope phase("EmitObject", "Machine code generation", options.time_report);
+    return emit_object_code(*mod, *target_machine, dest);
+  });
+}
+
+llvm::Error
+CompilerInstance::emit_bitcode(llvm::raw_ostream &dest) {
+  if (!mod) {
+    return make_compile_error("no compiled module to emit");
+  }
+  return run_safely([&] {
+    PhaseScope phase("EmitObject", "Bitcode output", options.time_report);
+    llvm::WriteBitcodeToFile(*mod, dest);
+    return llvm::Error::success();
+  });
+}
+
+llvm::Error
+CompilerInstance::emit_llvm_ir(llvm::raw_ostream &dest) {
+  if (!mod) {
+    return make_compile_error("no compiled module to emit");
+  }
+  return run_safely([&] {
+    PhaseScope phase("EmitIR", "IR output", options.time_report);
+    mod->print(dest, nullptr);
+    return llvm::Error::success();
+  });
+}
+
+llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>>
+CompilerInstance::create_jit() {
+  if (!mod) {
+    return make_compile_error("no compiled module to run");
+  }
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit) {
+    return jit.takeError();
+  }
+  auto host = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+    jit.get()->getDataLayout().getGlobalPrefix());
+  if (!host) {
+    return host.takeError();
+  }
+  jit.get()->getMainJITDylib().addGenerator(std::move(host.get()));
+  // the JIT compiles after the instance is gone, with nowhere to report remarks
+  ctxt->setDiagnosticHandler(std::make_unique<llvm::DiagnosticHandler>());
+  ctxt->setRemarkStreamer(nullptr);
+  llvm::orc::ThreadSafeModule tsm(std::move(mod), std::move(ctxt));
+  if (auto err = jit.get()->addIRModule(std::move(tsm))) {
+    return std::move(err);
+  }
+  return std::move(jit.get());
+}
@@ -0,0 +1,293 @@
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/Coroutines.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+#include "driver.hpp"
+
+llvm::Expected<llvm::Target const *>
+lookup_target(std::string const &target_triple) {
+  std::string error_message_buffer;
+  auto const target = llvm::TargetRegistry::lookupTarget(target_triple, error_message_buffer);
+  if (!target) {
+    return llvm::make_error<llvm::StringError>(
+      error_message_buffer, std::make_error_code(std::errc::not_supported));
+  }
+  return target;
+}
+
+llvm::Expected<std::unique_ptr<llvm::raw_fd_ostream>>
+create_raw_fd_stream(llvm::StringRef filename, llvm::sys::fs::OpenFlags flags) {
+  std::error_code ec;
+  auto stream = std::make_unique<llvm::raw_fd_ostream>(filename, ec, flags);
+  if (ec) {
+    return llvm::errorCodeToError(ec);
+  }
+  return stream;
+}
+
+void
+initialize_targets() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllAsmPrinters();
+  });
+}
+
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+create_target_machine(unsigned opt_level) {
+  initialize_targets();
+
+  auto const target_triple = llvm::sys::getDefaultTargetTriple();
+  auto target = lookup_target(target_triple);
+  if (!target) {
+    return target.takeError();
+  }
+
+  llvm::TargetOptions opt;
+  auto RM = llvm::Optional<llvm::Reloc::Model>();
+  auto const cg_level = (opt_level >= 3) ? llvm::CodeGenOpt::Aggressive : llvm::CodeGenOpt::Default;
+  std::unique_ptr<llvm::TargetMachine> target_machine(
+    target.get()->createTargetMachine(target_triple, "generic", "", opt, RM, llvm::None, cg_level));
+  return target_machine;
+}
+
+void
+configure_module(llvm::Module &mod, llvm::TargetMachine const &target_machine) {
+  mod.setTargetTriple(target_machine.getTargetTriple().str());
+  mod.setDataLayout(target_machine.createDataLayout());
+}
+
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+create_target_machine(llvm::Module &mod, unsigned opt_level) {
+  auto target_machine = create_target_machine(opt_level);
+  if (target_machine) {
+    configure_module(mod, *target_machine.get());
+  }
+  return target_machine;
+}
+
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+TargetMachinePool::acquire(unsigned opt_level) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &machines = idle[opt_level];
+    if (!machines.empty()) {
+      auto target_machine = std::move(machines.back());
+      machines.pop_back();
+      return std::move(target_machine);
+    }
+  }
+  return create_target_machine(opt_level);
+}
+
+void
+TargetMachinePool::release(
+  unsigned opt_level, std::unique_ptr<llvm::TargetMachine> target_machine) {
+  std::lock_guard<std::mutex> lock(mutex);
+  idle[opt_level].push_back(std::move(target_machine));
+}
+
+static void
+configure_pass_manager_builder(
+  llvm::PassManagerBuilder &builder, llvm::TargetMachine &target_machine, unsigned opt_level) {
+  builder.OptLevel = opt_level;
+  builder.SizeLevel = 0;
+  builder.Inliner = (opt_level > 1) ? llvm::createFunctionInliningPass(opt_level, 0, false)
+                                    : llvm::createAlwaysInlinerLegacyPass();
+  builder.LoopVectorize = opt_level > 1;
+  builder.SLPVectorize = opt_level > 1;
+  llvm::addCoroutinePassesToExtensionPoints(builder);
+  target_machine.adjustPassManager(builder);
+}
+
+void
+optimize_module(llvm::Module &mod, llvm::TargetMachine &target_machine, unsigned opt_level) {
+  // Async functions must be split into coroutines even at -O0
+  if (opt_level == 0 && !mod.getFunction("llvm.coro.id")) {
+    return;
+  }
+
+  llvm::PassManagerBuilder builder;
+  configure_pass_manager_builder(builder, target_machine, opt_level);
+
+  llvm::legacy::FunctionPassManager fpm(&mod);
+  fpm.add(llvm::createTargetTransformInfoWrapperPass(target_machine.getTargetIRAnalysis()));
+  builder.populateFunctionPassManager(fpm);
+
+  llvm::legacy::PassManager mpm;
+  mpm.add(llvm::createTargetTransformInfoWrapperPass(target_machine.getTargetIRAnalysis()));
+  builder.populateModulePassManager(mpm);
+
+  fpm.doInitialization();
+  for (auto &&fn : mod) {
+    fpm.run(fn);
+  }
+  fpm.doFinalization();
+  mpm.run(mod);
+}
+
+void
+optimize_linked_module(llvm::Module &mod, llvm::TargetMachine &machine, unsigned opt_level) {
+  if (opt_level == 0) {
+    return;
+  }
+
+  llvm::PassManagerBuilder builder;
+  configure_pass_manager_builder(builder, machine, opt_level);
+  llvm::legacy::PassManager mpm;
+  mpm.add(llvm::createTargetTransformInfoWrapperPass(machine.getTargetIRAnalysis()));
+  builder.populateLTOPassManager(mpm);
+  mpm.run(mod);
+}
+
+static char const exports_metadata[] = "kcea.exports";
+
+void
+record_exports(llvm::Module &mod, std::vector<std::string> const &names) {
+  if (names.empty()) {
+    return;
+  }
+  auto &ctxt = mod.getContext();
+  auto const exports = mod.getOrInsertNamedMetadata(exports_metadata);
+  for (auto &&name : names) {
+    exports->addOperand(llvm::MDNode::get(ctxt, llvm::MDString::get(ctxt, name)));
+  }
+}
+
+llvm::Expected<std::unique_ptr<llvm::Module>>
+link_modules(llvm::LLVMContext &ctxt, std::vector<std::string> const &filenames) {
+  auto merged = std::make_unique<llvm::Module>("kccc++.lto", ctxt);
+  llvm::Linker linker(*merged);
+  for (auto &&filename : filenames) {
+    llvm::SMDiagnostic diag;
+    auto mod = llvm::parseIRFile(filename, diag, ctxt);
+    if (!mod) {
+      return llvm::make_error<llvm::StringError>(
+        "cannot read " + filename + ": " + diag.getMessage(),
+        std::make_error_code(std::errc::invalid_argument));
+    }
+    // the linker reports the reason through the context's diagnostic handler
+    if (linker.linkInModule(std::move(mod))) {
+      return llvm::make_error<llvm::StringError>(
+        "cannot link " + filename, std::make_error_code(std::errc::invalid_argument));
+    }
+  }
+
+  // the metadata of all inputs has been concatenated by now
+  std::set<std::string> exported = {"main"};
+  if (auto const exports = merged->getNamedMetadata(exports_metadata)) {
+    for (auto &&node : exports->operands()) {
+      exported.insert(llvm::cast<llvm::MDString>(node->getOperand(0))->getString().str());
+    }
+  }
+  llvm::internalizeModule(
+    *merged, [&](llvm::GlobalValue const &gv) { return exported.count(gv.getName().str()) > 0; });
+  return std::move(merged);
+}
+
+llvm::Error
+emit_object_code(
+  llvm::Module &mod, llvm::TargetMachine &target_machine, llvm::raw_pwrite_stream &dest) {
+  llvm::legacy::PassManager pass;
+  if (target_machine.addPassesToEmitFile(pass, dest, nullptr, llvm::CGFT_ObjectFile)) {
+    return llvm::make_error<llvm::StringError>(
+      "TargetMachine can't emit a file of this type",
+      std::make_error_code(std::errc::not_supported));
+  }
+
+  pass.run(mod);
+  return llvm::Error::success();
+}
+
+llvm::Error
+output_object_code(
+  llvm::Module &mod, llvm::TargetMachine &target_machine, std::string const &filename) {
+  auto dest = create_raw_fd_stream(filename, llvm::sys::fs::OF_None);
+  if (!dest) {
+    return dest.takeError();
+  }
+
+  if (auto err = emit_object_code(mod, target_machine, *(dest.get()))) {
+    return err;
+  }
+  dest.get()->flush();
+
+  return llvm::Error::success();
+}
+
+std::string
+replace_file_extension(std::string const &filename, std::string const &extension) {
+  llvm::SmallString<128> buf = static_cast<llvm::StringRef>(filename);
+  llvm::sys::path::replace_extension(buf, extension);
+  return buf.str();
+}
+
+llvm::Error
+output_bitcode(llvm::Module &mod, std::string const &filename) {
+  auto dest = create_raw_fd_stream(filename, llvm::sys::fs::OF_None);
+  if (!dest) {
+    return dest.takeError();
+  }
+  llvm::WriteBitcodeToFile(mod, *dest.get());
+  return llvm::Error::success();
+}
+
+llvm::Error
+output_llvm_ir(llvm::Module &mod, std::string const &filename) {
+  auto dest = create_raw_fd_stream(filename, llvm::sys::fs::OF_None);
+  if (!dest) {
+    return dest.takeError();
+  }
+  mod.print(*(dest.get()), nullptr);
+
+  return llvm::Error::success();
+}
+
+llvm::Error
+link_relocatable(std::vector<std::string> const &objects, std::string const &output) {
+  auto const ld = llvm::sys::findProgramByName("ld");
+  if (!ld) {
+    return llvm::make_error<llvm::StringError>(
+      "cannot find ld: " + ld.getError().message(), ld.getError());
+  }
+  std::vector<llvm::StringRef> args = {"ld", "-r", "-o", output};
+  args.insert(args.end(), objects.begin(), objects.end());
+  std::string message;
+  if (llvm::sys::ExecuteAndWait(*ld, args, llvm::None, {}, 0, 0, &message) != 0) {
+    return llvm::make_error<llvm::StringError>(
+      "ld -r failed" + (message.empty() ? "" : ": " + message),
+      std::make_error_code(std::errc::io_error));
+  }
+  return llvm::Error::success();
+}
@@ -0,0 +1,292 @@
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Casting.h"
+
+#include "ast.hpp"
+#include "builtin.hpp"
+#include "effect.hpp"
+
+namespace {
+
+// Names bound inside a function body, shadowing top-level DefFns
+enum class Binding {
+  Local,
+  External,
+};
+
+class CallCollector {
+public:
+  CallCollector(std::set<std::string> const &toplevel): defs(toplevel) {
+  }
+  void collect(
+    DefFnAst *def,
+    std::set<std::string> &callees,
+    bool &calls_unknown,
+    bool &reads_memory,
+    bool &has_par,
+    bool &has_while);
+
+  // the callees of the operands of each Par, and whether they call anything unknown
+  std::map<ParExprAst const *, std::pair<std::set<std::string>, bool>> pars;
+
+private:
+  void visit(Ast *ast);
+  void visit_callee(Ast *callee);
+
+  std::set<std::string> const &defs;
+  std::vector<std::map<std::string, Binding>> scopes;
+  std::set<std::string> *out;
+  bool unknown;
+  bool reads;
+  bool par_expr;
+  bool while_loop;
+};
+
+void
+CallCollector::collect(
+  DefFnAst *def,
+  std::set<std::string> &callees,
+  bool &calls_unknown,
+  bool &reads_memory,
+  bool &has_par,
+  bool &has_while) {
+  out = &callees;
+  unknown = false;
+  reads = false;
+  par_expr = false;
+  while_loop = false;
+  scopes.assign(1, {});
+  for (size_t i = 0, len = def->get_arity(); i < len; ++i) {
+    scopes.back()[def->get_nth_name(i)] = Binding::Local;
+  }
+  visit(def->get_body());
+  calls_unknown = unknown;
+  reads_memory = reads;
+  has_par = par_expr;
+  has_while = while_loop;
+}
+
+void
+CallCollector::visit_callee(Ast *callee) {
+  auto const var = llvm::dyn_cast<VarRefExprAst>(callee);
+  if (!var) {
+    visit(callee);
+    unknown = true;
+    return;
+  }
+  auto const name = var->get_name();
+  for (auto iter = scopes.rbegin(); iter != scopes.rend(); ++iter) {
+    if (iter->count(name)) {
+      // a Decl'd external, or a function value held in a parameter or Let
+      unknown = true;
+      return;
+    }
+  }
+  if (defs.count(name)) {
+    out->insert(name);
+  } else if (auto const builtin = lookup_builtin(name)) {
+    unknown = unknown || !is_pure_builtin(*builtin);
+    reads = reads || reads_memory_builtin(*builtin);
+  } else {
+    unknown = true;
+  }
+}
+
+void
+CallCollector::visit(Ast *ast) {
+  using llvm::dyn_cast;
+  if (auto const block = dyn_cast<BlockExprAst>(ast)) {
+    scopes.emplace_back();
+    for_each_child(block, [this](Ast *stmt) { visit(stmt); });
+    scopes.pop_back();
+  } else if (auto const call = dyn_cast<CallExprAst>(ast)) {
+    visit_callee(call->get_callee());
+    for (size_t i = 0, len = call->get_nargs(); i < len; ++i) {
+      visit(call->get_nth_arg(i));
+    }
+  } else if (auto const decl = dyn_cast<DeclStmtAst>(ast)) {
+    scopes.back()[decl->get_var_name()] = Binding::External;
+  } else if (auto const loop = dyn_cast<ForExprAst>(ast)) {
+    visit(loop->get_start());
+    visit(loop->get_end());
+    visit(loop->get_init());
+    scopes.emplace_back();
+    scopes.back()[loop->get_var_name()] = Binding::Local;
+    scopes.back()[loop->get_acc_name()] = Binding::Local;
+    visit(loop->get_body());
+    scopes.pop_back();
+  } else if (auto const let = dyn_cast<LetStmtAst>(ast)) {
+    visit(let->get_init());
+    scopes.back()[let->get_var_name()] = Binding::Local;
+  } else if (auto const par = dyn_cast<ParExprAst>(ast)) {
+    par_expr = true;
+    visit(par->get_body());
+    // the operands once more on their own, to tell whether they may run in parallel
+    auto const outer = out;
+    auto const outer_unknown = unknown;
+    auto &operands = pars[par];
+    out = &operands.first;
+    unknown = false;
+    for (auto &&operand : par->get_operands()) {
+      visit(operand);
+    }
+    operands.second = unknown;
+    out = outer;
+    unknown = outer_unknown;
+  } else if (auto const loop = dyn_cast<WhileExprAst>(ast)) {
+    while_loop = true;
+    visit(loop->get_init());
+    scopes.emplace_back();
+    scopes.back()[loop->get_acc_name()] = Binding::Local;
+    visit(loop->get_cond());
+    visit(loop->get_body());
+    scopes.pop_back();
+  } else {
+    for_each_child(ast, [this](Ast *child) { visit(child); });
+  }
+}
+
+} // namespace
+
+void
+EffectAnalysis::analyze(TranslationUnitAst *tunit) {
+  fns.clear();
+  std::set<std::string> toplevel;
+  for (size_t i = 0, len = tunit->size(); i < len; ++i) {
+    toplevel.insert(llvm::cast<DefFnAst>(tunit->get_nth_func(i))->get_name());
+  }
+
+  CallCollector collector(toplevel);
+  for (size_t i = 0, len = tunit->size(); i < len; ++i) {
+    auto const def = llvm::cast<DefFnAst>(tunit->get_nth_func(i));
+    auto &info = fns[def->get_name()];
+    collector.collect(def, info.callees, info.calls_unknown, info.reads, info.par, info.while_loop);
+    // calling an Async function runs the event loop
+    info.calls_unknown = info.calls_unknown || def->has_modifier(DefFnAst::Async);
+    info.memo = def->has_modifier(DefFnAst::Memo);
+  }
+  pars.clear();
+  for (auto &&kv : collector.pars) {
+    auto &info = pars[kv.first];
+    info.callees = kv.second.first;
+    info.calls_unknown = kv.second.second;
+  }
+
+  // purity is the greatest fixpoint, the reachability of reads, caches and Pars the least ones
+  for (auto &&kv : fns) {
+    kv.second.pure = !kv.second.calls_unknown;
+    kv.second.reads_reachable = kv.second.reads;
+    kv.second.memo_reachable = kv.second.memo;
+    kv.second.par_reachable = kv.second.par;
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &&kv : fns) {
+      auto &info = kv.second;
+      for (auto &&callee : info.callees) {
+        auto const &target = fns[callee];
+        if (info.pure && !target.pure) {
+          info.pure = false;
+          changed = true;
+        }
+        if (!info.reads_reachable && target.reads_reachable) {
+          info.reads_reachable = true;
+          changed = true;
+        }
+        if (!info.memo_reachable && target.memo_reachable) {
+          info.memo_reachable = true;
+          changed = true;
+        }
+        if (!info.par_reachable && target.par_reachable) {
+          info.par_reachable = true;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  std::map<std::string, std::set<std::string>> reach;
+  for (auto &&kv : fns) {
+    auto &seen = reach[kv.first];
+    std::vector<std::string> work(kv.second.callees.begin(), kv.second.callees.end());
+    while (!work.empty()) {
+      auto const name = work.back();
+      work.pop_back();
+      if (!seen.insert(name).second) {
+        continue;
+      }
+      for (auto &&callee : fns[name].callees) {
+        work.push_back(callee);
+      }
+    }
+  }
+  for (auto &&kv : fns) {
+    auto const &seen = reach[kv.first];
+    bool diverges = kv.second.while_loop || seen.count(kv.first) > 0;
+    for (auto &&name : seen) {
+      diverges = diverges || fns[name].while_loop || reach[name].count(name) > 0;
+    }
+    kv.second.diverges = diverges;
+  }
+}
+
+bool
+EffectAnalysis::is_pure(std::string const &fn) const {
+  auto const iter = fns.find(fn);
+  return iter != fns.end() && iter->second.pure;
+}
+
+bool
+EffectAnalysis::reads_memory(std::string const &fn) const {
+  auto const iter = fns.find(fn);
+  return iter == fns.end() || iter->second.reads_reachable;
+}
+
+bool
+EffectAnalysis::touches_memo_cache(std::string const &fn) const {
+  auto const iter = fns.find(fn);
+  return iter == fns.end() || iter->second.memo_reachable;
+}
+
+bool
+EffectAnalysis::spawns_tasks(std::string const &fn) const {
+  auto const iter = fns.find(fn);
+  return iter == fns.end() || iter->second.par_reachable;
+}
+
+bool
+EffectAnalysis::may_diverge(std::string const &fn) const {
+  auto const iter = fns.find(fn);
+  return iter == fns.end() || iter->second.diverges;
+}
+
+bool
+EffectAnalysis::is_pure(ParExprAst const *par) const {
+  auto const iter = pars.find(par);
+  if (iter == pars.end() || iter->second.calls_unknown) {
+    return false;
+  }
+  for (auto &&callee : iter->second.callees) {
+    if (!is_pure(callee)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+EffectAnalysis::touches_memo_cache(ParExprAst const *par) const {
+  auto const iter = pars.find(par);
+  if (iter == pars.end()) {
+    return true;
+  }
+  for (auto &&callee : iter->second.callees) {
+    if (touches_memo_cache(callee)) {
+      return true;
+    }
+  }
+  return false;
+}
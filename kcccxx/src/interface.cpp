@@ -0,0 +1,329 @@
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ast.hpp"
+#include "driver.hpp"
+#include "interface.hpp"
+#include "type.hpp"
+
+static char const interface_magic[4] = {'K', 'C', 'I', '1'};
+
+// codes of the type table; independent of Type::TK so that its order can change
+enum class TypeCode : uint32_t {
+  Bool = 1,
+  Function,
+  IntN,
+  U8,
+  Unit,
+  Slice,
+  Vec,
+};
+
+static void
+append_word(std::string &buf, uint32_t word) {
+  char bytes[sizeof(word)];
+  llvm::support::endian::write32le(bytes, word);
+  buf.append(bytes, sizeof(bytes));
+}
+
+namespace {
+
+class TypeTable {
+public:
+  uint32_t intern(Type *ty);
+
+  uint32_t ntypes = 0;
+  uint32_t nparams = 0;
+  std::string types;
+  std::string params;
+
+private:
+  // structural key -> index
+  std::map<std::string, uint32_t> ids;
+};
+
+} // namespace
+
+uint32_t
+TypeTable::intern(Type *ty) {
+  using llvm::dyn_cast;
+  TypeCode code;
+  uint32_t a = 0;
+  uint32_t b = 0;
+  uint32_t c = 0;
+  std::vector<uint32_t> paramids;
+  if (auto const intty = dyn_cast<IntNType>(ty)) {
+    code = TypeCode::IntN;
+    a = intty->get_width();
+    b = intty->is_signed();
+  } else if (auto const slicety = dyn_cast<SliceType>(ty)) {
+    code = TypeCode::Slice;
+    a = intern(slicety->get_elem_type());
+  } else if (auto const vecty = dyn_cast<VecType>(ty)) {
+    code = TypeCode::Vec;
+    a = vecty->get_lanes();
+    b = intern(vecty->get_elem_type());
+  } else if (auto const fnty = dyn_cast<FunctionType>(ty)) {
+    code = TypeCode::Function;
+    a = intern(fnty->get_return_type());
+    for (size_t i = 0, arity = fnty->get_arity(); i < arity; ++i) {
+      paramids.push_back(intern(fnty->get_nth_param(i)));
+    }
+    c = paramids.size();
+  } else if (llvm::isa<BoolType>(ty)) {
+    code = TypeCode::Bool;
+  } else if (llvm::isa<U8Type>(ty)) {
+    code = TypeCode::U8;
+  } else if (llvm::isa<UnitType>(ty)) {
+    code = TypeCode::Unit;
+  } else {
+    llvm_unreachable("type cannot be exported");
+  }
+
+  std::string key;
+  llvm::raw_string_ostream os(key);
+  os << static_cast<uint32_t>(code) << ':' << a << ':' << b;
+  for (auto &&id : paramids) {
+    os << ':' << id;
+  }
+  auto const found = ids.find(os.str());
+  if (found != ids.end()) {
+    return found->second;
+  }
+
+  if (code == TypeCode::Function) {
+    b = nparams;
+    for (auto &&id : paramids) {
+      append_word(params, id);
+    }
+    nparams += paramids.size();
+  }
+  append_word(types, static_cast<uint32_t>(code));
+  append_word(types, a);
+  append_word(types, b);
+  append_word(types, c);
+  ids.emplace(key, ntypes);
+  return ntypes++;
+}
+
+ModuleInterface
+ModuleInterface::of(TranslationUnitAst *tunit) {
+  ModuleInterface iface;
+  for (size_t i = 0, len = tunit->size(); i < len; ++i) {
+    auto const def = llvm::cast<DefFnAst>(tunit->get_nth_func(i));
+    if (!def->has_modifier(DefFnAst::Export)) {
+      continue;
+    }
+    std::vector<Type *> params;
+    for (size_t j = 0, arity = def->get_arity(); j < arity; ++j) {
+      params.push_back(def->get_nth_type(j));
+    }
+    iface.functions.push_back({def->get_name(), new FunctionType(def->get_return_type(), params)});
+  }
+  return iface;
+}
+
+ModuleInterface
+ModuleInterface::runtime() {
+  auto const i32 = new IntNType(32);
+  auto const bytes = new SliceType(new U8Type);
+  ModuleInterface iface;
+  iface.functions = {
+    {"kcrt_write", new FunctionType(i32, {bytes})},
+    {"kcrt_write_static", new FunctionType(i32, {bytes})},
+    {"kcrt_write_byte", new FunctionType(i32, {new U8Type})},
+    {"kcrt_write_i64", new FunctionType(i32, {new IntNType(64)})},
+    {"kcrt_write_u64", new FunctionType(i32, {new IntNType(64, false)})},
+    {"kcrt_flush", new FunctionType(i32, {})},
+  };
+  return iface;
+}
+
+llvm::Error
+ModuleInterface::write(std::string const &filename) const {
+  TypeTable table;
+  std::string funcs;
+  std::string strtab;
+  for (auto &&fn : functions) {
+    append_word(funcs, strtab.size());
+    append_word(funcs, fn.name.size());
+    append_word(funcs, table.intern(fn.type));
+    strtab += fn.name;
+  }
+
+  auto dest = create_raw_fd_stream(filename, llvm::sys::fs::OF_None);
+  if (!dest) {
+    return dest.takeError();
+  }
+  std::string header(interface_magic, sizeof(interface_magic));
+  append_word(header, table.ntypes);
+  append_word(header, table.nparams);
+  append_word(header, functions.size());
+  append_word(header, strtab.size());
+  *dest.get() << header << table.types << table.params << funcs << strtab;
+  return llvm::Error::success();
+}
+
+namespace {
+
+// Reads the words of an interface file in order, failing once one is out of bounds.
+class WordReader {
+public:
+  explicit WordReader(llvm::StringRef data): buf(data) {
+  }
+  bool read(uint32_t &word) {
+    if (buf.size() - pos < sizeof(word)) {
+      return false;
+    }
+    word = llvm::support::endian::read32le(buf.data() + pos);
+    pos += sizeof(word);
+    return true;
+  }
+  bool skip(size_t n) {
+    if (buf.size() - pos < n) {
+      return false;
+    }
+    pos += n;
+    return true;
+  }
+  size_t position() const {
+    return pos;
+  }
+
+private:
+  llvm::StringRef buf;
+  size_t pos = 0;
+};
+
+} // namespace
+
+static llvm::Error
+malformed(std::string const &filename) {
+  return llvm::make_error<llvm::StringError>(
+    "malformed interface " + filename, std::make_error_code(std::errc::invalid_argument));
+}
+
+llvm::Expected<ModuleInterface>
+ModuleInterface::load(std::string const &filename) {
+  // large files are mapped rather than read
+  auto buf = llvm::MemoryBuffer::getFile(filename, -1, false /* no null terminator */);
+  if (!buf) {
+    return llvm::make_error<llvm::StringError>(
+      "cannot open interface " + filename + ": " + buf.getError().message(), buf.getError());
+  }
+  auto const data = buf.get()->getBuffer();
+  if (!data.startswith(llvm::StringRef(interface_magic, sizeof(interface_magic)))) {
+    return malformed(filename);
+  }
+
+  WordReader reader(data);
+  reader.skip(sizeof(interface_magic));
+  uint32_t ntypes, nparams, nfuncs, strtab_size;
+  auto const counts = reader.read(ntypes) && reader.read(nparams) && reader.read(nfuncs);
+  if (!counts || !reader.read(strtab_size)) {
+    return malformed(filename);
+  }
+
+  struct Record {
+    uint32_t code, a, b, c;
+  };
+  std::vector<Record> records(ntypes);
+  for (auto &&r : records) {
+    if (!reader.read(r.code) || !reader.read(r.a) || !reader.read(r.b) || !reader.read(r.c)) {
+      return malformed(filename);
+    }
+  }
+  std::vector<uint32_t> params(nparams);
+  for (auto &&p : params) {
+    if (!reader.read(p)) {
+      return malformed(filename);
+    }
+  }
+
+  // one Type per record, so equal signatures share their FunctionType
+  std::vector<Type *> types;
+  for (auto &&r : records) {
+    auto const index = types.size();
+    Type *ty = nullptr;
+    switch (static_cast<TypeCode>(r.code)) {
+      case TypeCode::Bool:
+        ty = new BoolType;
+        break;
+      case TypeCode::U8:
+        ty = new U8Type;
+        break;
+      case TypeCode::Unit:
+        ty = new UnitType;
+        break;
+      case TypeCode::IntN:
+        if (r.a == 8 || r.a == 16 || r.a == 32 || r.a == 64) {
+          ty = new IntNType(r.a, r.b != 0);
+        }
+        break;
+      case TypeCode::Slice:
+        if (r.a < index) {
+          ty = new SliceType(types[r.a]);
+        }
+        break;
+      case TypeCode::Vec:
+        if (VecType::valid_lanes(r.a) && r.b < index) {
+          ty = new VecType(r.a, types[r.b]);
+        }
+        break;
+      case TypeCode::Function: {
+        if (r.a >= index || r.b > nparams || nparams - r.b < r.c) {
+          break;
+        }
+        std::vector<Type *> paramtys;
+        for (uint32_t i = 0; i < r.c; ++i) {
+          auto const p = params[r.b + i];
+          if (p >= index) {
+            return malformed(filename);
+          }
+          paramtys.push_back(types[p]);
+        }
+        ty = new FunctionType(types[r.a], paramtys);
+        break;
+      }
+    }
+    if (!ty) {
+      return malformed(filename);
+    }
+    types.push_back(ty);
+  }
+
+  std::vector<uint32_t> funcs(nfuncs * 3);
+  for (auto &&word : funcs) {
+    if (!reader.read(word)) {
+      return malformed(filename);
+    }
+  }
+  auto const strtab = data.substr(reader.position());
+  if (strtab.size() != strtab_size) {
+    return malformed(filename);
+  }
+
+  ModuleInterface iface;
+  for (uint32_t i = 0; i < nfuncs; ++i) {
+    auto const offset = funcs[3 * i];
+    auto const length = funcs[3 * i + 1];
+    auto const type_index = funcs[3 * i + 2];
+    auto const in_strtab = offset <= strtab_size && strtab_size - offset >= length;
+    if (!in_strtab || type_index >= ntypes || !llvm::isa<FunctionType>(types[type_index])) {
+      return malformed(filename);
+    }
+    iface.functions.push_back(
+      {strtab.substr(offset, length).str(), llvm::cast<FunctionType>(types[type_index])});
+  }
+  return iface;
+}
@@ -1,24 +1,34 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <numeric>
+#include <thread>
 #include <vector>
 
-#include "llvm/IR/IRBuilder.h"
-#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassTimingInfo.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
-#include "llvm/Support/TargetRegistry.h"
-#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
-#include "llvm/Target/TargetOptions.h"
 
 #include "ast.hpp"
-#include "codegen.hpp"
+#include "compiler.hpp"
+#include "driver.hpp"
 #include "lexer.hpp"
-#include "parser.hpp"
-#include "typechecker.hpp"
+#include "server.hpp"
+#include "stats.hpp"
 
 void
 show_help(std::string const &exec) {
@@ -48,144 +58,505 @@ show_tokens(std::vector<Token> const &tokens) {
   }
 }
 
-llvm::Expected<llvm::Target const *>
-lookup_target(std::string const &target_triple) {
-  std::string error_message_buffer;
-  auto const target = llvm::TargetRegistry::lookupTarget(target_triple, error_message_buffer);
-  if (!target) {
-    return llvm::make_error<llvm::StringError>(
-      error_message_buffer, std::make_error_code(std::errc::not_supported));
-  }
-  return target;
-}
+static llvm::cl::OptionCategory kcccxx_category("kccc++");
 
-llvm::Expected<std::unique_ptr<llvm::raw_fd_ostream>>
-create_raw_fd_stream(llvm::StringRef filename, llvm::sys::fs::OpenFlags flags) {
-  std::error_code ec;
-  auto stream = std::make_unique<llvm::raw_fd_ostream>(filename, ec, flags);
-  if (ec) {
-    return llvm::errorCodeToError(ec);
-  }
-  return stream;
-}
+static llvm::cl::list<std::string> input_filenames(
+  llvm::cl::Positional,
+  llvm::cl::desc("<input files>"),
+  llvm::cl::ZeroOrMore,
+  llvm::cl::cat(kcccxx_category));
 
-llvm::Error
-output_object_code(llvm::Module &mod, std::string const &filename) {
-  llvm::InitializeAllTargetInfos();
-  llvm::InitializeAllTargets();
-  llvm::InitializeAllTargetMCs();
-  llvm::InitializeAllAsmParsers();
-  llvm::InitializeAllAsmPrinters();
+static llvm::cl::opt<std::string> output_filename(
+  "o",
+  llvm::cl::desc("output filename"),
+  llvm::cl::value_desc("filename"),
+  llvm::cl::ValueRequired,
+  llvm::cl::init(""),
+  llvm::cl::cat(kcccxx_category));
 
-  auto const target_triple = llvm::sys::getDefaultTargetTriple();
-  mod.setTargetTriple(target_triple);
+static llvm::cl::opt<bool>
+  opt_emit_llvm("emit-llvm", llvm::cl::desc("emit LLVM IR"), llvm::cl::cat(kcccxx_category));
 
-  auto target = lookup_target(target_triple);
-  if (!target) {
-    return target.takeError();
-  }
+static llvm::cl::opt<bool> opt_assemble("S", llvm::cl::desc(""), llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<unsigned> opt_level(
+  "O",
+  llvm::cl::desc("optimization level"),
+  llvm::cl::value_desc("level"),
+  llvm::cl::Prefix,
+  llvm::cl::init(0),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<std::string> opt_profile_generate(
+  "fprofile-generate",
+  llvm::cl::desc("instrument the program to append execution counts to <file> at exit"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::ValueOptional,
+  llvm::cl::init(""),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_memo_stats(
+  "fmemo-stats",
+  llvm::cl::desc("report Memo cache hit rates on stderr at exit"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<std::string> opt_profile_use(
+  "fprofile-use",
+  llvm::cl::desc("use execution counts in <file> for branch weights and entry counts"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::init(""),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_debug_info(
+  "g", llvm::cl::desc("generate DWARF debug information"), llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_time_report(
+  "ftime-report",
+  llvm::cl::desc("print the time spent in each compilation phase and LLVM pass"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<std::string> opt_time_trace(
+  "ftime-trace",
+  llvm::cl::desc("write a Chrome trace-event profile of the compilation to <file>"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::init(""),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<unsigned> opt_time_trace_granularity(
+  "ftime-trace-granularity",
+  llvm::cl::desc("minimum duration in microseconds of a -ftime-trace span"),
+  llvm::cl::value_desc("us"),
+  llvm::cl::init(500),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<std::string> opt_mem_report(
+  "fmem-report",
+  llvm::cl::desc("print object counts and peak memory per phase on stderr, as text or json"),
+  llvm::cl::value_desc("format"),
+  llvm::cl::ValueOptional,
+  llvm::cl::init(""),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<std::string> opt_remarks_passed(
+  "Rpass",
+  llvm::cl::desc("report optimizations done by the passes matching the regex"),
+  llvm::cl::value_desc("regex"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<std::string> opt_remarks_missed(
+  "Rpass-missed",
+  llvm::cl::desc("report optimizations missed by the passes matching the regex"),
+  llvm::cl::value_desc("regex"),
+  llvm::cl::cat(kcccxx_category));
 
-  llvm::TargetOptions opt;
-  auto RM = llvm::Optional<llvm::Reloc::Model>();
-  auto target_machine = target.get()->createTargetMachine(target_triple, "generic", "", opt, RM);
+static llvm::cl::opt<std::string> opt_remarks_analysis(
+  "Rpass-analysis",
+  llvm::cl::desc("report the analyses behind the decisions of the passes matching the regex"),
+  llvm::cl::value_desc("regex"),
+  llvm::cl::cat(kcccxx_category));
 
-  mod.setDataLayout(target_machine->createDataLayout());
+static llvm::cl::opt<bool> opt_save_remarks(
+  "fsave-optimization-record",
+  llvm::cl::desc("write every optimization remark to <input>.opt.yaml next to the output"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_function_stats(
+  "ffunction-stats",
+  llvm::cl::desc("print per-function IR sizes and stack estimates after codegen and optimization"),
+  llvm::cl::cat(kcccxx_category));
 
-  auto dest = create_raw_fd_stream(filename, llvm::sys::fs::OF_None);
-  if (!dest) {
-    return dest.takeError();
+static llvm::cl::list<std::string> import_paths(
+  "I",
+  llvm::cl::desc("add <dir> to the directories searched for the interfaces of Import"),
+  llvm::cl::value_desc("dir"),
+  llvm::cl::Prefix,
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<unsigned> opt_jobs(
+  "j",
+  llvm::cl::desc("number of inputs compiled at once (default: one per CPU)"),
+  llvm::cl::value_desc("jobs"),
+  llvm::cl::Prefix,
+  llvm::cl::init(0),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_relocatable(
+  "r",
+  llvm::cl::desc("link the objects of all inputs into one relocatable object"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_file_times(
+  "file-times",
+  llvm::cl::desc("print the wall time spent on each input on stderr"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_lto(
+  "flto",
+  llvm::cl::desc("write LLVM bitcode for --lto-link instead of machine code"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_lto_link(
+  "lto-link",
+  llvm::cl::desc("link -flto inputs into one module, optimize it as a whole and emit one object"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_server(
+  "server",
+  llvm::cl::desc("serve compile requests from --client processes on a Unix socket"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<unsigned> opt_server_threads(
+  "server-threads",
+  llvm::cl::desc("number of requests a --server compiles at once (default: one per CPU)"),
+  llvm::cl::init(0),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<bool> opt_client(
+  "client",
+  llvm::cl::desc("compile on a running --server, or in this process if there is none"),
+  llvm::cl::cat(kcccxx_category));
+
+static llvm::cl::opt<std::string> opt_socket(
+  "socket",
+  llvm::cl::desc("socket of --server and --client"),
+  llvm::cl::value_desc("path"),
+  llvm::cl::init(""),
+  llvm::cl::cat(kcccxx_category));
+
+static int
+compile(CompileOptions const &opts, llvm::raw_ostream &diag, TargetMachinePool *pool) {
+  CompilerInstance ci(opts, pool, &diag);
+  if (auto err = ci.compile_file()) {
+    llvm::logAllUnhandledErrors(std::move(err), diag, "[kccc++] ");
+    return 1;
+  }
+  if (opts.function_stats) {
+    print_function_stats(diag, opts.input_filename, ci.get_function_stats());
   }
 
-  llvm::legacy::PassManager pass;
-  if (target_machine->addPassesToEmitFile(pass, *(dest.get()), nullptr, llvm::CGFT_ObjectFile)) {
-    return llvm::make_error<llvm::StringError>(
-      "TargetMachine can't emit a file of this type",
-      std::make_error_code(std::errc::not_supported));
+  // output LLVM IR
+  if (opts.emit_llvm) {
+    auto const outpath = (opts.output_filename.length() > 0)
+      ? opts.output_filename
+      : replace_file_extension(opts.input_filename, ".ll");
+    auto dest = create_raw_fd_stream(outpath, llvm::sys::fs::OF_None);
+    auto err = dest ? ci.emit_llvm_ir(*dest.get()) : dest.takeError();
+    if (err) {
+      llvm::logAllUnhandledErrors(std::move(err), diag, "[kccc++] ");
+      return 1;
+    }
+    return 0;
   }
 
-  pass.run(mod);
-  dest.get()->flush();
+  // output object file
+  auto const outpath =
+    (opts.output_filename.length() > 0) ? opts.output_filename : std::string("kc.o");
+  auto dest = create_raw_fd_stream(outpath, llvm::sys::fs::OF_None);
+  auto err = !dest ? dest.takeError()
+    : opts.lto     ? ci.emit_bitcode(*dest.get())
+                   : ci.emit_object(*dest.get());
+  if (err) {
+    llvm::logAllUnhandledErrors(std::move(err), diag, "[kccc++] ");
+    return 1;
+  }
+  auto const &iface = ci.get_interface();
+  if (!opts.interface_filename.empty() && !iface.empty()) {
+    if (auto err = iface.write(opts.interface_filename)) {
+      llvm::logAllUnhandledErrors(std::move(err), diag, "[kccc++] ");
+      return 1;
+    }
+  }
 
-  return llvm::Error::success();
+  return 0;
 }
 
-std::string
-replace_file_extension(std::string const &filename, std::string const &extension) {
-  llvm::SmallString<128> buf = static_cast<llvm::StringRef>(filename);
-  llvm::sys::path::replace_extension(buf, extension);
-  return buf.str();
+// A --client hands the request to a server running in another directory, so paths the compiler
+// itself opens are resolved against this process's one first. The profile output path is only
+// embedded in the program and stays as given.
+static std::string
+absolute_path(std::string const &path) {
+  if (path.empty()) {
+    return path;
+  }
+  llvm::SmallString<128> buf(path);
+  llvm::sys::fs::make_absolute(buf);
+  return buf.str().str();
 }
 
-static llvm::cl::OptionCategory kcccxx_category("kccc++");
+// output is the object to write for input. With several inputs each gets an object or IR file
+// next to it unless -r collects them.
+static CompileOptions
+options_from_command_line(std::string const &input, std::string const &output) {
+  CompileOptions opts;
+  opts.input_filename = input;
+  opts.output_filename = output;
+  opts.opt_level = opt_level;
+  opts.emit_llvm = opt_emit_llvm && opt_assemble;
+  opts.debug_info = opt_debug_info;
+  opts.memo_stats = opt_memo_stats;
+  opts.profile_generate = opt_profile_generate.getNumOccurrences() > 0;
+  opts.profile_output = opt_profile_generate;
+  opts.profile_use = opt_profile_use;
+  opts.import_paths = import_paths;
+  opts.lto = opt_lto;
+  opts.time_report = opt_time_report;
+  opts.remarks_passed = opt_remarks_passed;
+  opts.remarks_missed = opt_remarks_missed;
+  opts.remarks_analysis = opt_remarks_analysis;
+  opts.function_stats = opt_function_stats;
+  // named after the module, next to the object or IR the user asked for
+  auto const beside_output = [&](llvm::StringRef extension) {
+    auto target = opt_relocatable ? output_filename.getValue() : output;
+    if (target.empty()) {
+      target = opts.emit_llvm ? replace_file_extension(input, ".ll") : std::string("kc.o");
+    }
+    llvm::SmallString<128> path(llvm::sys::path::parent_path(target));
+    llvm::sys::path::append(path, llvm::sys::path::stem(input) + extension);
+    return path.str().str();
+  };
+  if (!opts.emit_llvm) {
+    opts.interface_filename = beside_output(".kci");
+  }
+  if (opt_save_remarks) {
+    opts.remarks_record = beside_output(".opt.yaml");
+  }
+  if (opt_client) {
+    opts.input_filename = absolute_path(opts.input_filename);
+    opts.output_filename = absolute_path(
+      opts.output_filename.empty() && !opts.emit_llvm ? std::string("kc.o") : opts.output_filename);
+    opts.profile_use = absolute_path(opts.profile_use);
+    opts.interface_filename = absolute_path(opts.interface_filename);
+    opts.remarks_record = absolute_path(opts.remarks_record);
+    for (auto &&dir : opts.import_paths) {
+      dir = absolute_path(dir);
+    }
+  }
+  return opts;
+}
 
-static llvm::cl::opt<std::string> input_filename(
-  llvm::cl::Positional,
-  llvm::cl::desc("<input file>"),
-  llvm::cl::Required,
-  llvm::cl::cat(kcccxx_category));
+struct BatchResult {
+  int status = 0;
+  std::string diag;
+  double milliseconds = 0;
+};
+
+// Compiles every input of the batch on up to jobs threads, each with its own LLVMContext, and
+// reports diagnostics in input order. Returns the worst exit status.
+static int
+compile_batch(std::vector<CompileOptions> const &batch, unsigned jobs, std::string const *socket) {
+  // the largest inputs go first so that a big file picked up last does not leave the other
+  // threads idle at the end
+  std::vector<uint64_t> sizes(batch.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    llvm::sys::fs::file_size(batch[i].input_filename, sizes[i]);
+  }
+  std::vector<size_t> order(batch.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(
+    order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+  initialize_targets();
+  TargetMachinePool pool;
+  std::vector<BatchResult> results(batch.size());
+  std::atomic<size_t> next(0);
+  auto const work = [&] {
+    for (size_t i; (i = next++) < order.size();) {
+      auto const &opts = batch[order[i]];
+      auto &result = results[order[i]];
+      llvm::raw_string_ostream diag(result.diag);
+      auto const start = std::chrono::steady_clock::now();
+      auto status = socket ? run_client(*socket, opts, diag) : llvm::None;
+      result.status = status ? *status : compile(opts, diag, &pool);
+      diag.flush();
+      result.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+  };
 
-static llvm::cl::opt<std::string> output_filename(
-  "o",
-  llvm::cl::desc("output filename"),
-  llvm::cl::value_desc("filename"),
-  llvm::cl::ValueRequired,
-  llvm::cl::init(""),
-  llvm::cl::cat(kcccxx_category));
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  jobs = std::min<size_t>(jobs, batch.size());
+  auto const start = std::chrono::steady_clock::now();
+  {
+    // the calling thread is one of the workers, so -j1 compiles in it and per-process reports
+    // see the whole batch
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; ++i) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (auto &&thread : threads) {
+      thread.join();
+    }
+  }
+  auto const elapsed =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-static llvm::cl::opt<bool>
-  opt_emit_llvm("emit-llvm", llvm::cl::desc("emit LLVM IR"), llvm::cl::cat(kcccxx_category));
+  auto status = 0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    llvm::errs() << results[i].diag;
+    status = std::max(status, results[i].status);
+  }
+  if (opt_file_times) {
+    for (size_t i = 0; i < batch.size(); ++i) {
+      llvm::errs() << llvm::format("%10.3f ms  ", results[i].milliseconds)
+                   << batch[i].input_filename << "\n";
+    }
+    llvm::errs() << llvm::format("%10.3f ms  ", elapsed) << "total (" << batch.size() << " files, "
+                 << jobs << " jobs)\n";
+  }
+  return status;
+}
 
-static llvm::cl::opt<bool> opt_assemble("S", llvm::cl::desc(""), llvm::cl::cat(kcccxx_category));
+// --lto-link: the inputs are -flto outputs rather than sources
+static int
+lto_link() {
+  llvm::LLVMContext ctxt;
+  std::unique_ptr<llvm::Module> mod;
+  {
+    PhaseScope phase("Link", "Module linking", opt_time_report);
+    auto linked = link_modules(ctxt, input_filenames);
+    if (!linked) {
+      llvm::logAllUnhandledErrors(linked.takeError(), llvm::errs(), "[kccc++] ");
+      return 1;
+    }
+    mod = std::move(linked.get());
+  }
 
-llvm::Error
-output_llvm_ir(llvm::Module &mod, std::string const &filename) {
-  auto dest = create_raw_fd_stream(filename, llvm::sys::fs::OF_None);
-  if (!dest) {
-    return dest.takeError();
+  auto target_machine = create_target_machine(*mod, opt_level);
+  if (!target_machine) {
+    llvm::logAllUnhandledErrors(target_machine.takeError(), llvm::errs(), "[kccc++] ");
+    return 1;
+  }
+  {
+    PhaseScope phase("Optimize", "Optimization", opt_time_report);
+    optimize_linked_module(*mod, *target_machine.get(), opt_level);
   }
-  mod.print(*(dest.get()), nullptr);
 
-  return llvm::Error::success();
+  auto const emit_llvm = opt_emit_llvm && opt_assemble;
+  auto const outpath = !output_filename.empty() ? output_filename.getValue()
+    : emit_llvm                                 ? std::string("kc.ll")
+                                                : std::string("kc.o");
+  PhaseScope phase(emit_llvm ? "EmitIR" : "EmitObject", "Output", opt_time_report);
+  auto err = emit_llvm ? output_llvm_ir(*mod, outpath)
+                       : output_object_code(*mod, *target_machine.get(), outpath);
+  if (err) {
+    llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "[kccc++] ");
+    return 1;
+  }
+  return 0;
 }
 
 int
 main(int argc, char **argv) {
   llvm::cl::ParseCommandLineOptions(argc, argv);
 
-  auto const tokens = LexicalAnalysis(input_filename);
-  Parser parser(tokens);
-  auto const tunit = parser.parse_top_level_decl();
+  auto const socket_path = opt_socket.empty() ? default_socket_path() : opt_socket.getValue();
+  if (opt_server) {
+    TargetMachinePool pool;
+    return run_server(socket_path, opt_server_threads, [&](auto &&opts, auto &&diag) {
+      return compile(opts, diag, &pool);
+    });
+  }
+  if (input_filenames.empty()) {
+    llvm::errs() << "[kccc++] no input file\n";
+    return 1;
+  }
+  auto const emit_llvm = opt_emit_llvm && opt_assemble;
+  if (opt_relocatable && (emit_llvm || opt_lto)) {
+    llvm::errs() << "[kccc++] -r needs machine code; use --lto-link for -flto outputs\n";
+    return 1;
+  }
+  if (input_filenames.size() > 1 && !output_filename.empty() && !opt_relocatable && !opt_lto_link) {
+    llvm::errs() << "[kccc++] -o with several inputs requires -r\n";
+    return 1;
+  }
 
-  TypeChecker tc;
-  tc.traverse_tunit(tunit);
+  // with -r each input is compiled to a temporary object first
+  std::vector<std::string> objects;
+  auto const remove_objects = llvm::make_scope_exit([&] {
+    for (auto &&object : objects) {
+      llvm::sys::fs::remove(object);
+    }
+  });
+  std::vector<CompileOptions> batch;
+  // --lto-link reads its inputs itself
+  if (!opt_lto_link) {
+    for (auto &&input : input_filenames) {
+      std::string output = output_filename;
+      if (opt_relocatable) {
+        llvm::SmallString<128> path;
+        auto const ec = llvm::sys::fs::createTemporaryFile(llvm::sys::path::stem(input), "o", path);
+        if (ec) {
+          llvm::errs() << "[kccc++] cannot create a temporary object: " << ec.message() << "\n";
+          return 1;
+        }
+        output = path.str().str();
+        objects.push_back(output);
+      } else if (input_filenames.size() > 1) {
+        output = replace_file_extension(input, emit_llvm ? ".ll" : ".o");
+      }
+      batch.push_back(options_from_command_line(input, output));
+    }
+  }
 
-  llvm::LLVMContext ctxt;
-  llvm::Module mod(input_filename, ctxt);
-  llvm::IRBuilder<> builder(ctxt);
+  // the reports below describe this process, so they need the compilation to happen here, and
+  // their timers and counters are not shared between threads
+  auto const in_process_only =
+    opt_time_report || !opt_time_trace.empty() || opt_mem_report.getNumOccurrences() > 0;
+  auto const client = opt_client && !in_process_only;
 
-  CodeGen codegen(ctxt, mod, builder);
-  codegen.execute(tunit);
+  if (!opt_time_trace.empty()) {
+    llvm::timeTraceProfilerInitialize(opt_time_trace_granularity, argv[0]);
+  }
+  // the legacy pass managers time each pass into their own group
+  llvm::TimePassesIsEnabled = opt_time_report;
 
-  // output LLVM IR
-  if (opt_emit_llvm && opt_assemble) {
-    auto const outpath = (output_filename.length() > 0)
-      ? output_filename
-      : replace_file_extension(input_filename, ".ll");
+  auto const mem_report = opt_mem_report.getNumOccurrences() > 0;
+  if (mem_report && opt_mem_report != "" && opt_mem_report != "text" && opt_mem_report != "json") {
+    llvm::errs() << "[kccc++] unknown -fmem-report format " << opt_mem_report << "\n";
+    return 1;
+  }
+  CompileStats stats;
+  if (mem_report) {
+    CompileStats::set_active(&stats);
+    llvm::EnableStatistics(false /* reported below instead of at exit */);
+  }
 
-    if (auto err = output_llvm_ir(mod, outpath)) {
+  auto status = opt_lto_link
+    ? lto_link()
+    : compile_batch(batch, in_process_only ? 1 : opt_jobs, client ? &socket_path : nullptr);
+  if (status == 0 && opt_relocatable) {
+    auto const output = output_filename.empty() ? std::string("kc.o") : output_filename;
+    if (auto err = link_relocatable(objects, output)) {
       llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "[kccc++] ");
-      return 1;
+      status = 1;
+    }
+  }
+
+  if (mem_report) {
+    CompileStats::set_active(nullptr);
+    if (opt_mem_report == "json") {
+      stats.print_json(llvm::errs());
     } else {
-      return 0;
+      stats.print(llvm::errs());
     }
   }
 
-  // output object file
-  auto const outpath = (output_filename.length() > 0) ? output_filename : std::string("kc.o");
-  if (auto err = output_object_code(mod, outpath)) {
-    llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "[kccc++] ");
-    return 1;
+  if (llvm::timeTraceProfilerEnabled()) {
+    auto dest = create_raw_fd_stream(opt_time_trace, llvm::sys::fs::OF_Text);
+    if (!dest) {
+      llvm::logAllUnhandledErrors(dest.takeError(), llvm::errs(), "[kccc++] ");
+      return 1;
+    }
+    llvm::timeTraceProfilerWrite(*dest.get());
+    llvm::timeTraceProfilerCleanup();
+  }
+  if (opt_time_report) {
+    llvm::reportAndResetTimings(&llvm::errs());
+    llvm::TimerGroup::printAll(llvm::errs());
   }
 
-  return 0;
+  return status;
 }
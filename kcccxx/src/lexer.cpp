@@ -1,16 +1,17 @@
 #include "lexer.hpp"
+#include "source.hpp"
+#include "stats.hpp"
 #include "llvm/Support/ErrorHandling.h"
 #include <cassert>
 #include <cctype>
-#include <fstream>
 #include <string>
 #include <vector>
 
 BadGetterException::BadGetterException(std::string const &cause): std::domain_error(cause) {
 }
 
-Token::Token(TokenType type, std::string const &token_literal):
-    token_type(type), literal(token_literal) {
+Token::Token(TokenType type, std::string const &token_literal, uint32_t token_offset):
+    token_type(type), literal(token_literal), offset(token_offset) {
 }
 
 TokenType
@@ -23,6 +24,11 @@ Token::representation() const {
   return literal;
 }
 
+uint32_t
+Token::get_offset() const {
+  return offset;
+}
+
 std::string
 Token::get_as_name() const {
   switch (token_type) {
@@ -34,11 +40,24 @@ Token::get_as_name() const {
   }
 }
 
-int
+uint64_t
 Token::get_as_integer() const {
   switch (token_type) {
     case TokenType::Digit:
-      return std::stoi(literal);
+      return std::stoull(literal);
+    default:
+      llvm_unreachable("Not an integer");
+  }
+}
+
+// type suffix of an integer literal such as 10i64, empty if none
+std::string
+Token::get_integer_suffix() const {
+  switch (token_type) {
+    case TokenType::Digit: {
+      auto const pos = literal.find_first_not_of("0123456789");
+      return (pos == std::string::npos) ? "" : literal.substr(pos);
+    }
     default:
       llvm_unreachable("Not an integer");
   }
@@ -78,37 +97,29 @@ TokenStream::expect(TokenType type, char const *repr) {
 }
 
 struct char_stream {
-  explicit char_stream() {
-  }
-  bool open(std::string const &filename) {
-    ifs.open(filename);
-    if (!ifs) {
-      return false;
-    }
-    return true;
+  explicit char_stream(std::string const &text): buf(text), pos(0) {
   }
   char get_next_char() {
-    if (ifs.eof()) {
-      return '\0';
-    }
-    if (bk) {
-      bk = false;
-      return cur;
-    }
-    ifs >> std::noskipws >> cur;
-    return cur;
+    // keep counting past the end so that back() stays symmetric
+    auto const c = (pos < buf.size()) ? buf[pos] : '\0';
+    ++pos;
+    return c;
   }
   void back() {
-    assert(!bk);
-    bk = true;
+    assert(pos > 0);
+    --pos;
+  }
+  // offset of the character last returned by get_next_char()
+  uint32_t offset() const {
+    return pos - 1;
   }
-  std::ifstream ifs;
-  bool bk;
-  char cur;
+  std::string const &buf;
+  size_t pos;
 };
 
 Token
 lex_double_quoted_literal(char_stream &stream) {
+  auto const start = stream.offset();
   std::string str = "\"";
 
   char c;
@@ -117,44 +128,52 @@ lex_double_quoted_literal(char_stream &stream) {
     str.push_back(c);
   } while (c != '\"');
 
-  return Token(TokenType::DoubleQuoted, str);
+  return Token(TokenType::DoubleQuoted, str, start);
 }
 
 std::vector<Token>
 LexicalAnalysis(std::string const &filename) {
-  auto const syms = static_cast<std::string>("!$%&-=~^|@+:*<>/?.");
-
-  char_stream stream;
-  if (!stream.open(filename)) {
+  auto source = SourceFile::open(filename);
+  if (!source) {
+    llvm::consumeError(source.takeError());
     return {};
   }
+  return LexicalAnalysis(source.get());
+}
+
+std::vector<Token>
+LexicalAnalysis(SourceFile const &source) {
+  auto const syms = static_cast<std::string>("!$%&-=~^|@+:*<>/?.");
+
+  char_stream stream(source.get_text());
 
   std::vector<Token> tokens;
   while (char c = stream.get_next_char()) {
+    auto const start = stream.offset();
     switch (c) {
       case '(':
-        tokens.emplace_back(TokenType::LParen, "(");
+        tokens.emplace_back(TokenType::LParen, "(", start);
         continue;
       case ')':
-        tokens.emplace_back(TokenType::RParen, ")");
+        tokens.emplace_back(TokenType::RParen, ")", start);
         continue;
       case '[':
-        tokens.emplace_back(TokenType::LBracket, "[");
+        tokens.emplace_back(TokenType::LBracket, "[", start);
         continue;
       case ']':
-        tokens.emplace_back(TokenType::RBracket, "]");
+        tokens.emplace_back(TokenType::RBracket, "]", start);
         continue;
       case '{':
-        tokens.emplace_back(TokenType::LBrace, "{");
+        tokens.emplace_back(TokenType::LBrace, "{", start);
         continue;
       case '}':
-        tokens.emplace_back(TokenType::RBrace, "}");
+        tokens.emplace_back(TokenType::RBrace, "}", start);
         continue;
       case ',':
-        tokens.emplace_back(TokenType::Comma, ",");
+        tokens.emplace_back(TokenType::Comma, ",", start);
         continue;
       case ';':
-        tokens.emplace_back(TokenType::Semicolon, ";");
+        tokens.emplace_back(TokenType::Semicolon, ";", start);
         continue;
       case '"': {
         auto const tok = lex_double_quoted_literal(stream);
@@ -169,8 +188,14 @@ LexicalAnalysis(std::string const &filename) {
         cur_token.push_back(c);
         c = stream.get_next_char();
       }
+      if (c == 'i' || c == 'u') {
+        while (std::islower(c) || std::isdigit(c)) {
+          cur_token.push_back(c);
+          c = stream.get_next_char();
+        }
+      }
       stream.back();
-      tokens.emplace_back(TokenType::Digit, cur_token);
+      tokens.emplace_back(TokenType::Digit, cur_token, start);
     } else if (std::islower(c)) {
       std::string cur_token;
       while (std::islower(c) || std::isdigit(c) || c == '_') {
@@ -178,7 +203,7 @@ LexicalAnalysis(std::string const &filename) {
         c = stream.get_next_char();
       }
       stream.back();
-      tokens.emplace_back(TokenType::SmallName, cur_token);
+      tokens.emplace_back(TokenType::SmallName, cur_token, start);
     } else if (std::isupper(c)) {
       std::string capital;
       while (std::isalnum(c)) {
@@ -186,7 +211,7 @@ LexicalAnalysis(std::string const &filename) {
         c = stream.get_next_char();
       }
       stream.back();
-      tokens.emplace_back(TokenType::CapitalName, capital);
+      tokens.emplace_back(TokenType::CapitalName, capital, start);
     } else if (syms.find(c) != std::string::npos) {
       std::string tok;
       while (syms.find(c) != std::string::npos) {
@@ -194,9 +219,12 @@ LexicalAnalysis(std::string const &filename) {
         c = stream.get_next_char();
       }
       stream.back();
-      tokens.emplace_back(TokenType::Symbol, tok);
+      tokens.emplace_back(TokenType::Symbol, tok, start);
     }
   }
-  tokens.emplace_back(TokenType::Eof, "");
+  tokens.emplace_back(TokenType::Eof, "", stream.offset());
+  if (auto const stats = CompileStats::active()) {
+    stats->tokens += tokens.size();
+  }
   return tokens;
 }
@@ -1,8 +1,11 @@
 #include <cassert>
+#include <map>
 #include <stack>
 #include <string>
 #include <vector>
 
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Casting.h"
 #include "llvm/Support/ErrorHandling.h"
 
 #include "ast.hpp"
@@ -11,22 +14,60 @@
 #include "parser.hpp"
 #include "type.hpp"
 
+template <typename T>
+static T *
+located(T *ast, uint32_t offset) {
+  ast->set_loc(offset);
+  return ast;
+}
+
 TranslationUnitAst *
 Parser::parse_top_level_decl() {
+  std::vector<std::string> imports;
+  while (tokens.seek()->representation() == "Import") {
+    tokens.advance();
+    imports.push_back(tokens.expect(TokenType::SmallName)->representation());
+  }
   std::vector<Ast *> funcs;
   while (tokens.seek()->type() != TokenType::Eof) {
     auto const fn = parse_deffn_decl();
     funcs.push_back(fn);
   }
-  return new TranslationUnitAst(funcs);
+  return new TranslationUnitAst(funcs, imports, embeds);
+}
+
+static bool
+parse_modifier(std::string const &repr, DefFnAst::Modifier &mod) {
+  if (repr == "Memo") {
+    mod = DefFnAst::Memo;
+    return true;
+  }
+  if (repr == "Export") {
+    mod = DefFnAst::Export;
+    return true;
+  }
+  if (repr == "Async") {
+    mod = DefFnAst::Async;
+    return true;
+  }
+  return false;
 }
 
 Ast *
 Parser::parse_deffn_decl() {
+  auto const start = tokens.seek()->get_offset();
+  std::vector<DefFnAst::Modifier> mods;
+  DefFnAst::Modifier mod;
+  while (tokens.seek()->type() == TokenType::CapitalName
+         && parse_modifier(tokens.seek()->representation(), mod)) {
+    tokens.advance();
+    mods.push_back(mod);
+  }
   tokens.expect(TokenType::CapitalName, "DefFn");
 
   auto tok = tokens.get();
   auto const name = tok->representation();
+  auto const type_params = parse_type_params();
 
   tokens.expect(TokenType::LParen);
   std::vector<std::string> params;
@@ -48,7 +89,47 @@ Parser::parse_deffn_decl() {
   Type *retty = parse_type();
 
   Ast *body = parse_block_expr();
-  return new DefFnAst(name, params, retty, types, body);
+  auto const def = located(new DefFnAst(name, params, retty, types, body), start);
+  for (auto &&m : mods) {
+    def->add_modifier(m);
+  }
+  def->set_type_params(type_params);
+  type_param_scope.clear();
+  return def;
+}
+
+// [T, U: Int], where Int admits only integer types; the names are in scope until the end of the
+// DefFn
+std::vector<TyVar *>
+Parser::parse_type_params() {
+  std::vector<TyVar *> tyvars;
+  type_param_scope.clear();
+  if (tokens.seek()->type() != TokenType::LBracket) {
+    return tyvars;
+  }
+  tokens.expect(TokenType::LBracket);
+  for (;;) {
+    auto const name = tokens.expect(TokenType::CapitalName)->representation();
+    auto const reserved = name == "Bool" || name == "Fr" || name == "Slice" || name == "Vec";
+    if (reserved || type_param_scope.count(name)) {
+      llvm::report_fatal_error(llvm::Twine("cannot name a type parameter ") + name);
+    }
+    auto bound = TyVar::Bound::Any;
+    if (tokens.seek()->representation() == ":") {
+      tokens.advance();
+      tokens.expect(TokenType::CapitalName, "Int");
+      bound = TyVar::Bound::Int;
+    }
+    auto const tyvar = new TyVar(next_type_param++, name, bound);
+    type_param_scope[name] = tyvar;
+    tyvars.push_back(tyvar);
+    if (tokens.seek()->type() != TokenType::Comma) {
+      break;
+    }
+    tokens.advance();
+  }
+  tokens.expect(TokenType::RBracket);
+  return tyvars;
 }
 
 std::vector<Ast *>
@@ -84,7 +165,8 @@ Parser::parse_expr() {
 
 static bool
 is_binop_token(Token *tok) {
-  return tok->type() == TokenType::Symbol;
+  // .. separates the bounds of a For range
+  return tok->type() == TokenType::Symbol && tok->representation() != "..";
 }
 
 static BinOp *
@@ -129,7 +211,7 @@ Parser::parse_binary_expr_seq() {
       outstk.pop();
       auto const lhs = outstk.top();
       outstk.pop();
-      outstk.push(t->create(lhs, rhs));
+      outstk.push(located(t->create(lhs, rhs), lhs->get_loc()));
     }
     opstk.push(op);
 
@@ -143,7 +225,7 @@ Parser::parse_binary_expr_seq() {
     outstk.pop();
     auto const lhs = outstk.top();
     outstk.pop();
-    outstk.push(op->create(lhs, rhs));
+    outstk.push(located(op->create(lhs, rhs), lhs->get_loc()));
   }
   assert(outstk.size() == 1);
   return outstk.top();
@@ -151,19 +233,19 @@ Parser::parse_binary_expr_seq() {
 
 Ast *
 Parser::parse_block_expr() {
-  tokens.expect(TokenType::LBrace);
+  auto const start = tokens.expect(TokenType::LBrace)->get_offset();
   auto const stmts = parse_stmt_seq();
   tokens.expect(TokenType::RBrace);
-  return new BlockExprAst(stmts);
+  return located(new BlockExprAst(stmts), start);
 }
 
 Ast *
 Parser::parse_decl_stmt() {
-  tokens.expect(TokenType::CapitalName, "Decl");
+  auto const start = tokens.expect(TokenType::CapitalName, "Decl")->get_offset();
   auto const nametok = tokens.expect(TokenType::SmallName);
   tokens.expect(TokenType::Symbol, ":");
   auto const ty = parse_type();
-  return new DeclStmtAst(nametok->representation(), ty);
+  return located(new DeclStmtAst(nametok->representation(), ty), start);
 }
 
 Ast *
@@ -182,9 +264,18 @@ Parser::parse_primary_expr() {
       return parse_block_expr();
     case TokenType::CapitalName: {
       auto const head = tok->representation();
+      if (head == "Await") {
+        return parse_await_expr();
+      }
+      if (head == "For") {
+        return parse_for_expr();
+      }
+      if (head == "Embed") {
+        return parse_embed_expr();
+      }
       if (head == "False") {
         tokens.advance();
-        return new BoolLiteralExprAst(false);
+        return located(new BoolLiteralExprAst(false), tok->get_offset());
       }
       if (head == "If") {
         return parse_if_expr();
@@ -192,9 +283,15 @@ Parser::parse_primary_expr() {
       if (head == "Oc") {
         return parse_octet_seq_literal();
       }
+      if (head == "Par") {
+        return parse_par_expr();
+      }
       if (head == "True") {
         tokens.advance();
-        return new BoolLiteralExprAst(true);
+        return located(new BoolLiteralExprAst(true), tok->get_offset());
+      }
+      if (head == "While") {
+        return parse_while_expr();
       }
     }
     case TokenType::SmallName:
@@ -204,17 +301,44 @@ Parser::parse_primary_expr() {
   }
 }
 
+static Type *
+integer_type_of_name(std::string const &name) {
+  if (name == "u8") {
+    return new U8Type;
+  }
+  // clang-format off
+  static struct { char const *name; int width; bool sign; } constexpr types[] = {
+    { "i8", 8, true }, { "i16", 16, true }, { "i32", 32, true }, { "i64", 64, true },
+    { "u16", 16, false }, { "u32", 32, false }, { "u64", 64, false },
+  };
+  // clang-format on
+  for (auto &&t : types) {
+    if (name == t.name) {
+      return new IntNType(t.width, t.sign);
+    }
+  }
+  return nullptr;
+}
+
 Ast *
 Parser::parse_integer_literal() {
   auto const tok = tokens.get();
   assert(tok->type() == TokenType::Digit);
-  return new IntegerLiteralExpr(std::stoi(tok->representation()));
+  auto const suffix = tok->get_integer_suffix();
+  Type *ty = nullptr;
+  if (!suffix.empty()) {
+    ty = integer_type_of_name(suffix);
+    if (!ty) {
+      llvm::report_fatal_error(llvm::Twine("unknown integer suffix ") + suffix);
+    }
+  }
+  return located(new IntegerLiteralExpr(tok->get_as_integer(), ty), tok->get_offset());
 }
 
 Ast *
 Parser::parse_ident_expr() {
   auto const tok = tokens.get();
-  auto const var = new VarRefExprAst(tok->representation());
+  auto const var = located(new VarRefExprAst(tok->representation()), tok->get_offset());
   if (tokens.seek()->type() != TokenType::LParen) {
     return var;
   }
@@ -230,12 +354,12 @@ Parser::parse_ident_expr() {
     args.push_back(arg);
   }
   tokens.expect(TokenType::RParen);
-  return new CallExprAst(var, args);
+  return located(new CallExprAst(var, args), tok->get_offset());
 }
 
 Ast *
 Parser::parse_if_expr() {
-  tokens.expect(TokenType::CapitalName, "If");
+  auto const start = tokens.expect(TokenType::CapitalName, "If")->get_offset();
   auto const cond = parse_expr();
 
   tokens.expect(TokenType::CapitalName, "Then");
@@ -244,16 +368,94 @@ Parser::parse_if_expr() {
   tokens.expect(TokenType::CapitalName, "Else");
   auto const els = parse_expr();
 
-  return new IfExprAst(cond, then, els);
+  return located(new IfExprAst(cond, then, els), start);
+}
+
+Ast *
+Parser::parse_for_expr() {
+  auto const start = tokens.expect(TokenType::CapitalName, "For")->get_offset();
+  auto const var = tokens.expect(TokenType::SmallName)->representation();
+  tokens.expect(TokenType::CapitalName, "In");
+  auto const lo = parse_expr();
+  tokens.expect(TokenType::Symbol, "..");
+  auto const hi = parse_expr();
+
+  tokens.expect(TokenType::CapitalName, "With");
+  auto const acc = tokens.expect(TokenType::SmallName)->representation();
+  tokens.expect(TokenType::Symbol, "=");
+  auto const init = parse_expr();
+  auto const hints = parse_loop_hints();
+
+  tokens.expect(TokenType::CapitalName, "Do");
+  auto const body = parse_expr();
+  return located(new ForExprAst(var, lo, hi, acc, init, body, hints), start);
+}
+
+Ast *
+Parser::parse_await_expr() {
+  auto const start = tokens.expect(TokenType::CapitalName, "Await")->get_offset();
+  auto const body = parse_expr();
+  return located(new AwaitExprAst(body), start);
+}
+
+Ast *
+Parser::parse_par_expr() {
+  auto const start = tokens.expect(TokenType::CapitalName, "Par")->get_offset();
+  auto const body = parse_expr();
+  return located(new ParExprAst(body), start);
+}
+
+Ast *
+Parser::parse_while_expr() {
+  auto const start = tokens.expect(TokenType::CapitalName, "While")->get_offset();
+  auto const cond = parse_expr();
+
+  tokens.expect(TokenType::CapitalName, "With");
+  auto const acc = tokens.expect(TokenType::SmallName)->representation();
+  tokens.expect(TokenType::Symbol, "=");
+  auto const init = parse_expr();
+  auto const hints = parse_loop_hints();
+
+  tokens.expect(TokenType::CapitalName, "Do");
+  auto const body = parse_expr();
+  return located(new WhileExprAst(cond, acc, init, body, hints), start);
+}
+
+// Hint name = N, ... with name one of vectorize, interleave and unroll
+LoopHints
+Parser::parse_loop_hints() {
+  LoopHints hints;
+  if (tokens.seek()->representation() != "Hint") {
+    return hints;
+  }
+  tokens.advance();
+  while (true) {
+    auto const name = tokens.expect(TokenType::SmallName)->representation();
+    tokens.expect(TokenType::Symbol, "=");
+    auto const value = static_cast<unsigned>(tokens.expect(TokenType::Digit)->get_as_integer());
+    if (name == "vectorize") {
+      hints.vectorize = value;
+    } else if (name == "interleave") {
+      hints.interleave = value;
+    } else if (name == "unroll") {
+      hints.unroll = value;
+    } else {
+      llvm::report_fatal_error(llvm::Twine("unknown loop hint ") + name);
+    }
+    if (tokens.seek()->type() != TokenType::Comma) {
+      return hints;
+    }
+    tokens.advance();
+  }
 }
 
 Ast *
 Parser::parse_let_stmt() {
-  tokens.expect(TokenType::CapitalName, "Let");
+  auto const start = tokens.expect(TokenType::CapitalName, "Let")->get_offset();
   auto const nametok = tokens.expect(TokenType::SmallName);
   tokens.expect(TokenType::Symbol, "=");
   auto const rhs = parse_expr();
-  return new LetStmtAst(nametok->representation(), rhs);
+  return located(new LetStmtAst(nametok->representation(), rhs), start);
 }
 
 static std::string
@@ -261,12 +463,21 @@ read_octet_seq_literal(std::string const &repr) {
   return repr.substr(1, repr.size() - 2);
 }
 
+Ast *
+Parser::parse_embed_expr() {
+  auto const start = tokens.expect(TokenType::CapitalName, "Embed")->get_offset();
+  auto const path = tokens.expect(TokenType::DoubleQuoted);
+  auto const embed = new EmbedExprAst(read_octet_seq_literal(path->representation()));
+  embeds.push_back(embed);
+  return located(embed, start);
+}
+
 Ast *
 Parser::parse_octet_seq_literal() {
-  tokens.expect(TokenType::CapitalName, "Oc");
+  auto const start = tokens.expect(TokenType::CapitalName, "Oc")->get_offset();
   auto const literal = tokens.expect(TokenType::DoubleQuoted);
   auto const content = read_octet_seq_literal(literal->representation());
-  return new OctetSeqLiteralAst(content);
+  return located(new OctetSeqLiteralAst(content), start);
 }
 
 Type *
@@ -274,20 +485,16 @@ Parser::parse_type() {
   auto const tok = tokens.seek();
   switch (tok->type()) {
     case TokenType::SmallName: {
-      auto const head = tok->representation();
-      if (head == "i32") {
+      if (auto const ty = integer_type_of_name(tok->representation())) {
         tokens.advance();
-        return new IntNType(32);
-      }
-      if (head == "u8") {
-        tokens.advance();
-        return new U8Type;
+        return ty;
       }
       llvm_unreachable("not implemented");
     }
     case TokenType::CapitalName: {
       auto const head = tok->representation();
       if (head == "Bool") {
+        tokens.advance();
         return new BoolType;
       }
       if (head == "Fr") {
@@ -298,7 +505,24 @@ Parser::parse_type() {
         auto const elt = parse_type();
         return new SliceType(elt);
       }
-      llvm_unreachable("not implemented");
+      if (head == "Vec") {
+        tokens.advance();
+        auto const lanes = tokens.expect(TokenType::Digit)->get_as_integer();
+        if (!VecType::valid_lanes(lanes)) {
+          llvm::report_fatal_error("Vec lanes must be a power of two up to 64");
+        }
+        auto const elt = parse_type();
+        if (!llvm::isa<IntNType>(elt) && !llvm::isa<U8Type>(elt) && !llvm::isa<BoolType>(elt)) {
+          llvm::report_fatal_error("Vec lanes must be integers, u8 or Bool");
+        }
+        return new VecType(lanes, elt);
+      }
+      auto const tyvar = type_param_scope.find(head);
+      if (tyvar != type_param_scope.end()) {
+        tokens.advance();
+        return tyvar->second;
+      }
+      llvm::report_fatal_error(llvm::Twine("unknown type ") + head);
     }
     default:
       llvm_unreachable("not implemented");
@@ -311,15 +535,15 @@ Parser::parse_fn_type() {
 
   tokens.expect(TokenType::LParen);
   std::vector<Type *> types;
-  auto tok = tokens.seek();
-  while (tok->type() != TokenType::RParen) {
+  while (tokens.seek()->type() != TokenType::RParen) {
     auto const ty = parse_type();
     types.push_back(ty);
-    tok = tokens.get();
-    if (tok->type() == TokenType::Comma) {
-      tok = tokens.get();
+    if (tokens.seek()->type() != TokenType::Comma) {
+      break;
     }
+    tokens.advance();
   }
+  tokens.expect(TokenType::RParen);
   tokens.expect(TokenType::Symbol, "->");
   auto const retty = parse_type();
   return new FunctionType(retty, types);
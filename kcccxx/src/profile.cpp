@@ -0,0 +1,66 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MD5.h"
+
+#include "profile.hpp"
+
+llvm::Expected<ProfileData>
+ProfileData::load(std::string const &filename) {
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    return llvm::make_error<llvm::StringError>(
+      "cannot open profile " + filename,
+      std::make_error_code(std::errc::no_such_file_or_directory));
+  }
+
+  ProfileData data;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream record(line);
+    uint64_t hash;
+    size_t ncounters;
+    if (!(record >> std::hex >> hash >> std::dec >> ncounters)) {
+      return llvm::make_error<llvm::StringError>(
+        "malformed profile record: " + line, std::make_error_code(std::errc::invalid_argument));
+    }
+    std::vector<uint64_t> counters(ncounters);
+    for (auto &&c : counters) {
+      if (!(record >> c)) {
+        return llvm::make_error<llvm::StringError>(
+          "truncated profile record: " + line, std::make_error_code(std::errc::invalid_argument));
+      }
+    }
+
+    auto &acc = data.counts[hash];
+    if (acc.empty()) {
+      acc = counters;
+    } else if (acc.size() == counters.size()) {
+      for (size_t i = 0; i < ncounters; ++i) {
+        acc[i] += counters[i];
+      }
+    }
+    // records whose shape differs from the first one seen are stale; drop them
+  }
+  return data;
+}
+
+std::vector<uint64_t> const *
+ProfileData::lookup(uint64_t hash) const {
+  auto const iter = counts.find(hash);
+  if (iter == counts.end()) {
+    return nullptr;
+  }
+  return &iter->second;
+}
+
+uint64_t
+function_hash(std::string const &name) {
+  return llvm::MD5Hash(name);
+}
@@ -0,0 +1,123 @@
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ast.hpp"
+#include "remarks.hpp"
+#include "source.hpp"
+
+RemarkHandler::RemarkHandler(SourceFile const &source, llvm::raw_ostream &diag):
+    source(source), diag(diag) {
+}
+
+static llvm::Error
+compile_filter(
+  std::string const &option, std::string const &pattern, llvm::Optional<llvm::Regex> &filter) {
+  if (pattern.empty()) {
+    return llvm::Error::success();
+  }
+  llvm::Regex regex(pattern);
+  std::string error;
+  if (!regex.isValid(error)) {
+    return llvm::make_error<llvm::StringError>(
+      "invalid regular expression '" + pattern + "' in " + option + ": " + error,
+      std::make_error_code(std::errc::invalid_argument));
+  }
+  filter.emplace(std::move(regex));
+  return llvm::Error::success();
+}
+
+llvm::Expected<std::unique_ptr<RemarkHandler>>
+RemarkHandler::create(
+  std::string const &passed,
+  std::string const &missed,
+  std::string const &analysis,
+  SourceFile const &source,
+  TranslationUnitAst *tunit,
+  llvm::raw_ostream &diag) {
+  std::unique_ptr<RemarkHandler> handler(new RemarkHandler(source, diag));
+  if (auto err = compile_filter("-Rpass", passed, handler->passed)) {
+    return std::move(err);
+  }
+  if (auto err = compile_filter("-Rpass-missed", missed, handler->missed)) {
+    return std::move(err);
+  }
+  if (auto err = compile_filter("-Rpass-analysis", analysis, handler->analysis)) {
+    return std::move(err);
+  }
+  for (size_t i = 0; i < tunit->size(); ++i) {
+    if (auto const def = llvm::dyn_cast<DefFnAst>(tunit->get_nth_func(i))) {
+      handler->definitions.emplace(def->get_name(), def->get_loc());
+    }
+  }
+  return std::move(handler);
+}
+
+bool
+RemarkHandler::isAnalysisRemarkEnabled(llvm::StringRef pass) const {
+  return analysis && analysis->match(pass);
+}
+
+bool
+RemarkHandler::isMissedOptRemarkEnabled(llvm::StringRef pass) const {
+  return missed && missed->match(pass);
+}
+
+bool
+RemarkHandler::isPassedOptRemarkEnabled(llvm::StringRef pass) const {
+  return passed && passed->match(pass);
+}
+
+bool
+RemarkHandler::isAnyRemarkEnabled() const {
+  return passed || missed || analysis;
+}
+
+bool
+RemarkHandler::handleDiagnostics(llvm::DiagnosticInfo const &info) {
+  char const *option;
+  switch (info.getKind()) {
+    case llvm::DK_OptimizationRemark:
+    case llvm::DK_MachineOptimizationRemark:
+      option = "-Rpass";
+      break;
+    case llvm::DK_OptimizationRemarkMissed:
+    case llvm::DK_MachineOptimizationRemarkMissed:
+      option = "-Rpass-missed";
+      break;
+    case llvm::DK_OptimizationRemarkAnalysis:
+    case llvm::DK_OptimizationRemarkAnalysisFPCommute:
+    case llvm::DK_OptimizationRemarkAnalysisAliasing:
+    case llvm::DK_MachineOptimizationRemarkAnalysis:
+      option = "-Rpass-analysis";
+      break;
+    default:
+      // errors and warnings keep LLVM's default handling
+      return false;
+  }
+  // every kind above derives from DiagnosticInfoOptimizationBase, and so has a location
+  auto const &remark = static_cast<llvm::DiagnosticInfoOptimizationBase const &>(info);
+
+  diag << source.get_name();
+  if (remark.isLocationAvailable()) {
+    // locations of whole functions have no column
+    auto const loc = remark.getLocation();
+    diag << ":" << loc.getLine();
+    if (loc.getColumn() > 0) {
+      diag << ":" << loc.getColumn();
+    }
+  } else {
+    // f[i32] and f.resume come from the DefFn of f
+    auto const name = remark.getFunction().getName();
+    auto const def = definitions.find(name.substr(0, name.find_first_of("[.")).str());
+    if (def != definitions.end()) {
+      diag << ":" << source.get_line(def->second) << ":" << source.get_column(def->second);
+    }
+  }
+  diag << ": remark: " << remark.getMsg() << " [" << option << "=" << remark.getPassName() << "]\n";
+  return true;
+}
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "compiler.hpp"
+#include "server.hpp"
+
+// Both directions send one message: a 32-bit byte count, then that many bytes holding a sequence
+// of length-prefixed strings.
+static uint32_t constexpr max_message_size = 1 << 20;
+static char const protocol_version[] = "kccc++-4";
+
+static bool
+write_all(int fd, char const *data, size_t len) {
+  while (len > 0) {
+    auto const n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool
+read_all(int fd, char *data, size_t len) {
+  while (len > 0) {
+    auto const n = recv(fd, data, len, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void
+append_length(std::string &buf, uint32_t len) {
+  char bytes[sizeof(len)];
+  std::memcpy(bytes, &len, sizeof(len));
+  buf.append(bytes, sizeof(len));
+}
+
+static bool
+send_message(int fd, std::vector<std::string> const &fields) {
+  std::string body;
+  for (auto &&field : fields) {
+    append_length(body, field.size());
+    body += field;
+  }
+  std::string msg;
+  append_length(msg, body.size());
+  msg += body;
+  return write_all(fd, msg.data(), msg.size());
+}
+
+static bool
+receive_message(int fd, std::vector<std::string> &fields) {
+  uint32_t len;
+  if (!read_all(fd, reinterpret_cast<char *>(&len), sizeof(len)) || len > max_message_size) {
+    return false;
+  }
+  std::string body(len, '\0');
+  if (!read_all(fd, &body[0], len)) {
+    return false;
+  }
+  fields.clear();
+  for (size_t pos = 0; pos < body.size();) {
+    uint32_t flen;
+    if (body.size() - pos < sizeof(flen)) {
+      return false;
+    }
+    std::memcpy(&flen, body.data() + pos, sizeof(flen));
+    pos += sizeof(flen);
+    if (body.size() - pos < flen) {
+      return false;
+    }
+    fields.push_back(body.substr(pos, flen));
+    pos += flen;
+  }
+  return true;
+}
+
+static std::vector<std::string>
+encode_options(CompileOptions const &opts) {
+  auto const flag = [](bool b) { return std::string(b ? "1" : "0"); };
+  return {
+    protocol_version,
+    opts.input_filename,
+    opts.output_filename,
+    std::to_string(opts.opt_level),
+    flag(opts.emit_llvm),
+    flag(opts.debug_info),
+    flag(opts.memo_stats),
+    flag(opts.profile_generate),
+    opts.profile_output,
+    opts.profile_use,
+    llvm::join(opts.import_paths, llvm::StringRef("\0", 1)),
+    opts.interface_filename,
+    flag(opts.lto),
+    opts.remarks_passed,
+    opts.remarks_missed,
+    opts.remarks_analysis,
+    opts.remarks_record,
+    flag(opts.function_stats),
+  };
+}
+
+static llvm::Optional<CompileOptions>
+decode_options(std::vector<std::string> const &fields) {
+  if (fields.size() != 18 || fields[0] != protocol_version) {
+    return llvm::None;
+  }
+  CompileOptions opts;
+  opts.input_filename = fields[1];
+  opts.output_filename = fields[2];
+  if (llvm::StringRef(fields[3]).getAsInteger(10, opts.opt_level)) {
+    return llvm::None;
+  }
+  opts.emit_llvm = fields[4] == "1";
+  opts.debug_info = fields[5] == "1";
+  opts.memo_stats = fields[6] == "1";
+  opts.profile_generate = fields[7] == "1";
+  opts.profile_output = fields[8];
+  opts.profile_use = fields[9];
+  if (!fields[10].empty()) {
+    llvm::SmallVector<llvm::StringRef, 4> paths;
+    llvm::StringRef(fields[10]).split(paths, '\0');
+    for (auto &&path : paths) {
+      opts.import_paths.push_back(path.str());
+    }
+  }
+  opts.interface_filename = fields[11];
+  opts.lto = fields[12] == "1";
+  opts.remarks_passed = fields[13];
+  opts.remarks_missed = fields[14];
+  opts.remarks_analysis = fields[15];
+  opts.remarks_record = fields[16];
+  opts.function_stats = fields[17] == "1";
+  return opts;
+}
+
+static bool
+make_address(std::string const &path, sockaddr_un &addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+// The socket path is predictable, so each end makes sure the other runs as the same user before
+// trusting it with file names or compiling on its behalf.
+static bool
+peer_is_same_user(int fd) {
+  ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || len != sizeof(cred)) {
+    return false;
+  }
+  return cred.uid == getuid();
+}
+
+static int
+connect_to(std::string const &path) {
+  sockaddr_un addr;
+  if (!make_address(path, addr)) {
+    return -1;
+  }
+  auto const fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+std::string
+default_socket_path() {
+  llvm::SmallString<128> path;
+  if (auto const dir = llvm::sys::Process::GetEnv("XDG_RUNTIME_DIR")) {
+    path = *dir;
+    llvm::sys::path::append(path, "kccc++.sock");
+  } else {
+    path = "/tmp/kccc++-" + std::to_string(getuid()) + ".sock";
+  }
+  return path.str().str();
+}
+
+static void
+serve_request(int fd, CompileFunction const &compile) {
+  std::vector<std::string> fields;
+  if (!receive_message(fd, fields)) {
+    return;
+  }
+
+  std::string diag_text;
+  llvm::raw_string_ostream diag(diag_text);
+  auto status = 1;
+  if (auto const opts = decode_options(fields)) {
+    // fatal errors in the compilation itself already fail it through its CompilerInstance
+    llvm::CrashRecoveryContext crc;
+    if (!crc.RunSafely([&] { status = compile(*opts, diag); })) {
+      diag << "[kccc++] compiler crashed\n";
+      status = 1;
+    }
+  } else {
+    diag << "[kccc++] malformed request\n";
+  }
+  send_message(fd, {std::to_string(status), diag.str()});
+}
+
+// RemoveFileOnSignal() only removes regular files, so the socket is unlinked by hand when the
+// server is interrupted. The path lives in a fixed buffer because this runs in a signal handler.
+static char listening_socket_path[sizeof(sockaddr_un::sun_path)];
+
+static void
+remove_listening_socket() {
+  unlink(listening_socket_path);
+  _exit(0);
+}
+
+namespace {
+
+class ConnectionQueue {
+public:
+  void push(int fd) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      fds.push_back(fd);
+    }
+    ready.notify_one();
+  }
+  // -1 once the queue is shut down and drained
+  int pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait(lock, [this] { return !fds.empty() || shut; });
+    if (fds.empty()) {
+      return -1;
+    }
+    auto const fd = fds.front();
+    fds.pop_front();
+    return fd;
+  }
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shut = true;
+    }
+    ready.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<int> fds;
+  bool shut = false;
+};
+
+} // namespace
+
+int
+run_server(std::string const &socket_path, unsigned nthreads, CompileFunction compile) {
+  sockaddr_un addr;
+  if (!make_address(socket_path, addr)) {
+    llvm::errs() << "[kccc++] socket path too long: " << socket_path << "\n";
+    return 1;
+  }
+  // a socket nobody answers on was left behind by a server that was killed
+  if (auto const fd = connect_to(socket_path); fd >= 0) {
+    close(fd);
+    llvm::errs() << "[kccc++] a server is already listening on " << socket_path << "\n";
+    return 1;
+  }
+  unlink(socket_path.c_str());
+
+  auto const listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  auto const sa = reinterpret_cast<sockaddr *>(&addr);
+  if (listener < 0 || bind(listener, sa, sizeof(addr)) < 0 || listen(listener, SOMAXCONN) < 0) {
+    llvm::errs() << "[kccc++] cannot listen on " << socket_path << ": " << std::strerror(errno)
+                 << "\n";
+    return 1;
+  }
+  std::memcpy(listening_socket_path, addr.sun_path, sizeof(listening_socket_path));
+  llvm::sys::SetInterruptFunction(remove_listening_socket);
+
+  initialize_targets();
+  enable_crash_recovery();
+
+  if (nthreads == 0) {
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  ConnectionQueue queue;
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < nthreads; ++i) {
+    workers.emplace_back([&] {
+      for (auto fd = queue.pop(); fd >= 0; fd = queue.pop()) {
+        serve_request(fd, compile);
+        close(fd);
+      }
+    });
+  }
+
+  for (;;) {
+    auto const fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      llvm::errs() << "[kccc++] accept failed: " << std::strerror(errno) << "\n";
+      break;
+    }
+    if (!peer_is_same_user(fd)) {
+      close(fd);
+      continue;
+    }
+    queue.push(fd);
+  }
+
+  // the workers use queue and compile, so they finish the accepted requests before those go away
+  queue.shutdown();
+  for (auto &&worker : workers) {
+    worker.join();
+  }
+  close(listener);
+  unlink(listening_socket_path);
+  return 1;
+}
+
+llvm::Optional<int>
+run_client(std::string const &socket_path, CompileOptions const &opts, llvm::raw_ostream &diag) {
+  auto const fd = connect_to(socket_path);
+  if (fd < 0) {
+    return llvm::None;
+  }
+  auto const close_fd = llvm::make_scope_exit([fd] { close(fd); });
+  if (!peer_is_same_user(fd)) {
+    diag << "[kccc++] ignoring " << socket_path << ": it belongs to another user\n";
+    return llvm::None;
+  }
+
+  std::vector<std::string> reply;
+  if (!send_message(fd, encode_options(opts)) || !receive_message(fd, reply) || reply.size() != 2) {
+    // the server went away in the middle of the request
+    return llvm::None;
+  }
+  diag << reply[1];
+  return std::atoi(reply[0].c_str());
+}
@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+
+#include "source.hpp"
+
+SourceFile::SourceFile(std::string const &filename, std::string const &text):
+    name(filename), contents(text) {
+  line_starts.push_back(0);
+  for (size_t i = 0, len = contents.size(); i < len; ++i) {
+    if (contents[i] == '\n') {
+      line_starts.push_back(i + 1);
+    }
+  }
+}
+
+llvm::Expected<SourceFile>
+SourceFile::open(std::string const &filename) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    return llvm::make_error<llvm::StringError>(
+      "cannot open " + filename, std::make_error_code(std::errc::no_such_file_or_directory));
+  }
+  std::ostringstream buf;
+  buf << ifs.rdbuf();
+  return SourceFile(filename, buf.str());
+}
+
+unsigned
+SourceFile::get_line(uint32_t offset) const {
+  auto const next = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+  return next - line_starts.begin();
+}
+
+unsigned
+SourceFile::get_column(uint32_t offset) const {
+  return offset - line_starts[get_line(offset) - 1] + 1;
+}
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+
+#include <sys/resource.h>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "stats.hpp"
+
+thread_local CompileStats *CompileStats::current = nullptr;
+
+long
+peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void
+CompileStats::record_peak_rss(std::string const &phase) {
+  peak_rss_kb.emplace_back(phase, ::peak_rss_kb());
+}
+
+static char const *
+name_of(Ast::AK kind) {
+  switch (kind) {
+    case Ast::AK::TranslationUnit:
+      return "TranslationUnit";
+    case Ast::AK::DefFn:
+      return "DefFn";
+    case Ast::AK::AwaitExpr:
+      return "AwaitExpr";
+    case Ast::AK::BinaryExpr:
+      return "BinaryExpr";
+    case Ast::AK::BlockExpr:
+      return "BlockExpr";
+    case Ast::AK::BoolLiteral:
+      return "BoolLiteral";
+    case Ast::AK::CallExpr:
+      return "CallExpr";
+    case Ast::AK::DeclStmt:
+      return "DeclStmt";
+    case Ast::AK::EmbedExpr:
+      return "EmbedExpr";
+    case Ast::AK::ForExpr:
+      return "ForExpr";
+    case Ast::AK::IntegerLiteral:
+      return "IntegerLiteral";
+    case Ast::AK::IfExpr:
+      return "IfExpr";
+    case Ast::AK::LetStmt:
+      return "LetStmt";
+    case Ast::AK::OctetSeqLiteral:
+      return "OctetSeqLiteral";
+    case Ast::AK::ParExpr:
+      return "ParExpr";
+    case Ast::AK::VarRefExpr:
+      return "VarRefExpr";
+    case Ast::AK::WhileExpr:
+      return "WhileExpr";
+  }
+  llvm_unreachable("unknown AST kind");
+}
+
+static char const *
+name_of(Type::TK kind) {
+  switch (kind) {
+    case Type::TK::Bool:
+      return "Bool";
+    case Type::TK::Function:
+      return "Function";
+    case Type::TK::IntN:
+      return "IntN";
+    case Type::TK::U8:
+      return "U8";
+    case Type::TK::Unit:
+      return "Unit";
+    case Type::TK::Slice:
+      return "Slice";
+    case Type::TK::TyVar:
+      return "TyVar";
+    case Type::TK::Vec:
+      return "Vec";
+  }
+  llvm_unreachable("unknown type kind");
+}
+
+template <typename K>
+static size_t
+total(std::map<K, size_t> const &counts) {
+  size_t sum = 0;
+  for (auto &&kv : counts) {
+    sum += kv.second;
+  }
+  return sum;
+}
+
+void
+CompileStats::print(llvm::raw_ostream &os) const {
+  auto const line = [&](int indent, llvm::StringRef name, long value) {
+    auto const label = std::string(indent, ' ') + name.str();
+    os << llvm::format("%-36s %12ld\n", label.c_str(), value);
+  };
+  os << "===- kccc++ statistics -===\n";
+  line(0, "tokens", tokens);
+  line(0, "AST nodes", total(ast_nodes));
+  for (auto &&kv : ast_nodes) {
+    line(2, name_of(kv.first), kv.second);
+  }
+  line(0, "Type objects", total(types));
+  for (auto &&kv : types) {
+    line(2, name_of(kv.first), kv.second);
+  }
+  line(0, "BinOp objects", binops);
+  line(0, "symbol table lookups", typechecker_lookups + codegen_lookups);
+  line(2, "type checker", typechecker_lookups);
+  line(2, "codegen", codegen_lookups);
+  os << "LLVM instructions\n";
+  for (auto &&kv : llvm_instructions) {
+    line(2, "after " + kv.first, kv.second);
+  }
+  os << "peak RSS (KiB)\n";
+  for (auto &&kv : peak_rss_kb) {
+    line(2, "after " + kv.first, kv.second);
+  }
+  auto const llvm_stats = llvm::GetStatistics();
+  if (!llvm_stats.empty()) {
+    os << "LLVM statistics\n";
+    for (auto &&kv : llvm_stats) {
+      line(2, kv.first, kv.second);
+    }
+  }
+}
+
+void
+CompileStats::print_json(llvm::raw_ostream &os) const {
+  auto const count = [](size_t n) { return static_cast<int64_t>(n); };
+  llvm::json::Object ast;
+  for (auto &&kv : ast_nodes) {
+    ast[name_of(kv.first)] = count(kv.second);
+  }
+  llvm::json::Object tys;
+  for (auto &&kv : types) {
+    tys[name_of(kv.first)] = count(kv.second);
+  }
+  llvm::json::Object insts;
+  for (auto &&kv : llvm_instructions) {
+    insts[kv.first] = count(kv.second);
+  }
+  llvm::json::Object rss;
+  for (auto &&kv : peak_rss_kb) {
+    rss[kv.first] = static_cast<int64_t>(kv.second);
+  }
+  llvm::json::Object llvm_stats;
+  for (auto &&kv : llvm::GetStatistics()) {
+    llvm_stats[kv.first] = static_cast<int64_t>(kv.second);
+  }
+  llvm::json::Value const report = llvm::json::Object{
+    {"tokens", count(tokens)},
+    {"ast_nodes", std::move(ast)},
+    {"types", std::move(tys)},
+    {"binops", count(binops)},
+    {"symbol_lookups",
+     llvm::json::Object{
+       {"typechecker", count(typechecker_lookups)},
+       {"codegen", count(codegen_lookups)},
+     }},
+    {"llvm_instructions", std::move(insts)},
+    {"peak_rss_kb", std::move(rss)},
+    {"llvm_statistics", std::move(llvm_stats)},
+  };
+  os << llvm::formatv("{0:2}", report) << "\n";
+}
+
+std::vector<FunctionStats>
+collect_function_stats(llvm::Module const &mod) {
+  auto const &layout = mod.getDataLayout();
+  std::vector<FunctionStats> result;
+  for (auto &&fn : mod) {
+    if (fn.isDeclaration()) {
+      continue;
+    }
+    FunctionStats stats;
+    stats.name = fn.getName().str();
+    stats.blocks = fn.size();
+    for (auto &&inst : llvm::instructions(fn)) {
+      if (llvm::isa<llvm::DbgInfoIntrinsic>(inst)) {
+        continue;
+      }
+      ++stats.instructions;
+      if (llvm::isa<llvm::CallBase>(inst)) {
+        ++stats.calls;
+      }
+      auto const alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst);
+      if (!alloca) {
+        continue;
+      }
+      ++stats.allocas;
+      if (!alloca->isStaticAlloca()) {
+        stats.dynamic_stack = true;
+        continue;
+      }
+      auto const type = alloca->getAllocatedType();
+      auto const count = llvm::cast<llvm::ConstantInt>(alloca->getArraySize())->getZExtValue();
+      auto const align =
+        alloca->getAlignment() ? alloca->getAlignment() : layout.getPrefTypeAlignment(type);
+      stats.stack_bytes =
+        llvm::alignTo(stats.stack_bytes, align) + layout.getTypeAllocSize(type) * count;
+    }
+    result.push_back(std::move(stats));
+  }
+  return result;
+}
+
+void
+print_function_stats(
+  llvm::raw_ostream &os, std::string const &module, PhaseFunctionStats const &phases) {
+  if (phases.empty()) {
+    return;
+  }
+  // functions that later phases split off, coroutine parts say, come after the others
+  std::vector<std::map<std::string, FunctionStats const *>> by_name(phases.size());
+  std::vector<std::string> names;
+  std::set<std::string> seen;
+  size_t name_width = 8;
+  size_t phase_width = 5;
+  for (size_t i = 0; i < phases.size(); ++i) {
+    phase_width = std::max(phase_width, phases[i].first.size());
+    for (auto &&fn : phases[i].second) {
+      by_name[i][fn.name] = &fn;
+      name_width = std::max(name_width, fn.name.size());
+      if (seen.insert(fn.name).second) {
+        names.push_back(fn.name);
+      }
+    }
+  }
+  auto const row = [&](
+                     llvm::StringRef name,
+                     llvm::StringRef phase,
+                     llvm::StringRef insts,
+                     llvm::StringRef blocks,
+                     llvm::StringRef allocas,
+                     llvm::StringRef calls,
+                     llvm::StringRef stack) {
+    os << llvm::left_justify(name, name_width) << "  " << llvm::left_justify(phase, phase_width)
+       << llvm::right_justify(insts, 8) << llvm::right_justify(blocks, 8)
+       << llvm::right_justify(allocas, 9) << llvm::right_justify(calls, 7)
+       << llvm::right_justify(stack, 11) << "\n";
+  };
+  os << "===- kccc++ function statistics: " << module << " -===\n";
+  row("function", "phase", "insts", "blocks", "allocas", "calls", "stack");
+  for (auto &&fn_name : names) {
+    for (size_t i = 0; i < phases.size(); ++i) {
+      auto const name = i == 0 ? fn_name : std::string();
+      auto const found = by_name[i].find(fn_name);
+      if (found == by_name[i].end()) {
+        row(name, phases[i].first, "-", "", "", "", "");
+        continue;
+      }
+      auto const &fn = *found->second;
+      row(
+        name,
+        phases[i].first,
+        std::to_string(fn.instructions),
+        std::to_string(fn.blocks),
+        std::to_string(fn.allocas),
+        std::to_string(fn.calls),
+        std::to_string(fn.stack_bytes) + (fn.dynamic_stack ? "+" : ""));
+    }
+  }
+}
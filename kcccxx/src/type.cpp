@@ -1,8 +1,17 @@
 #include "type.hpp"
+#include "stats.hpp"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/ErrorHandling.h"
 #include <cstdlib>
+#include <string>
 #include <vector>
 
+Type::Type(TK k): kind(k) {
+  if (auto const stats = CompileStats::active()) {
+    ++stats->types[k];
+  }
+}
+
 Type::~Type() {
 }
 
@@ -28,7 +37,23 @@ FunctionType::equal(Type *rhs) const {
 bool
 IntNType::equal(Type *lhs) const {
   if (auto const lty = llvm::dyn_cast<IntNType>(lhs)) {
-    return width == lty->width;
+    return width == lty->width && sign == lty->sign;
+  }
+  return false;
+}
+
+bool
+SliceType::equal(Type *rhs) const {
+  if (auto const rty = llvm::dyn_cast<SliceType>(rhs)) {
+    return elem->equal(rty->elem);
+  }
+  return false;
+}
+
+bool
+VecType::equal(Type *rhs) const {
+  if (auto const rty = llvm::dyn_cast<VecType>(rhs)) {
+    return lanes == rty->lanes && elem->equal(rty->elem);
   }
   return false;
 }
@@ -40,3 +65,65 @@ TyVar::equal(Type *lhs) const {
   }
   return false;
 }
+
+Type *
+substitute(Type *ty, TypeBindings const &bindings) {
+  using llvm::dyn_cast;
+  if (auto const tyvar = dyn_cast<TyVar>(ty)) {
+    auto const bound = bindings.find(tyvar->get_id());
+    return bound == bindings.end() ? ty : bound->second;
+  }
+  if (auto const slice = dyn_cast<SliceType>(ty)) {
+    auto const elem = substitute(slice->get_elem_type(), bindings);
+    return elem == slice->get_elem_type() ? ty : new SliceType(elem);
+  }
+  if (auto const vec = dyn_cast<VecType>(ty)) {
+    auto const elem = substitute(vec->get_elem_type(), bindings);
+    return elem == vec->get_elem_type() ? ty : new VecType(vec->get_lanes(), elem);
+  }
+  if (auto const fnty = dyn_cast<FunctionType>(ty)) {
+    auto changed = false;
+    auto const ret = substitute(fnty->get_return_type(), bindings);
+    changed |= ret != fnty->get_return_type();
+    std::vector<Type *> params;
+    for (size_t i = 0, arity = fnty->get_arity(); i < arity; ++i) {
+      params.push_back(substitute(fnty->get_nth_param(i), bindings));
+      changed |= params.back() != fnty->get_nth_param(i);
+    }
+    return changed ? new FunctionType(ret, params) : ty;
+  }
+  return ty;
+}
+
+std::string
+type_name(Type *ty) {
+  switch (ty->get_kind()) {
+    case Type::TK::Bool:
+      return "Bool";
+    case Type::TK::Function: {
+      auto const fnty = llvm::cast<FunctionType>(ty);
+      std::string name = "Fr (";
+      for (size_t i = 0, arity = fnty->get_arity(); i < arity; ++i) {
+        name += (i ? ", " : "") + type_name(fnty->get_nth_param(i));
+      }
+      return name + ") -> " + type_name(fnty->get_return_type());
+    }
+    case Type::TK::IntN: {
+      auto const intty = llvm::cast<IntNType>(ty);
+      return (intty->is_signed() ? "i" : "u") + std::to_string(intty->get_width());
+    }
+    case Type::TK::U8:
+      return "u8";
+    case Type::TK::Unit:
+      return "()";
+    case Type::TK::Slice:
+      return "Slice " + type_name(llvm::cast<SliceType>(ty)->get_elem_type());
+    case Type::TK::TyVar:
+      return llvm::cast<TyVar>(ty)->get_name();
+    case Type::TK::Vec: {
+      auto const vec = llvm::cast<VecType>(ty);
+      return "Vec " + std::to_string(vec->get_lanes()) + " " + type_name(vec->get_elem_type());
+    }
+  }
+  llvm_unreachable("unknown type kind");
+}
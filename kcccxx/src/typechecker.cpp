@@ -1,10 +1,16 @@
 #include "ast.hpp"
 #include "binop.hpp"
+#include "builtin.hpp"
+#include "effect.hpp"
+#include "stats.hpp"
 #include "type.hpp"
+#include "llvm/ADT/Twine.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/TimeProfiler.h"
 #include <iostream>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -19,10 +25,38 @@ public:
 
   using tymap = std::map<std::string, Type *>;
   std::vector<tymap> tyenv;
+  // whether Memo functions are pure and Par operands may run in parallel
+  EffectAnalysis effects;
+
+  // the types bound to Async functions, which may only be called
+  std::set<Type *> async_fns;
+  bool in_async = false;
+  // the types bound to generic functions, which may only be called
+  std::map<Type *, DefFnAst *> generic_fns;
+  // the callee of the call being checked
+  Ast *callee = nullptr;
+  bool is_async_call(CallExprAst *call) const;
 };
 
+bool
+TypeCheckerImpl::is_async_call(CallExprAst *call) const {
+  auto const callee = llvm::cast<ExprAst>(call->get_callee());
+  if (async_fns.count(callee->get_type())) {
+    return true;
+  }
+  auto const var = llvm::dyn_cast<VarRefExprAst>(callee);
+  if (!var || lookup_tyenv(var->get_name())) {
+    return false;
+  }
+  auto const builtin = lookup_builtin(var->get_name());
+  return builtin && is_async_builtin(*builtin);
+}
+
 Type *
 TypeCheckerImpl::lookup_tyenv(std::string const &name) const {
+  if (auto const stats = CompileStats::active()) {
+    ++stats->typechecker_lookups;
+  }
   for (auto iter = rbegin(tyenv); iter != rend(tyenv); ++iter) {
     auto const kv = iter->find(name);
     if (kv != iter->end()) {
@@ -47,6 +81,61 @@ TypeCheckerImpl::register_type(std::string const &name, Type *ty) {
   tyenv.back()[name] = ty;
 }
 
+// integer types and type parameters bound to them
+static bool
+is_integer(Type *ty) {
+  auto const tyvar = llvm::dyn_cast<TyVar>(ty);
+  return llvm::isa<IntNType>(ty) || (tyvar && tyvar->get_bound() == TyVar::Bound::Int);
+}
+
+static bool
+literal_fits(uint64_t value, Type *ty) {
+  if (llvm::isa<U8Type>(ty)) {
+    return value <= UINT8_MAX;
+  }
+  if (llvm::isa<TyVar>(ty)) {
+    // must fit whichever integer type the parameter stands for
+    return is_integer(ty) && value <= INT8_MAX;
+  }
+  if (auto const intty = llvm::dyn_cast<IntNType>(ty)) {
+    auto const bits = intty->get_width() - (intty->is_signed() ? 1 : 0);
+    return bits >= 64 || value < (uint64_t(1) << bits);
+  }
+  return false;
+}
+
+// Gives an unsuffixed integer literal in expr the type want instead of its default. Looks through
+// the last statement of a block and both arms of an If. Returns the resulting type of expr.
+static Type *
+coerce_literal(Ast *expr, Type *want) {
+  using llvm::dyn_cast;
+  auto const have = llvm::cast<ExprAst>(expr)->get_type();
+  if (!have || have->equal(want)) {
+    return have;
+  }
+  if (auto const num = dyn_cast<IntegerLiteralExpr>(expr)) {
+    if (!num->get_suffix_type() && literal_fits(num->get_value(), want)) {
+      num->set_type(want);
+      return want;
+    }
+    return have;
+  }
+  if (auto const block = dyn_cast<BlockExprAst>(expr)) {
+    auto const ty = coerce_literal(block->get_nth_stmt(block->size() - 1), want);
+    block->set_type(ty);
+    return ty;
+  }
+  if (auto const ife = dyn_cast<IfExprAst>(expr)) {
+    auto const thenty = coerce_literal(ife->get_then(), want);
+    auto const elsety = coerce_literal(ife->get_else(), want);
+    if (thenty->equal(elsety)) {
+      ife->set_type(thenty);
+      return thenty;
+    }
+  }
+  return have;
+}
+
 TypeChecker::TypeChecker(): pimpl(new TypeCheckerImpl) {
 }
 
@@ -54,11 +143,29 @@ TypeChecker::~TypeChecker() = default;
 
 void
 TypeChecker::traverse_tunit(TranslationUnitAst *tunit) {
+  pimpl->effects.analyze(tunit);
   pimpl->push_tyenv();
+  for (size_t i = 0, len = tunit->get_import_decl_count(); i < len; ++i) {
+    traverse_decl_stmt(llvm::cast<DeclStmtAst>(tunit->get_nth_import_decl(i)));
+  }
+  // every signature is known before the first body so that functions may refer to later ones
   for (size_t i = 0, len = tunit->size(); i < len; ++i) {
     auto const def = llvm::cast<DefFnAst>(tunit->get_nth_func(i));
-    auto const fnty = traverse_deffn(def);
+    std::vector<Type *> params;
+    for (size_t j = 0, arity = def->get_arity(); j < arity; ++j) {
+      params.push_back(def->get_nth_type(j));
+    }
+    auto const fnty = new FunctionType(def->get_return_type(), params);
     pimpl->register_type(def->get_name(), fnty);
+    if (def->has_modifier(DefFnAst::Async)) {
+      pimpl->async_fns.insert(fnty);
+    }
+    if (def->is_generic()) {
+      pimpl->generic_fns[fnty] = def;
+    }
+  }
+  for (size_t i = 0, len = tunit->size(); i < len; ++i) {
+    traverse_deffn(llvm::cast<DefFnAst>(tunit->get_nth_func(i)));
   }
   pimpl->pop_tyenv();
 }
@@ -68,22 +175,89 @@ TypeChecker::traverse_decl(Ast *) {
   llvm_unreachable("not implemented");
 }
 
+static bool
+mentions(Type *ty, TyVar *tyvar) {
+  using llvm::dyn_cast;
+  if (auto const slice = dyn_cast<SliceType>(ty)) {
+    return mentions(slice->get_elem_type(), tyvar);
+  }
+  if (auto const fnty = dyn_cast<FunctionType>(ty)) {
+    for (size_t i = 0, arity = fnty->get_arity(); i < arity; ++i) {
+      if (mentions(fnty->get_nth_param(i), tyvar)) {
+        return true;
+      }
+    }
+    return mentions(fnty->get_return_type(), tyvar);
+  }
+  return ty->equal(tyvar);
+}
+
+// Type parameters are inferred from the arguments of each call, so each must occur in a parameter
+static void
+check_type_params(DefFnAst *def) {
+  auto const exposed = def->has_modifier(DefFnAst::Export) || def->get_name() == "main";
+  auto const lowered = def->has_modifier(DefFnAst::Memo) || def->has_modifier(DefFnAst::Async);
+  if (exposed || lowered) {
+    llvm::report_fatal_error("generic functions cannot be Memo, Export, Async or main");
+  }
+  for (auto &&tyvar : def->get_type_params()) {
+    auto found = false;
+    for (size_t i = 0, arity = def->get_arity(); i < arity && !found; ++i) {
+      found = mentions(def->get_nth_type(i), tyvar);
+    }
+    if (!found) {
+      llvm::report_fatal_error(
+        llvm::Twine("type parameter ") + tyvar->get_name() + " of " + def->get_name()
+        + " must occur in a parameter type");
+    }
+  }
+}
+
 Type *
 TypeChecker::traverse_deffn(DefFnAst *def) {
+  llvm::TimeTraceScope scope("TypeCheckFunction", [&] { return def->get_name(); });
   pimpl->push_tyenv();
   std::vector<Type *> params;
   for (size_t i = 0, len = def->get_arity(); i < len; ++i) {
     auto const name = def->get_nth_name(i);
     auto const ty = def->get_nth_type(i);
+    auto const keyable =
+      llvm::isa<IntNType>(ty) || llvm::isa<BoolType>(ty) || llvm::isa<U8Type>(ty);
+    if (def->has_modifier(DefFnAst::Memo) && !keyable) {
+      llvm::report_fatal_error("Memo parameters must be integers or Bool");
+    }
     pimpl->register_type(name, ty);
     params.push_back(ty);
   }
   auto const retty = def->get_return_type();
+  if (def->has_modifier(DefFnAst::Memo)) {
+    if (llvm::isa<UnitType>(retty) || llvm::isa<SliceType>(retty)) {
+      llvm::report_fatal_error("Memo functions cannot return Unit or a Slice");
+    }
+    if (!pimpl->effects.is_pure(def->get_name())) {
+      llvm::report_fatal_error(
+        llvm::Twine("Memo function ") + def->get_name()
+        + " may have side effects, which a cache hit would skip");
+    }
+  }
   auto const fnty = new FunctionType(retty, params);
   pimpl->register_type(def->get_name(), fnty);
+  if (def->is_generic()) {
+    check_type_params(def);
+    pimpl->generic_fns[fnty] = def;
+  }
+  pimpl->in_async = def->has_modifier(DefFnAst::Async);
+  if (pimpl->in_async) {
+    auto const exposed = def->has_modifier(DefFnAst::Export) || def->get_name() == "main";
+    if (def->has_modifier(DefFnAst::Memo) || exposed) {
+      llvm::report_fatal_error("Async functions cannot be Memo, Export or main");
+    }
+    pimpl->async_fns.insert(fnty);
+  }
 
   auto const body = llvm::cast<BlockExprAst>(def->get_body());
-  auto const bodyty = traverse_block_expr(body);
+  traverse_block_expr(body);
+  auto const bodyty = coerce_literal(body, retty);
   if (not retty->equal(bodyty)) {
     llvm::report_fatal_error("return type mismatch");
   }
@@ -95,6 +269,9 @@ Type *
 TypeChecker::traverse_expr(Ast *expr) {
   using llvm::dyn_cast;
   using llvm::isa;
+  if (auto const await = dyn_cast<AwaitExprAst>(expr)) {
+    return traverse_await_expr(await);
+  }
   if (auto const bin = dyn_cast<BinaryExprAst>(expr)) {
     return traverse_binary_expr(bin);
   }
@@ -102,7 +279,9 @@ TypeChecker::traverse_expr(Ast *expr) {
     return traverse_block_expr(block);
   }
   if (auto const bl = dyn_cast<BoolLiteralExprAst>(expr)) {
-    return new BoolType;
+    auto const bt = new BoolType;
+    bl->set_type(bt);
+    return bt;
   }
   if (auto const call = dyn_cast<CallExprAst>(expr)) {
     return traverse_call_expr(call);
@@ -110,56 +289,128 @@ TypeChecker::traverse_expr(Ast *expr) {
   if (auto const decl = dyn_cast<DeclStmtAst>(expr)) {
     return traverse_decl_stmt(decl);
   }
+  if (auto const embed = dyn_cast<EmbedExprAst>(expr)) {
+    auto const st = new SliceType(new U8Type);
+    embed->set_type(st);
+    return st;
+  }
+  if (auto const loop = dyn_cast<ForExprAst>(expr)) {
+    return traverse_for_expr(loop);
+  }
   if (auto const ife = dyn_cast<IfExprAst>(expr)) {
     return traverse_if_expr(ife);
   }
-  if (llvm::isa<IntegerLiteralExpr>(expr)) {
-    return new IntNType(32);
+  if (auto const num = dyn_cast<IntegerLiteralExpr>(expr)) {
+    return traverse_integer_literal(num);
   }
   if (auto const let = dyn_cast<LetStmtAst>(expr)) {
     return traverse_let_stmt(let);
   }
-  if (isa<OctetSeqLiteralAst>(expr)) {
-    return new SliceType(new U8Type);
+  if (auto const oseq = dyn_cast<OctetSeqLiteralAst>(expr)) {
+    auto const st = new SliceType(new U8Type);
+    oseq->set_type(st);
+    return st;
+  }
+  if (auto const par = dyn_cast<ParExprAst>(expr)) {
+    return traverse_par_expr(par);
   }
   if (auto const var = dyn_cast<VarRefExprAst>(expr)) {
     return traverse_var_ref(var);
   }
+  if (auto const loop = dyn_cast<WhileExprAst>(expr)) {
+    return traverse_while_expr(loop);
+  }
   llvm_unreachable("not implemented");
 }
 
+Type *
+TypeChecker::traverse_await_expr(AwaitExprAst *await) {
+  if (!pimpl->in_async) {
+    llvm::report_fatal_error("Await outside an Async function");
+  }
+  auto const body = await->get_body();
+  auto const ty = traverse_expr(body);
+
+  // a call is awaited on its own; otherwise its operands run concurrently
+  std::vector<Ast *> candidates{body};
+  auto const call = llvm::dyn_cast<CallExprAst>(body);
+  if (!call || !pimpl->is_async_call(call)) {
+    candidates.clear();
+    if (auto const bin = llvm::dyn_cast<BinaryExprAst>(body)) {
+      candidates = {bin->get_lhs(), bin->get_rhs()};
+    } else if (call) {
+      for (size_t i = 0, len = call->get_nargs(); i < len; ++i) {
+        candidates.push_back(call->get_nth_arg(i));
+      }
+    }
+  }
+  std::vector<CallExprAst *> awaited;
+  for (auto &&candidate : candidates) {
+    auto const operand = llvm::dyn_cast<CallExprAst>(candidate);
+    if (operand && pimpl->is_async_call(operand)) {
+      awaited.push_back(operand);
+    }
+  }
+  if (awaited.empty()) {
+    llvm::report_fatal_error("Await needs a call to an Async function or an async builtin");
+  }
+  await->set_awaited(awaited);
+  await->set_type(ty);
+  return ty;
+}
+
+// Vec of integers or u8, which binary expressions work on lane by lane
+static bool
+is_integer_vector(Type *ty) {
+  auto const vecty = llvm::dyn_cast<VecType>(ty);
+  return vecty
+    && (llvm::isa<IntNType>(vecty->get_elem_type()) || llvm::isa<U8Type>(vecty->get_elem_type()));
+}
+
 Type *
 TypeChecker::traverse_binary_expr(BinaryExprAst *bin) {
   switch (bin->get_op()->get_kind()) {
     case BO::Eq:
     case BO::Lt:
     case BO::Gt: {
-      auto const lty = traverse_expr(bin->get_lhs());
-      auto const rty = traverse_expr(bin->get_rhs());
-      if (!llvm::isa<IntNType>(lty) || !llvm::isa<IntNType>(rty)) {
+      auto const ty = traverse_operands(bin);
+      if (!is_integer(ty) && !is_integer_vector(ty)) {
         llvm::report_fatal_error("must be integer");
       }
-      auto const bt = new BoolType;
-      bin->set_type(bt);
-      return bt;
+      Type *const bt = new BoolType;
+      auto const resty =
+        is_integer_vector(ty) ? new VecType(llvm::cast<VecType>(ty)->get_lanes(), bt) : bt;
+      bin->set_type(resty);
+      return resty;
     }
     case BO::Plus:
     case BO::Minus:
     case BO::Mult:
     case BO::Div: {
-      auto const lty = traverse_expr(bin->get_lhs());
-      auto const rty = traverse_expr(bin->get_rhs());
-      if (!llvm::isa<IntNType>(lty) || !llvm::isa<IntNType>(rty)) {
+      auto const ty = traverse_operands(bin);
+      if (!is_integer(ty) && !is_integer_vector(ty)) {
         llvm::report_fatal_error("must be integer");
       }
-      auto const it = new IntNType(32);
-      bin->set_type(it);
-      return it;
+      bin->set_type(ty);
+      return ty;
     }
   }
   llvm_unreachable("not implemented");
 }
 
+// Both operands must have the same type; an unsuffixed literal on either side adopts the other's.
+Type *
+TypeChecker::traverse_operands(BinaryExprAst *bin) {
+  auto lty = traverse_expr(bin->get_lhs());
+  auto rty = traverse_expr(bin->get_rhs());
+  rty = coerce_literal(bin->get_rhs(), lty);
+  lty = coerce_literal(bin->get_lhs(), rty);
+  if (not lty->equal(rty)) {
+    llvm::report_fatal_error("operands must have the same type");
+  }
+  return lty;
+}
+
 Type *
 TypeChecker::traverse_block_expr(BlockExprAst *block) {
   size_t len = block->size();
@@ -180,19 +431,184 @@ TypeChecker::traverse_block_expr(BlockExprAst *block) {
   return ty;
 }
 
+// Checks that arg is an unsuffixed integer literal valid as a lane count or below limit as a lane
+// index, and returns its value
+static unsigned
+literal_lane(Ast *arg, uint64_t limit = 0) {
+  auto const num = llvm::dyn_cast<IntegerLiteralExpr>(arg);
+  if (!num || num->get_suffix_type()) {
+    llvm::report_fatal_error("Vec lane counts and shuffle indices must be integer literals");
+  }
+  auto const value = num->get_value();
+  if (limit ? value >= limit : !VecType::valid_lanes(value)) {
+    llvm::report_fatal_error("Vec lane count or shuffle index out of range");
+  }
+  num->set_type(new IntNType(32));
+  return value;
+}
+
+static VecType *
+expect_vector(Type *ty) {
+  auto const vecty = llvm::dyn_cast<VecType>(ty);
+  if (!vecty) {
+    llvm::report_fatal_error("must be Vec");
+  }
+  return vecty;
+}
+
+// Lane indices and slice positions are i32, like slice lengths
+static void
+expect_index(Ast *arg) {
+  if (!coerce_literal(arg, new IntNType(32))->equal(new IntNType(32))) {
+    llvm::report_fatal_error("index must be i32");
+  }
+}
+
+// Slice of integers or u8, which vectors are loaded from and stored to
+static SliceType *
+expect_lane_slice(Type *ty) {
+  auto const slicety = llvm::dyn_cast<SliceType>(ty);
+  auto const elemty = slicety ? slicety->get_elem_type() : nullptr;
+  if (!(llvm::isa_and_nonnull<IntNType>(elemty) || llvm::isa_and_nonnull<U8Type>(elemty))) {
+    llvm::report_fatal_error("must be a Slice of integers or u8");
+  }
+  return slicety;
+}
+
+Type *
+TypeChecker::traverse_vector_builtin(CallExprAst *call, Builtin builtin) {
+  using llvm::isa;
+  auto const nargs = call->get_nargs();
+  auto const arg = [&](size_t n) { return call->get_nth_arg(n); };
+  auto const expect_args = [&](size_t n) {
+    if (nargs != n) {
+      llvm::report_fatal_error("wrong number of arguments");
+    }
+  };
+  Type *ty = nullptr;
+  switch (builtin) {
+    case Builtin::Splat: {
+      expect_args(2);
+      auto const lanes = literal_lane(arg(0));
+      auto const elt = traverse_expr(arg(1));
+      if (!isa<IntNType>(elt) && !isa<U8Type>(elt) && !isa<BoolType>(elt)) {
+        llvm::report_fatal_error("Vec lanes must be integers, u8 or Bool");
+      }
+      ty = new VecType(lanes, elt);
+      break;
+    }
+    case Builtin::Extract: {
+      expect_args(2);
+      ty = expect_vector(traverse_expr(arg(0)))->get_elem_type();
+      traverse_expr(arg(1));
+      expect_index(arg(1));
+      break;
+    }
+    case Builtin::Shuffle: {
+      if (nargs < 3) {
+        llvm::report_fatal_error("wrong number of arguments");
+      }
+      auto const vecty = expect_vector(traverse_expr(arg(0)));
+      if (!vecty->equal(traverse_expr(arg(1)))) {
+        llvm::report_fatal_error("shuffle operands must have the same type");
+      }
+      for (size_t i = 2; i < nargs; ++i) {
+        literal_lane(arg(i), 2 * vecty->get_lanes());
+      }
+      if (!VecType::valid_lanes(nargs - 2)) {
+        llvm::report_fatal_error("Vec lanes must be a power of two up to 64");
+      }
+      ty = new VecType(nargs - 2, vecty->get_elem_type());
+      break;
+    }
+    case Builtin::Select: {
+      expect_args(3);
+      auto const mask = expect_vector(traverse_expr(arg(0)));
+      auto const vecty = traverse_expr(arg(1));
+      auto const lanes = expect_vector(vecty)->get_lanes();
+      auto const bool_mask = isa<BoolType>(mask->get_elem_type()) && mask->get_lanes() == lanes;
+      if (!bool_mask || !vecty->equal(traverse_expr(arg(2)))) {
+        llvm::report_fatal_error("select needs a Vec N Bool and two Vecs of N lanes");
+      }
+      ty = vecty;
+      break;
+    }
+    case Builtin::ReduceAdd:
+    case Builtin::ReduceMul:
+    case Builtin::ReduceMin:
+    case Builtin::ReduceMax: {
+      expect_args(1);
+      auto const vecty = traverse_expr(arg(0));
+      if (!is_integer_vector(vecty)) {
+        llvm::report_fatal_error("must be a Vec of integers or u8");
+      }
+      ty = llvm::cast<VecType>(vecty)->get_elem_type();
+      break;
+    }
+    case Builtin::ReduceAnd:
+    case Builtin::ReduceOr: {
+      expect_args(1);
+      ty = expect_vector(traverse_expr(arg(0)))->get_elem_type();
+      if (!isa<BoolType>(ty)) {
+        llvm::report_fatal_error("must be a Vec of Bool");
+      }
+      break;
+    }
+    case Builtin::LoadVec: {
+      expect_args(3);
+      auto const lanes = literal_lane(arg(0));
+      auto const slicety = expect_lane_slice(traverse_expr(arg(1)));
+      traverse_expr(arg(2));
+      expect_index(arg(2));
+      ty = new VecType(lanes, slicety->get_elem_type());
+      break;
+    }
+    case Builtin::StoreVec: {
+      expect_args(3);
+      auto const slicety = expect_lane_slice(traverse_expr(arg(0)));
+      traverse_expr(arg(1));
+      expect_index(arg(1));
+      auto const vecty = expect_vector(traverse_expr(arg(2)));
+      if (!vecty->get_elem_type()->equal(slicety->get_elem_type())) {
+        llvm::report_fatal_error("store_vec needs a Vec of the slice's element type");
+      }
+      ty = new UnitType;
+      break;
+    }
+    default:
+      llvm_unreachable("not a Vec builtin");
+  }
+  call->set_type(ty);
+  return ty;
+}
+
 Type *
 TypeChecker::traverse_call_expr(CallExprAst *call) {
   auto const callee = call->get_callee();
+  auto const var = llvm::dyn_cast<VarRefExprAst>(callee);
+  if (var && !pimpl->lookup_tyenv(var->get_name())) {
+    auto const builtin = lookup_builtin(var->get_name());
+    if (builtin && is_vector_builtin(*builtin)) {
+      return traverse_vector_builtin(call, *builtin);
+    }
+  }
+  pimpl->callee = callee;
   auto const fnty = llvm::dyn_cast<FunctionType>(traverse_expr(callee));
   if (not fnty) {
     llvm::report_fatal_error("must be function");
   }
+  auto const generic = pimpl->generic_fns.find(fnty);
+  if (generic != pimpl->generic_fns.end()) {
+    return traverse_generic_call(call, generic->second, fnty);
+  }
   auto const arity = fnty->get_arity();
   if (arity != call->get_nargs()) {
     llvm::report_fatal_error("wrong number of arguments");
   }
   for (size_t i = 0; i < arity; ++i) {
-    auto const ty = traverse_expr(call->get_nth_arg(i));
+    auto const arg = call->get_nth_arg(i);
+    traverse_expr(arg);
+    auto const ty = coerce_literal(arg, fnty->get_nth_param(i));
     if (not ty->equal(fnty->get_nth_param(i))) {
       llvm::report_fatal_error("wrong argument");
     }
@@ -201,6 +617,87 @@ TypeChecker::traverse_call_expr(CallExprAst *call) {
   return fnty->get_return_type();
 }
 
+// Binds the type parameters in param to the parts of arg they stand for. Returns whether arg fits.
+static bool
+unify(Type *param, Type *arg, TypeBindings &bindings) {
+  using llvm::dyn_cast;
+  if (auto const tyvar = dyn_cast<TyVar>(param)) {
+    auto const bound = bindings.find(tyvar->get_id());
+    if (bound != bindings.end()) {
+      return bound->second->equal(arg);
+    }
+    bindings[tyvar->get_id()] = arg;
+    return true;
+  }
+  if (auto const slice = dyn_cast<SliceType>(param)) {
+    auto const argslice = dyn_cast<SliceType>(arg);
+    return argslice && unify(slice->get_elem_type(), argslice->get_elem_type(), bindings);
+  }
+  if (auto const fnty = dyn_cast<FunctionType>(param)) {
+    auto const argfn = dyn_cast<FunctionType>(arg);
+    if (!argfn || argfn->get_arity() != fnty->get_arity()) {
+      return false;
+    }
+    for (size_t i = 0, arity = fnty->get_arity(); i < arity; ++i) {
+      if (!unify(fnty->get_nth_param(i), argfn->get_nth_param(i), bindings)) {
+        return false;
+      }
+    }
+    return unify(fnty->get_return_type(), argfn->get_return_type(), bindings);
+  }
+  return param->equal(arg);
+}
+
+// Infers the type arguments of a call to a generic function from its arguments. Those of fixed
+// type go first, so that an unsuffixed literal takes the type a parameter is bound to by another
+// argument and its default type only if none binds it.
+Type *
+TypeChecker::traverse_generic_call(CallExprAst *call, DefFnAst *def, FunctionType *fnty) {
+  auto const arity = fnty->get_arity();
+  if (arity != call->get_nargs()) {
+    llvm::report_fatal_error("wrong number of arguments");
+  }
+  auto const is_literal = [&](size_t i) {
+    auto const num = llvm::dyn_cast<IntegerLiteralExpr>(call->get_nth_arg(i));
+    return num && !num->get_suffix_type();
+  };
+  TypeBindings bindings;
+  for (size_t i = 0; i < arity; ++i) {
+    auto const ty = traverse_expr(call->get_nth_arg(i));
+    if (!is_literal(i) && !unify(fnty->get_nth_param(i), ty, bindings)) {
+      llvm::report_fatal_error("wrong argument");
+    }
+  }
+  for (size_t i = 0; i < arity; ++i) {
+    if (!is_literal(i)) {
+      continue;
+    }
+    auto const arg = call->get_nth_arg(i);
+    auto const want = substitute(fnty->get_nth_param(i), bindings);
+    auto const tyvar = llvm::dyn_cast<TyVar>(want);
+    auto const unbound = tyvar && !bindings.count(tyvar->get_id());
+    auto const ty = unbound ? llvm::cast<ExprAst>(arg)->get_type() : coerce_literal(arg, want);
+    if (!unify(fnty->get_nth_param(i), ty, bindings)) {
+      llvm::report_fatal_error("wrong argument");
+    }
+  }
+
+  std::vector<Type *> type_args;
+  for (auto &&tyvar : def->get_type_params()) {
+    auto const ty = bindings.at(tyvar->get_id());
+    if (tyvar->get_bound() == TyVar::Bound::Int && !is_integer(ty)) {
+      llvm::report_fatal_error(
+        llvm::Twine(def->get_name()) + " needs an integer type for " + tyvar->get_name() + ", not "
+        + type_name(ty));
+    }
+    type_args.push_back(ty);
+  }
+  call->set_type_args(type_args);
+  auto const retty = substitute(fnty->get_return_type(), bindings);
+  call->set_type(retty);
+  return retty;
+}
+
 Type *
 TypeChecker::traverse_decl_stmt(DeclStmtAst *decl) {
   auto const var = decl->get_var_name();
@@ -211,14 +708,40 @@ TypeChecker::traverse_decl_stmt(DeclStmtAst *decl) {
   return unit;
 }
 
+Type *
+TypeChecker::traverse_for_expr(ForExprAst *loop) {
+  auto loty = traverse_expr(loop->get_start());
+  auto hity = traverse_expr(loop->get_end());
+  hity = coerce_literal(loop->get_end(), loty);
+  loty = coerce_literal(loop->get_start(), hity);
+  if (!is_integer(loty) || not loty->equal(hity)) {
+    llvm::report_fatal_error("range bounds must be integers of the same type");
+  }
+  auto const accty = traverse_expr(loop->get_init());
+
+  pimpl->push_tyenv();
+  pimpl->register_type(loop->get_var_name(), loty);
+  pimpl->register_type(loop->get_acc_name(), accty);
+  traverse_expr(loop->get_body());
+  auto const bodyty = coerce_literal(loop->get_body(), accty);
+  if (not accty->equal(bodyty)) {
+    llvm::report_fatal_error("loop body must have the type of the accumulator");
+  }
+  pimpl->pop_tyenv();
+  loop->set_type(accty);
+  return accty;
+}
+
 Type *
 TypeChecker::traverse_if_expr(IfExprAst *ife) {
   auto const condty = traverse_expr(ife->get_cond());
   if (not llvm::isa<BoolType>(condty)) {
     llvm::report_fatal_error("must be bool");
   }
-  auto const thenty = traverse_expr(ife->get_then());
-  auto const elsety = traverse_expr(ife->get_else());
+  auto thenty = traverse_expr(ife->get_then());
+  auto elsety = traverse_expr(ife->get_else());
+  elsety = coerce_literal(ife->get_else(), thenty);
+  thenty = coerce_literal(ife->get_then(), elsety);
   if (not thenty->equal(elsety)) {
     llvm::report_fatal_error("then and else must be the same type");
   }
@@ -226,6 +749,22 @@ TypeChecker::traverse_if_expr(IfExprAst *ife) {
   return thenty;
 }
 
+Type *
+TypeChecker::traverse_integer_literal(IntegerLiteralExpr *num) {
+  auto ty = num->get_suffix_type();
+  if (ty && !literal_fits(num->get_value(), ty)) {
+    llvm::report_fatal_error("integer literal out of range");
+  }
+  if (!ty) {
+    auto const value = num->get_value();
+    auto const i32 = new IntNType(32);
+    auto const i64 = new IntNType(64);
+    ty = literal_fits(value, i32) ? i32 : literal_fits(value, i64) ? i64 : new IntNType(64, false);
+  }
+  num->set_type(ty);
+  return ty;
+}
+
 Type *
 TypeChecker::traverse_let_stmt(LetStmtAst *let) {
   auto const var = let->get_var_name();
@@ -236,9 +775,61 @@ TypeChecker::traverse_let_stmt(LetStmtAst *let) {
   return unit;
 }
 
+Type *
+TypeChecker::traverse_par_expr(ParExprAst *par) {
+  if (par->get_operands().empty()) {
+    llvm::report_fatal_error("Par needs a binary expression or a call with arguments");
+  }
+  auto const ty = traverse_expr(par->get_body());
+  // the operands run on other threads, in no particular order
+  if (!pimpl->effects.is_pure(par)) {
+    llvm::report_fatal_error("Par operands must be pure");
+  }
+  if (pimpl->effects.touches_memo_cache(par)) {
+    llvm::report_fatal_error("Par operands must not reach a Memo function");
+  }
+  par->set_type(ty);
+  return ty;
+}
+
 Type *
 TypeChecker::traverse_var_ref(VarRefExprAst *var) {
-  auto const ty = pimpl->lookup_tyenv(var->get_name());
+  auto ty = pimpl->lookup_tyenv(var->get_name());
+  if (!ty) {
+    auto const builtin = lookup_builtin(var->get_name());
+    if (!builtin) {
+      llvm::report_fatal_error(llvm::Twine("unbound variable ") + var->get_name());
+    }
+    ty = get_builtin_type(*builtin);
+    if (!ty) {
+      llvm::report_fatal_error(llvm::Twine(var->get_name()) + " can only be called");
+    }
+  }
+  if (pimpl->async_fns.count(ty) && var != pimpl->callee) {
+    llvm::report_fatal_error("Async functions can only be called");
+  }
+  if (pimpl->generic_fns.count(ty) && var != pimpl->callee) {
+    llvm::report_fatal_error("generic functions can only be called");
+  }
   var->set_type(ty);
   return ty;
 }
+
+Type *
+TypeChecker::traverse_while_expr(WhileExprAst *loop) {
+  auto const accty = traverse_expr(loop->get_init());
+
+  pimpl->push_tyenv();
+  pimpl->register_type(loop->get_acc_name(), accty);
+  if (not llvm::isa<BoolType>(traverse_expr(loop->get_cond()))) {
+    llvm::report_fatal_error("must be bool");
+  }
+  traverse_expr(loop->get_body());
+  auto const bodyty = coerce_literal(loop->get_body(), accty);
+  if (not accty->equal(bodyty)) {
+    llvm::report_fatal_error("loop body must have the type of the accumulator");
+  }
+  pimpl->pop_tyenv();
+  loop->set_type(accty);
+  return accty;
+}